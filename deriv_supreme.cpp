@@ -6,6 +6,12 @@
 #include <cctype>
 #include <cerrno>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tree_bin.h"
+#include "num_print.h"
+
 #ifndef DEBUG
 #define DEBUGPRINTF(...) printf("\nDEBUG:\n" __VA_ARGS__)
 #else
@@ -15,9 +21,65 @@
 enum
 {
     MAX_NODE_STR_LEN  = 128,
-    MAX_TREE_FILE_LEN = 1024
+    POOL_CHUNK_ITEMS  = 4096
 };
 
+//nodes and their data strings are cut out of big chunks and recycled through
+//free lists, so building and simplifying trees costs no malloc per node
+struct PoolItem
+{
+    PoolItem*   next_;
+};
+
+struct Pool
+{
+    size_t      item_size_;
+    PoolItem*   free_;
+    PoolItem*   chunks_;    //first item of every chunk links the chunks
+};
+
+static void* pool_get(Pool* pool)
+{
+    if (!pool->free_)
+    {
+        char* chunk = (char*) calloc (POOL_CHUNK_ITEMS, pool->item_size_);
+        if (!chunk)
+        {
+            printf("pool_get: error finding memory for %i items of %zu bytes\n", POOL_CHUNK_ITEMS, pool->item_size_);
+            exit(2);
+        }
+        ((PoolItem*) chunk)->next_ = pool->chunks_;
+        pool->chunks_ = (PoolItem*) chunk;
+        for (int i = POOL_CHUNK_ITEMS - 1; i > 0; i--)
+        {
+            PoolItem* item = (PoolItem*) (chunk + (size_t) i * pool->item_size_);
+            item->next_ = pool->free_;
+            pool->free_ = item;
+        }
+    }
+    PoolItem* item = pool->free_;
+    pool->free_ = item->next_;
+    return item;
+}
+
+static void pool_put(Pool* pool, void* item)
+{
+    if (!item)
+        return;
+    ((PoolItem*) item)->next_ = pool->free_;
+    pool->free_ = (PoolItem*) item;
+}
+
+static Pool str_pool = {MAX_NODE_STR_LEN, NULL, NULL};
+
+//every node string is MAX_NODE_STR_LEN long, act() prints numbers into any of them
+static char* node_str_get()
+{
+    char* str = (char*) pool_get(&str_pool);
+    memset(str, 0, MAX_NODE_STR_LEN);
+    return str;
+}
+
 //#define _DEBUG_MODE_
 
 enum NODE_TYPE
@@ -45,11 +107,15 @@ enum NODE_PRTS //priority
         Node    ();
         Node    (char* data);
         Node    (const char* data);
+        Node    (const char* data, size_t len);
         Node    (char actChar);
         Node    (double value);
         Node    (char* data, NODE_TYPE type, NODE_PRTS priority, Node* ancestor);
         ~Node();
 
+        static void* operator new    (size_t size);
+        static void  operator delete (void* ptr);
+
         void        printNode();
         Node*       Dup();
         NODE_TYPE   getType();
@@ -67,10 +133,23 @@ enum NODE_PRTS //priority
         Node*     ancestor_;
     };
 
+    static Pool node_pool = {sizeof(Node), NULL, NULL};
+
+    void* Node::operator new(size_t size)
+    {
+        assert(size == sizeof(Node));
+        return pool_get(&node_pool);
+    }
+
+    void Node::operator delete(void* ptr)
+    {
+        pool_put(&node_pool, ptr);
+    }
+
     Node::Node():
         type_       (TYPE_DEF),
         priority_   (PR_DEF),
-        data_       ((char*) calloc (MAX_NODE_STR_LEN, sizeof(char))),
+        data_       (node_str_get()),
         left_dec_   (NULL),
         right_dec_  (NULL),
         ancestor_   (NULL)
@@ -91,12 +170,7 @@ enum NODE_PRTS //priority
                 printf("Warning: data ptr is NULL in node %p\n", this);
             else
             {
-                data_       = (char*) calloc (MAX_NODE_STR_LEN, sizeof(char));
-                if (!data_)
-                {
-                    printf("error finding memory\n");
-                    exit(2);
-                }
+                data_       = node_str_get();
                 if (!strncpy(data_, data, MAX_NODE_STR_LEN)) 
                 {
                     printf("Error copying data str in node %p\n", this);
@@ -119,12 +193,7 @@ enum NODE_PRTS //priority
                 printf("Warning: data ptr is NULL in node %p\n", this);
             else
             {
-                data_       = (char*) calloc (MAX_NODE_STR_LEN, sizeof(char));
-                if (!data_)
-                {
-                    printf("error finding memory\n");
-                    exit(2);
-                }
+                data_       = node_str_get();
                 if (!strncpy(data_, data, MAX_NODE_STR_LEN)) 
                 {
                     printf("Error copying data str in node %p\n", this);
@@ -143,13 +212,8 @@ enum NODE_PRTS //priority
         right_dec_  (NULL),
         ancestor_   (NULL)
         {
-            data_ = (char*) calloc (MAX_NODE_STR_LEN, sizeof(char));
-            if (!data_)
-            {
-                printf("Error finding memory\n");
-                exit(2);
-            }
-            sprintf(data_, "%lg", value);
+            data_ = node_str_get();
+            num_print(value, data_);
             type_		= TYPE_CONST;
             priority_	= getPriority();
         }
@@ -162,12 +226,7 @@ enum NODE_PRTS //priority
         right_dec_  (NULL),
         ancestor_   (ancestor)
         {
-            data_ = (char*) calloc (MAX_NODE_STR_LEN, sizeof(char));   
-            if (!data_)
-            {
-                printf("Error finding memory\n");
-                exit(2);
-            } 
+            data_ = node_str_get();
             if (!strncpy(data_, data, MAX_NODE_STR_LEN)) 
             {
                 printf("Error copying data str in node %p\n", this);
@@ -186,22 +245,30 @@ enum NODE_PRTS //priority
         right_dec_  (NULL),
         ancestor_   (NULL)
         {                       
-            //                      actchar      + eoline char
-            data_  = (char*) calloc(sizeof(char) + sizeof('\0'), sizeof(char));
-            if (!data_)
-            {
-                printf("Error finding memory\n");
-                exit(2);
-            }
+            data_       = node_str_get();
             data_[0]	= actChar;
             type_		= getType();
             priority_	= getPriority();
         }
 
+    //token view straight from the expression file, it is not '\0'-terminated
+    Node::Node(const char* data, size_t len):
+        type_       (TYPE_DEF),
+        priority_   (PR_DEF),
+        data_       (node_str_get()),
+        left_dec_   (NULL),
+        right_dec_  (NULL),
+        ancestor_   (NULL)
+        {
+            assert(len < MAX_NODE_STR_LEN);
+            memcpy(data_, data, len);
+            type_       = getType();
+            priority_   = getPriority();
+        }
+
     Node::~Node()
     {
-        if (data_)
-            free(data_);
+        pool_put(&str_pool, data_);
         data_     = NULL;
         ancestor_ = NULL;
         type_     = TYPE_DEF;
@@ -303,7 +370,7 @@ enum NODE_PRTS //priority
                 printf("error reading arguments while counting %p node\n", this);
                 exit(3);
             }
-            sprintf(data_, "%lg", res);
+            num_print(res, data_);
             priority_ = PR_LOW;
         }
         printf("counted successfully\n");
@@ -358,7 +425,7 @@ enum NODE_PRTS //priority
     int Node::isFuncName()
     {   
 #define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)    \
+#define MATH_FUNC(funcName, notused, notused_tex) \
         if(!strcmp(#funcName, data_))   \
             return 1;                   
 #include "MATH_FUNCTIONS"
@@ -377,6 +444,8 @@ class Differentator
         void    inFilePrint      ();
         void    inFilePrint_dot  (Node* head);
         void    inFilePrint_tex  (Node* head1, Node* head2);
+        void    inFilePrint_bin  (Node* head);
+        void    useBinaryOutput  ();
         void    buildTree        ();
         void    alterTree        (Node** curNodePtr);
         void    derivative       ();
@@ -389,12 +458,15 @@ class Differentator
         Node*	_nodeDerivDiv    (Node* left_node, Node* right_node);
         Node*	_nodeDerivPow    (Node* left_node, Node* right_node);
         Node*	_nodePow         (Node* left_node, double deg);
-        Node*	_buildTree       (Node*  curNodePtr);
+        Node*	_buildTree       ();
         void	_printTree       (Node*  curNodePtr);
         void	_sprintTree      (Node*  curNodePtr, char* tree_str);
         void	_inFilePrint     (Node*  curNodePtr);  
         void	_inFilePrint_dot (Node*  curNodePtr, FILE* gv_f);
         void	_inFilePrint_tex (Node*  curNodePtr);
+        void	_packTree        (Node*  curNodePtr, Blob* blob);
+        void	_packNode        (Node*  curNodePtr, Blob* ops, Blob* consts, Blob* syms, Blob* sym_names, int* n_syms, int* n_nodes);
+        Node*	_unpackTree      (const unsigned char* rec, size_t len);
         void	_countTree       (Node*  curNodePtr);
         void	_zeroMul         (Node*  curNodePtr);
         void	_zeroSum         (Node** curNodePtr);
@@ -405,7 +477,7 @@ class Differentator
         void	_unitDiv         (Node** curNodePtr);
         int		_d_equal         (double a, double b);
 #define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)                \
+#define MATH_FUNC(funcName, notused, notused_tex)   \
         Node*  _##funcName##Der(Node* curNodePtr);  \
         void   _##funcName##Calc(Node* node);
 #include "MATH_FUNCTIONS"
@@ -416,8 +488,10 @@ class Differentator
         Node*   new_root_;
         FILE*   file_to_write_;
 		FILE*	tx_f;
-        char*   expr_;
-        int     expr_offset_;
+        const char* expr_;    //the mapped expression file
+        size_t  expr_offset_;
+        size_t  expr_len_;
+        int     bin_out_;     //resfile gets tree_bin.h files instead of prefix text
 };
 
 Differentator::Differentator(FILE* file_to_read, FILE* res_file, const char* tex_file):
@@ -426,7 +500,9 @@ Differentator::Differentator(FILE* file_to_read, FILE* res_file, const char* tex
     file_to_write_  (res_file),
 	tx_f			(NULL),
     expr_           (0),
-    expr_offset_    (0)
+    expr_offset_    (0),
+    expr_len_       (0),
+    bin_out_        (0)
     {
 		(tex_file)?tx_f = fopen(tex_file, "w"):tx_f = fopen("MathShit.txt", "w");
 	    if (!tx_f)
@@ -434,28 +510,23 @@ Differentator::Differentator(FILE* file_to_read, FILE* res_file, const char* tex
 	        printf("Differentator: error: cannot open/create .tex file\n");
 	        exit(EXIT_FAILURE);
 	    }
-        unsigned int file_size = 0;
-        fseek(file_to_read, 0, SEEK_END);
-        file_size = (unsigned int) ftell(file_to_read);
-        rewind(file_to_read);
-        assert(MAX_TREE_FILE_LEN >= 1024);
-        if (file_size > MAX_TREE_FILE_LEN)
+        //the file is mapped, not read: the scanner takes tokens right from it
+        struct stat file_stat = {};
+        if (fstat(fileno(file_to_read), &file_stat) == -1 || !file_stat.st_size)
         {
-            printf("Your expression is too bigm I think you're tryina get my prog down, aren't ya?\n");
-            exit(1);
+            printf("Differentator: expression file is empty or unreadable: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
         }
-        expr_ = (char*) calloc (file_size, sizeof(char));
-        printf("fileSize is %u\n", file_size);
-        if (!expr_)
+        expr_len_ = (size_t) file_stat.st_size;
+        printf("fileSize is %zu\n", expr_len_);
+        void* map = mmap(NULL, expr_len_, PROT_READ, MAP_PRIVATE, fileno(file_to_read), 0);
+        if (map == MAP_FAILED)
         {
-            printf("Cannot find memory to read file\n");
-            exit(0);
+            printf("Differentator: cannot map expression file: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
         }
-        if (fscanf(file_to_read, "%s", expr_) == EOF)
-		{
-			printf("Differentator: Error reading expression file: %s\n", strerror(errno));
-			exit(EXIT_FAILURE);
-		}
+        madvise(map, expr_len_, MADV_SEQUENTIAL);
+        expr_ = (const char*) map;
     }
 
 Differentator::~Differentator()
@@ -464,8 +535,9 @@ Differentator::~Differentator()
     delete_subTree(&root_);
     delete_subTree(&new_root_);
     file_to_write_= NULL;
-    free(expr_);
+    munmap(const_cast<char*>(expr_), expr_len_);
     expr_         = NULL;
+    expr_len_     = 0;
     expr_offset_  = 0;
 }
 
@@ -491,49 +563,88 @@ void Differentator::delete_subTree(Node** head)
 
 void Differentator::buildTree()
 {
-    root_ = _buildTree(root_);
+    const unsigned char* body = blob_get_header((const unsigned char*) expr_, expr_len_);
+    root_ = (body)?_unpackTree(body, expr_len_ - TREE_BIN_HEADER_LEN):_buildTree();
 }
 
-Node* Differentator::_buildTree(Node* curNodePtr)
+//Prefix text "(*(x)(2))": a node is '(' token ')' or '(' token child child ')',
+//a child is a node or '_'. One pass over the mapped file: the nodes still
+//waiting for children are kept on a stack and every token is copied right
+//into its node, without scratch buffers or recursion.
+Node* Differentator::_buildTree()
 {
-    int stopCharPtr = 0;
-    expr_offset_++;    // move tree ptr to a char that's next to '('
-    assert (MAX_NODE_STR_LEN >= 128);
-    char* curData = (char*) calloc (MAX_NODE_STR_LEN, sizeof(char));
-    if (!curData)
+    Node*  root   = NULL;
+    Node** stack  = NULL;
+    int*   filled = NULL;   //children already read by the node of the stack
+    int    depth  = 0, cap = 0;
+    expr_offset_  = 0;
+    do
     {
-        printf("error finding memory for putting another node data\n");
-        exit(2);
-    }
-    if (sscanf(expr_ + expr_offset_, "%127[^()_]%n", curData, &stopCharPtr))
-        switch (expr_[expr_offset_ + stopCharPtr])
+        while (expr_offset_ < expr_len_ && isspace((unsigned char) expr_[expr_offset_]))
+            expr_offset_++;
+        if (expr_offset_ >= expr_len_)
         {
-            case '(':
-                expr_offset_ += stopCharPtr;
-                curNodePtr = new Node(curData);
-                
-                curNodePtr->left_dec_   = _buildTree(curNodePtr->left_dec_);
-
-                curNodePtr->right_dec_  = _buildTree(curNodePtr->right_dec_);
-                expr_offset_++; //skipping closing brace
-                break;
-            case ')': //curnodeptr = null + ret cyrnodtr        
-                expr_offset_ += stopCharPtr + 1;
-                curNodePtr = new Node(curData);
-                break;
-            case '_':
-                expr_offset_++;
-                curNodePtr = NULL;
-                break;
-            default:
-                printf("got unknown ruling char '%c' near %i char; worked at %i line\n", expr_[expr_offset_], expr_offset_ + 1, __LINE__);
+            printf("_buildTree: expression ends inside %i open nodes\n", depth);
+            exit(0);
+        }
+        char ruling = expr_[expr_offset_++];
+        if (ruling == ')' || ruling == '_')
+        {
+            if (!depth || (ruling == '_' && filled[depth - 1] == 2))
+            {
+                printf("_buildTree: unexpected '%c' near %zu char\n", ruling, expr_offset_);
                 exit(0);
-                break;
+            }
+            (ruling == ')')?depth--:filled[depth - 1]++;
+            continue;
         }
-    else
-        printf("error reading expression\n");
-    free(curData);
-    return curNodePtr;
+        if (ruling != '(' || (depth && filled[depth - 1] == 2))
+        {
+            printf("got unknown ruling char '%c' near %zu char; worked at %i line\n", ruling, expr_offset_, __LINE__);
+            exit(0);
+        }
+
+        size_t tok = expr_offset_;
+        while (expr_offset_ < expr_len_ && !strchr("()_", expr_[expr_offset_]) && !isspace((unsigned char) expr_[expr_offset_]))
+            expr_offset_++;
+        if (expr_offset_ == tok || expr_offset_ - tok >= MAX_NODE_STR_LEN)
+        {
+            printf("_buildTree: empty or too long token near %zu char\n", tok + 1);
+            exit(0);
+        }
+        Node* node = new Node(expr_ + tok, expr_offset_ - tok);
+        if (!depth)
+            root = node;
+        else if (filled[depth - 1]++)
+            stack[depth - 1]->right_dec_ = node;
+        else
+            stack[depth - 1]->left_dec_  = node;
+
+        while (expr_offset_ < expr_len_ && isspace((unsigned char) expr_[expr_offset_]))
+            expr_offset_++;
+        if (expr_offset_ < expr_len_ && expr_[expr_offset_] == ')')
+        {
+            expr_offset_++; //a leaf is closed right away
+            continue;
+        }
+        if (depth == cap)
+        {
+            cap    = (cap)?cap * 2:64;
+            stack  = (Node**) realloc (stack,  (size_t) cap * sizeof(Node*));
+            filled = (int*)   realloc (filled, (size_t) cap * sizeof(int));
+            if (!stack || !filled)
+            {
+                printf("_buildTree: error finding memory for %i open nodes\n", cap);
+                exit(2);
+            }
+        }
+        stack[depth]    = node;
+        filled[depth++] = 0;
+    }
+    while (depth);
+    free(stack);
+    free(filled);
+    return root;
 }
 
 void Differentator::inFilePrint()
@@ -551,6 +662,216 @@ void Differentator::_inFilePrint(Node* curNodePtr)
     fprintf(file_to_write_,")");
 }
 
+void Differentator::useBinaryOutput()
+{
+    bin_out_ = 1;
+}
+
+void Differentator::inFilePrint_bin(Node* head)
+{
+    Blob blob = {};
+    blob_put_header(&blob);
+    _packTree(head, &blob);
+    if (fwrite(blob.data_, 1, blob.size_, file_to_write_) != blob.size_)
+        printf("inFilePrint_bin: error writing %zu bytes: %s\n", blob.size_, strerror(errno));
+    free(blob.data_);
+}
+
+//writes the tree body of tree_bin.h, without the file header
+void Differentator::_packTree(Node* curNodePtr, Blob* blob)
+{
+    Blob ops = {}, consts = {}, syms = {}, sym_names = {};
+    int  n_syms = 0, n_nodes = 0;
+
+    _packNode(curNodePtr, &ops, &consts, &syms, &sym_names, &n_syms, &n_nodes);
+
+    blob_put_varint(blob, (unsigned long long) n_nodes);
+    blob_put_varint(blob, consts.size_ / sizeof(double));
+    blob_put_varint(blob, (unsigned long long) n_syms);
+    if (consts.size_) blob_put(blob, consts.data_, consts.size_);
+    if (syms.size_)   blob_put(blob, syms.data_,   syms.size_);
+    if (ops.size_)    blob_put(blob, ops.data_,    ops.size_);
+    free(ops.data_);
+    free(consts.data_);
+    free(syms.data_);
+    free(sym_names.data_);
+}
+
+void Differentator::_packNode(Node* curNodePtr, Blob* ops, Blob* consts, Blob* syms, Blob* sym_names, int* n_syms, int* n_nodes)
+{
+    if (!curNodePtr)
+        return;
+    _packNode(curNodePtr->left_dec_,  ops, consts, syms, sym_names, n_syms, n_nodes);
+    _packNode(curNodePtr->right_dec_, ops, consts, syms, sym_names, n_syms, n_nodes);
+    (*n_nodes)++;
+
+    switch(curNodePtr->type_)
+    {
+        case TYPE_CONST:
+        {
+            double val = 0.0;
+            sscanf(curNodePtr->data_, "%lg", &val);
+            blob_put(consts, &val, sizeof(double));
+            blob_put(ops, "c", 1);
+            break;
+        }
+        case TYPE_VAR:
+        case TYPE_FUNC:
+        {
+            //there are a few distinct names in a tree, linear search is fine
+            char** names = (char**) sym_names->data_;
+            int sym = 0;
+            while (sym < *n_syms && strcmp(names[sym], curNodePtr->data_))
+                sym++;
+            if (sym == *n_syms)
+            {
+                blob_put_varint(syms, strlen(curNodePtr->data_));
+                blob_put(syms, curNodePtr->data_, strlen(curNodePtr->data_));
+                blob_put(sym_names, &curNodePtr->data_, sizeof(char*));
+                (*n_syms)++;
+            }
+            blob_put(ops, (curNodePtr->type_ == TYPE_VAR)?"v":"f", 1);
+            blob_put_varint(ops, (unsigned long long) sym);
+            if (curNodePtr->type_ == TYPE_FUNC)
+                blob_put_varint(ops, 1);
+            break;
+        }
+        case TYPE_ACT:
+            blob_put(ops, curNodePtr->data_, 1);
+            blob_put_varint(ops, 2);
+            break;
+        case TYPE_DEF:
+        default:
+            printf("_packNode: node %p type is not set\n", curNodePtr);
+            exit(4);
+    }
+}
+
+Node* Differentator::_unpackTree(const unsigned char* rec, size_t len)
+{
+    const unsigned char* pos = rec;
+    const unsigned char* end = rec + len;
+    unsigned long long n_nodes  = blob_get_varint(&pos, end);
+    unsigned long long n_consts = blob_get_varint(&pos, end);
+    unsigned long long n_syms   = blob_get_varint(&pos, end);
+    const unsigned char* consts = pos;
+    unsigned long long   n_used = 0;
+    if (n_consts > (unsigned long long) (end - pos) / sizeof(double))
+    {
+        printf("_unpackTree: broken const table\n");
+        exit(5);
+    }
+    pos += n_consts * sizeof(double);
+
+    char** syms  = (char**) calloc ((size_t) n_syms + 1,  sizeof(char*));
+    Node** stack = (Node**) calloc ((size_t) n_nodes + 1, sizeof(Node*));
+    if (!syms || !stack || pos > end)
+    {
+        printf("_unpackTree: broken record or no memory for %llu nodes\n", n_nodes);
+        exit(5);
+    }
+    for (unsigned long long i = 0; i < n_syms; i++)
+    {
+        unsigned long long sym_len = blob_get_varint(&pos, end);
+        if (pos + sym_len > end || sym_len >= MAX_NODE_STR_LEN || !(syms[i] = strndup((const char*) pos, sym_len)))
+        {
+            printf("_unpackTree: broken symbol table\n");
+            exit(5);
+        }
+        pos += sym_len;
+    }
+
+    int depth = 0;
+    for (unsigned long long i = 0; i < n_nodes; i++)
+    {
+        if (pos >= end)
+        {
+            printf("_unpackTree: record is truncated\n");
+            exit(5);
+        }
+        unsigned char op = *pos++;
+        Node* node = NULL;
+        switch(op)
+        {
+            case 'c':
+            {
+                double val = 0.0;
+                if (n_used++ == n_consts)
+                {
+                    printf("_unpackTree: broken const table\n");
+                    exit(5);
+                }
+                memcpy(&val, consts, sizeof(double));
+                consts += sizeof(double);
+                node = new Node(val);
+                break;
+            }
+            case 'v':
+            case 'f':
+            {
+                unsigned long long sym    = blob_get_varint(&pos, end);
+                unsigned long long n_kids = (op == 'f')?blob_get_varint(&pos, end):0;
+                if (sym >= n_syms || (op == 'f' && (n_kids != 1 || !depth)))
+                {
+                    printf("_unpackTree: broken symbol reference\n");
+                    exit(5);
+                }
+                node = new Node(syms[sym]);
+                if (op == 'f')
+                    node->left_dec_ = stack[--depth];
+                break;
+            }
+            case '+':
+            case '-':
+            case '*':
+            case '/':
+            case '^':
+            {
+                unsigned long long n_kids = blob_get_varint(&pos, end);
+                if (n_kids < 2 || (n_kids > 2 && op != '+' && op != '*') || n_kids > (unsigned long long) depth)
+                {
+                    printf("_unpackTree: action '%c' needs 2 operands\n", op);
+                    exit(5);
+                }
+                //full sized data, act() folds numbers into it;
+                //an n-ary '+' or '*' becomes a chain of binary ones
+                char act_str[2] = {(char) op, '\0'};
+                int  first      = depth - (int) n_kids;
+                node = stack[first];
+                for (int k = first + 1; k < depth; k++)
+                {
+                    Node* chain = new Node(act_str);
+                    chain->left_dec_  = node;
+                    chain->right_dec_ = stack[k];
+                    node = chain;
+                }
+                depth = first;
+                break;
+            }
+            default:
+                printf("_unpackTree: unknown op '%c'\n", op);
+                exit(5);
+        }
+        stack[depth++] = node;
+    }
+    Node* res = (depth == 1)?stack[0]:NULL;
+    if (!res)
+    {
+        printf("_unpackTree: record holds %i trees instead of one\n", depth);
+        exit(5);
+    }
+    if (n_used != n_consts)
+    {
+        printf("_unpackTree: broken const table\n");
+        exit(5);
+    }
+    for (unsigned long long i = 0; i < n_syms; i++)
+        free(syms[i]);
+    free(syms);
+    free(stack);
+    return res;
+}
+
 void Differentator::inFilePrint_dot(Node* head)
 {
     if (head)
@@ -756,14 +1077,14 @@ void Differentator::_sprintTree(Node* curNodePtr, char* tree_str)
 }
 
 #define _FUNCTIONS_
-#define MATH_FUNC(funcName, cppFuncName)                    \
+#define MATH_FUNC(funcName, cppFuncName, notused_tex)           \
 void Differentator::_##funcName##Calc(Node* node)           \
 {                                                           \
     if (node->left_dec_->type_ == TYPE_CONST)               \
     {                                                       \
         double argument = 0.0;                              \
         sscanf(node->left_dec_->data_, "%lg", &argument);   \
-        sprintf(node->data_, "%lg", cppFuncName(argument)); \
+        num_print(cppFuncName(argument), node->data_);      \
         delete node->left_dec_;                             \
         node->left_dec_ = NULL;                             \
         node->type_ = TYPE_CONST;                           \
@@ -833,7 +1154,7 @@ void Differentator::_countTree(Node* curNodePtr)
     if (curNodePtr->type_ == TYPE_FUNC)
     {
 #define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)\
+#define MATH_FUNC(funcName, notused, notused_tex)\
 if(!strcmp(curNodePtr->data_, #funcName))\
     _##funcName##Calc(curNodePtr);
 #include "MATH_FUNCTIONS"
@@ -1114,7 +1435,7 @@ Node* Differentator::_derivative(Node* curNodePtr)
             }
         case TYPE_FUNC:
 #define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)\
+#define MATH_FUNC(funcName, notused, notused_tex)\
             if (!strcmp(curNodePtr->data_, #funcName))\
                 return _##funcName##Der(curNodePtr);
 #include "MATH_FUNCTIONS"
@@ -1150,6 +1471,98 @@ Node* Differentator::_sinDer(Node* curNodePtr)
     return res_node;
 }
 
+Node* Differentator::_cosDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('*');
+    Node* new_l = new Node('*');
+    new_l->left_dec_  = new Node("-1");
+    new_l->right_dec_ = curNodePtr->Dup();
+    sprintf(new_l->right_dec_->data_, "sin");
+    Node* new_r = _derivative(curNodePtr->left_dec_);
+
+    res_node->left_dec_  = new_l;
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
+Node* Differentator::_expDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('*');
+    res_node->left_dec_  = curNodePtr->Dup();
+    res_node->right_dec_ = _derivative(L_BRANCH);
+    return res_node;
+}
+
+Node* Differentator::_tanDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('/');
+    Node* new_r    = new Node('^');
+    new_r->left_dec_  = new Node("cos");
+    new_r->left_dec_->left_dec_ = L_BRANCH->Dup();
+    new_r->right_dec_ = new Node("2");
+
+    res_node->left_dec_  = _derivative(L_BRANCH);
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
+Node* Differentator::_sqrtDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('/');
+    Node* new_r    = new Node('*');
+    new_r->left_dec_  = new Node("2");
+    new_r->right_dec_ = curNodePtr->Dup();
+
+    res_node->left_dec_  = _derivative(L_BRANCH);
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
+//(1 - u^2)^0.5, the denominator of asin and acos
+static Node* asin_root(Node* arg_node)
+{
+    Node* sub_node = new Node('-');
+    sub_node->left_dec_  = new Node("1");
+    sub_node->right_dec_ = new Node('^');
+    sub_node->right_dec_->left_dec_  = arg_node->Dup();
+    sub_node->right_dec_->right_dec_ = new Node("2");
+
+    Node* root_node = new Node('^');
+    root_node->left_dec_  = sub_node;
+    root_node->right_dec_ = new Node("0.5");
+    return root_node;
+}
+
+Node* Differentator::_asinDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('/');
+    res_node->left_dec_  = _derivative(L_BRANCH);
+    res_node->right_dec_ = asin_root(L_BRANCH);
+    return res_node;
+}
+
+Node* Differentator::_acosDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('/');
+    res_node->left_dec_ = new Node('*');
+    res_node->left_dec_->left_dec_  = new Node("-1");
+    res_node->left_dec_->right_dec_ = _derivative(L_BRANCH);
+    res_node->right_dec_ = asin_root(L_BRANCH);
+    return res_node;
+}
+
+Node* Differentator::_atanDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('/');
+    Node* new_r    = new Node('+');
+    new_r->left_dec_  = new Node("1");
+    new_r->right_dec_ = _nodePow(L_BRANCH, 2.0);
+
+    res_node->left_dec_  = _derivative(L_BRANCH);
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
 #undef L_BRANCH
 #undef R_BRANCH
 
@@ -1185,6 +1598,7 @@ void Differentator::derivative()
     printTree(root_);
     printf("\n\n");
     inFilePrint_tex(root_, new_root_);
+    (bin_out_)?inFilePrint_bin(new_root_):_inFilePrint(new_root_);
 }
 
 int main(int argc, char* argv[])
@@ -1194,8 +1608,8 @@ int main(int argc, char* argv[])
         printf("Usage: %s [expression_file] [resfile]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
-    FILE* f_expr = fopen(argv[1], "r");
-    FILE* res_f  = fopen(argv[2], "w");
+    FILE* f_expr = fopen(argv[1], "rb");
+    FILE* res_f  = fopen(argv[2], "wb");
     if (!f_expr)
     {
         printf("Invalid exprfile name\n");
@@ -1207,6 +1621,9 @@ int main(int argc, char* argv[])
         exit(0);
     }
     Differentator my_diff(f_expr, res_f, "MathShit.tex");
+    size_t res_len = strlen(argv[2]);
+    if (res_len > 4 && !strcmp(argv[2] + res_len - 4, ".dtb"))
+        my_diff.useBinaryOutput();
 
     my_diff.buildTree();
     printf("BUILDED!\n");
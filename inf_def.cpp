@@ -358,7 +358,7 @@ enum NODE_PRTS //priority
     int Node::isFuncName()
     {   
 #define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)    \
+#define MATH_FUNC(funcName, notused, notused_tex) \
         if(!strcmp(#funcName, data_))   \
             return 1;                   
 #include "MATH_FUNCTIONS"
@@ -413,7 +413,7 @@ class Differentator
         void	_unitDiv         (Node** curNodePtr);
         int		_d_equal         (double a, double b);
 #define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)                \
+#define MATH_FUNC(funcName, notused, notused_tex)   \
         Node*  _##funcName##Der(Node* curNodePtr);  \
         void   _##funcName##Calc(Node* node);
 #include "MATH_FUNCTIONS"
@@ -879,7 +879,7 @@ void Differentator::_sprintTree(Node* curNodePtr, char* tree_str)
 }
 
 #define _FUNCTIONS_
-#define MATH_FUNC(funcName, cppFuncName)                    \
+#define MATH_FUNC(funcName, cppFuncName, notused_tex)           \
 void Differentator::_##funcName##Calc(Node* node)           \
 {                                                           \
     if (node->left_dec_->type_ == TYPE_CONST)               \
@@ -956,7 +956,7 @@ void Differentator::_countTree(Node* curNodePtr)
     if (curNodePtr->type_ == TYPE_FUNC)
     {
 #define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)\
+#define MATH_FUNC(funcName, notused, notused_tex)\
 if(!strcmp(curNodePtr->data_, #funcName))\
     _##funcName##Calc(curNodePtr);
 #include "MATH_FUNCTIONS"
@@ -1237,7 +1237,7 @@ Node* Differentator::_derivative(Node* curNodePtr)
             }
         case TYPE_FUNC:
 #define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)\
+#define MATH_FUNC(funcName, notused, notused_tex)\
             if (!strcmp(curNodePtr->data_, #funcName))\
                 return _##funcName##Der(curNodePtr);
 #include "MATH_FUNCTIONS"
@@ -1273,6 +1273,98 @@ Node* Differentator::_sinDer(Node* curNodePtr)
     return res_node;
 }
 
+Node* Differentator::_cosDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('*');
+    Node* new_l = new Node('*');
+    new_l->left_dec_  = new Node("-1");
+    new_l->right_dec_ = curNodePtr->Dup();
+    sprintf(new_l->right_dec_->data_, "sin");
+    Node* new_r = _derivative(curNodePtr->left_dec_);
+
+    res_node->left_dec_  = new_l;
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
+Node* Differentator::_expDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('*');
+    res_node->left_dec_  = curNodePtr->Dup();
+    res_node->right_dec_ = _derivative(L_BRANCH);
+    return res_node;
+}
+
+Node* Differentator::_tanDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('/');
+    Node* new_r    = new Node('^');
+    new_r->left_dec_  = new Node("cos");
+    new_r->left_dec_->left_dec_ = L_BRANCH->Dup();
+    new_r->right_dec_ = new Node("2");
+
+    res_node->left_dec_  = _derivative(L_BRANCH);
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
+Node* Differentator::_sqrtDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('/');
+    Node* new_r    = new Node('*');
+    new_r->left_dec_  = new Node("2");
+    new_r->right_dec_ = curNodePtr->Dup();
+
+    res_node->left_dec_  = _derivative(L_BRANCH);
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
+//(1 - u^2)^0.5, the denominator of asin and acos
+static Node* asin_root(Node* arg_node)
+{
+    Node* sub_node = new Node('-');
+    sub_node->left_dec_  = new Node("1");
+    sub_node->right_dec_ = new Node('^');
+    sub_node->right_dec_->left_dec_  = arg_node->Dup();
+    sub_node->right_dec_->right_dec_ = new Node("2");
+
+    Node* root_node = new Node('^');
+    root_node->left_dec_  = sub_node;
+    root_node->right_dec_ = new Node("0.5");
+    return root_node;
+}
+
+Node* Differentator::_asinDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('/');
+    res_node->left_dec_  = _derivative(L_BRANCH);
+    res_node->right_dec_ = asin_root(L_BRANCH);
+    return res_node;
+}
+
+Node* Differentator::_acosDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('/');
+    res_node->left_dec_ = new Node('*');
+    res_node->left_dec_->left_dec_  = new Node("-1");
+    res_node->left_dec_->right_dec_ = _derivative(L_BRANCH);
+    res_node->right_dec_ = asin_root(L_BRANCH);
+    return res_node;
+}
+
+Node* Differentator::_atanDer(Node* curNodePtr)
+{
+    Node* res_node = new Node('/');
+    Node* new_r    = new Node('+');
+    new_r->left_dec_  = new Node("1");
+    new_r->right_dec_ = _nodePow(L_BRANCH, 2.0);
+
+    res_node->left_dec_  = _derivative(L_BRANCH);
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
 #undef L_BRANCH
 #undef R_BRANCH
 
@@ -5,6 +5,17 @@
 #include <cassert>
 #include <cctype>
 #include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <spawn.h>
+#include "tree_bin.h"
+#include "num_parse.h"
+#include "num_print.h"
 
 #ifndef DEBUG
 #define DEBUGPRINTF(...) printf("\nDEBUG:\n" __VA_ARGS__)
@@ -15,9 +26,23 @@
 enum
 {
     MAX_NODE_STR_LEN  = 128,
-    MAX_TREE_FILE_LEN = 1024
+    MAX_TREE_FILE_LEN = 65536,
+    LET_MIN_SIZE      = 5,      //nodes a shared subtree needs to get a name of its own with --let
+    BOUND_MAX_BOXES   = 1 << 16,//boxes bound looks at for each of min and max
+    BOUND_MAX_DEPTH   = 60      //halvings of a box before its interval bound is taken as it is
 };
 
+//Exact comparison of doubles, for the places that mean it: consts folded
+//from literals, integer exponents, interned literals. All such compares go
+//through here, so -Wfloat-equal is off for this one function only.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wfloat-equal"
+static inline int exact_equal(double a, double b)
+{
+    return a == b;
+}
+#pragma GCC diagnostic pop
+
 //#define _DEBUG_MODE_
 
 enum NODE_TYPE
@@ -27,6 +52,8 @@ enum NODE_TYPE
     TYPE_VAR,
     TYPE_CONST,
     TYPE_FUNC,
+    TYPE_SUM,       //n-ary '+' and '*', operands are in kids_
+    TYPE_PROD,
 };
 
 
@@ -39,6 +66,29 @@ enum NODE_PRTS //priority
     PR_FUNC
 };
 
+enum MATH_FUNC_ID
+{
+#define _FUNCTIONS_
+#define MATH_FUNC(funcName, notused, notused_tex) FUNC_##funcName,
+#include "MATH_FUNCTIONS"
+#undef MATH_FUNC
+#undef _FUNCTIONS_
+    FUNC_CNT
+};
+
+//names are resolved once, when a node is made; everything after that indexes math_funcs by func_id_
+static int func_id(const char* name)
+{
+#define _FUNCTIONS_
+#define MATH_FUNC(funcName, notused, notused_tex)   \
+    if (!strcmp(name, #funcName))                   \
+        return FUNC_##funcName;
+#include "MATH_FUNCTIONS"
+#undef MATH_FUNC
+#undef _FUNCTIONS_
+    return -1;
+}
+
     class Node
     {
     public:
@@ -46,6 +96,7 @@ enum NODE_PRTS //priority
         Node    (char* data);
         Node    (const char* data);
         Node    (char actChar);
+        Node    (char actChar, int n_kids);
         Node    (double value);
         Node    (char* data, NODE_TYPE type, NODE_PRTS priority, Node* ancestor);
         ~Node();
@@ -57,7 +108,9 @@ enum NODE_PRTS //priority
         void        act(); 
         int         hasLeftGrandChildren();
         int         hasRightGrandChildren();
-        int         isFuncName();
+        Node*       Share();
+        void        setConst(double value);
+        int         isAct();
 
         NODE_TYPE type_;
         NODE_PRTS priority_;
@@ -65,6 +118,14 @@ enum NODE_PRTS //priority
         Node*     left_dec_;
         Node*     right_dec_;
         Node*     ancestor_;
+        int       refs_;      //owners of the node; subtrees may be shared between trees
+        int       var_id_;    //index in Differentator's var table, -1 for non-var nodes
+        unsigned long long hash_; //structural hash of the subtree, 0 until Differentator::_treeHash
+        int       frozen_;    //in Differentator's table of shared subtrees: simplified, never rewritten again
+        double    value_;     //exact value of a const node, data_ only shows it
+        int       func_id_;   //MATH_FUNC_ID of a func node, -1 otherwise
+        Node**    kids_;      //operands of TYPE_SUM and TYPE_PROD, NULL for the rest
+        int       n_kids_;
     };
 
     Node::Node():
@@ -73,7 +134,15 @@ enum NODE_PRTS //priority
         data_       ((char*) calloc (MAX_NODE_STR_LEN, sizeof(char))),
         left_dec_   (NULL),
         right_dec_  (NULL),
-        ancestor_   (NULL)
+        ancestor_   (NULL),
+        refs_       (1),
+        var_id_     (-1),
+        hash_       (0),
+        frozen_     (0),
+        value_      (0.0),
+        func_id_    (-1),
+        kids_       (NULL),
+        n_kids_     (0)
         {
             if (!data_)
                 printf("Warning: created node %p with empty data\n", this);
@@ -85,7 +154,15 @@ enum NODE_PRTS //priority
         data_       (NULL),
         left_dec_   (NULL),
         right_dec_  (NULL),
-        ancestor_   (NULL)
+        ancestor_   (NULL),
+        refs_       (1),
+        var_id_     (-1),
+        hash_       (0),
+        frozen_     (0),
+        value_      (0.0),
+        func_id_    (-1),
+        kids_       (NULL),
+        n_kids_     (0)
         {
             if (!data)
                 printf("Warning: data ptr is NULL in node %p\n", this);
@@ -104,6 +181,8 @@ enum NODE_PRTS //priority
                 }
                 type_       = getType();
                 priority_   = getPriority();
+                if (type_ == TYPE_CONST)
+                    num_parse(data_, data_ + strlen(data_), &value_);
             }
         } 
 
@@ -113,7 +192,15 @@ enum NODE_PRTS //priority
         data_       (NULL),
         left_dec_   (NULL),
         right_dec_  (NULL),
-        ancestor_   (NULL)
+        ancestor_   (NULL),
+        refs_       (1),
+        var_id_     (-1),
+        hash_       (0),
+        frozen_     (0),
+        value_      (0.0),
+        func_id_    (-1),
+        kids_       (NULL),
+        n_kids_     (0)
         {
             if (!data)//strcpy + calloc
                 printf("Warning: data ptr is NULL in node %p\n", this);
@@ -132,6 +219,8 @@ enum NODE_PRTS //priority
                 }
                 type_       = getType();
                 priority_   = getPriority();
+                if (type_ == TYPE_CONST)
+                    num_parse(data_, data_ + strlen(data_), &value_);
             }
         }
 
@@ -141,7 +230,15 @@ enum NODE_PRTS //priority
         data_       (NULL),
         left_dec_   (NULL),
         right_dec_  (NULL),
-        ancestor_   (NULL)
+        ancestor_   (NULL),
+        refs_       (1),
+        var_id_     (-1),
+        hash_       (0),
+        frozen_     (0),
+        value_      (0.0),
+        func_id_    (-1),
+        kids_       (NULL),
+        n_kids_     (0)
         {
             data_ = (char*) calloc (MAX_NODE_STR_LEN, sizeof(char));
             if (!data_)
@@ -149,7 +246,8 @@ enum NODE_PRTS //priority
                 printf("Error finding memory\n");
                 exit(2);
             }
-            sprintf(data_, "%lg", value);
+            num_print(value, data_);
+            value_      = value;
             type_		= TYPE_CONST;
             priority_	= getPriority();
         }
@@ -160,7 +258,15 @@ enum NODE_PRTS //priority
         data_       (NULL),
         left_dec_   (NULL),
         right_dec_  (NULL),
-        ancestor_   (ancestor)
+        ancestor_   (ancestor),
+        refs_       (1),
+        var_id_     (-1),
+        hash_       (0),
+        frozen_     (0),
+        value_      (0.0),
+        func_id_    (-1),
+        kids_       (NULL),
+        n_kids_     (0)
         {
             data_ = (char*) calloc (MAX_NODE_STR_LEN, sizeof(char));   
             if (!data_)
@@ -184,10 +290,18 @@ enum NODE_PRTS //priority
         data_       (NULL),
         left_dec_   (NULL),
         right_dec_  (NULL),
-        ancestor_   (NULL)
+        ancestor_   (NULL),
+        refs_       (1),
+        var_id_     (-1),
+        hash_       (0),
+        frozen_     (0),
+        value_      (0.0),
+        func_id_    (-1),
+        kids_       (NULL),
+        n_kids_     (0)
         {                       
-            //                      actchar      + eoline char
-            data_  = (char*) calloc(sizeof(char) + sizeof('\0'), sizeof(char));
+            //act nodes get folded in place by act(), so they need room for a number
+            data_  = (char*) calloc(MAX_NODE_STR_LEN, sizeof(char));
             if (!data_)
             {
                 printf("Error finding memory\n");
@@ -196,12 +310,41 @@ enum NODE_PRTS //priority
             data_[0]	= actChar;
             type_		= getType();
             priority_	= getPriority();
+            if (type_ == TYPE_CONST)
+                value_  = actChar - '0';
+        }
+
+    //n-ary sum or product of n_kids operands, kids_ is for the caller to fill
+    Node::Node(char actChar, int n_kids):
+        type_       ((actChar == '+')?TYPE_SUM:TYPE_PROD),
+        priority_   ((actChar == '+')?PR_LOW:PR_MID),
+        data_       ((char*) calloc (MAX_NODE_STR_LEN, sizeof(char))),
+        left_dec_   (NULL),
+        right_dec_  (NULL),
+        ancestor_   (NULL),
+        refs_       (1),
+        var_id_     (-1),
+        hash_       (0),
+        frozen_     (0),
+        value_      (0.0),
+        func_id_    (-1),
+        kids_       ((Node**) calloc ((size_t) n_kids + 1, sizeof(Node*))),
+        n_kids_     (n_kids)
+        {
+            if (!data_ || !kids_)
+            {
+                printf("Error finding memory for %i operands\n", n_kids);
+                exit(2);
+            }
+            data_[0] = actChar;
         }
 
     Node::~Node()
     {
         if (data_)
             free(data_);
+        free(kids_);
+        kids_     = NULL;
         data_     = NULL;
         ancestor_ = NULL;
         type_     = TYPE_DEF;
@@ -225,7 +368,8 @@ enum NODE_PRTS //priority
         if (isdigit(data_[0]))
             return TYPE_CONST;
 
-        if (isFuncName())
+        func_id_ = func_id(data_);
+        if (func_id_ >= 0)
             return TYPE_FUNC;
 
         if (isalpha(data_[0]))
@@ -252,6 +396,10 @@ enum NODE_PRTS //priority
                     return PR_HIG;
             case TYPE_FUNC:
                 return PR_FUNC;
+            case TYPE_SUM:
+                return PR_LOW;
+            case TYPE_PROD:
+                return PR_MID;
             case TYPE_DEF:
                 return PR_DEF;
             default:
@@ -267,12 +415,11 @@ enum NODE_PRTS //priority
             left_dec_->data_ && right_dec_->data_)
         {
             printf("entered act func; action '%c'\n", data_[0]);
-            double a = 0.0, b = 0.0, res = 0.0;
+            double a = left_dec_->value_, b = right_dec_->value_, res = 0.0;
             printf("decs data: '%s'%x lr '%s'%x\n", 
                     left_dec_->data_,  (unsigned int) *left_dec_->data_, 
                     right_dec_->data_, (unsigned int) *right_dec_->data_ );
-            if (sscanf(left_dec_->data_,  "%lg", &a) && 
-                sscanf(right_dec_->data_, "%lg", &b))
+            if (left_dec_->type_ == TYPE_CONST && right_dec_->type_ == TYPE_CONST)
             {
                 printf("got operands %lg %lg\n", a, b);
                 switch(*data_)
@@ -303,15 +450,18 @@ enum NODE_PRTS //priority
                 printf("error reading arguments while counting %p node\n", this);
                 exit(3);
             }
-            sprintf(data_, "%lg", res);
-            priority_ = PR_LOW;
+            setConst(res);
         }
         printf("counted successfully\n");
     }
 
     Node* Node::Dup()//construc
     {
-        Node* newNodePtr = new Node(data_, type_, priority_, ancestor_);
+        Node* newNodePtr = (kids_)?new Node(data_[0], n_kids_):new Node(data_, type_, priority_, ancestor_);
+        newNodePtr->var_id_ = var_id_;
+        newNodePtr->value_  = value_;
+        for (int i = 0; i < n_kids_; i++)
+            newNodePtr->kids_[i] = kids_[i]->Dup();
 
         if (left_dec_)
             newNodePtr->left_dec_  = left_dec_->Dup();
@@ -322,6 +472,29 @@ enum NODE_PRTS //priority
         return newNodePtr;
     }
 
+    Node* Node::Share()
+    {
+        refs_++;
+        return this;
+    }
+
+    //binary or n-ary arithmetic, the nodes printed as operators
+    int Node::isAct()
+    {
+        return type_ == TYPE_ACT || type_ == TYPE_SUM || type_ == TYPE_PROD;
+    }
+
+    //turns the node into a const in place, its children are the caller's business
+    void Node::setConst(double value)
+    {
+        value_      = value;
+        num_print(value, data_);
+        type_       = TYPE_CONST;
+        priority_   = PR_LOW;
+        hash_       = 0;
+        func_id_    = -1;
+    }
+
     void Node::printNode()
     {
         printf("\n");
@@ -340,6 +513,8 @@ enum NODE_PRTS //priority
             }
             printf("Left descendant  ptr %p\n", left_dec_);
             printf("Right descendant ptr %p\n", right_dec_);
+            if (kids_)
+                printf("Operands         %i\n", n_kids_);
             if (left_dec_)
             {
                 printf("left dec data    ptr %p\n", left_dec_->data_);
@@ -355,989 +530,5911 @@ enum NODE_PRTS //priority
         }
     }
 
-    int Node::isFuncName()
-    {   
-#define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)    \
-        if(!strcmp(#funcName, data_))   \
-            return 1;                   
-#include "MATH_FUNCTIONS"
-#undef MATH_FUNC
-#undef _FUNCTIONS_
-    return 0;
-    }
-
-class Differentator
-{
-    public:    
-        Differentator   (FILE* file_to_read, FILE* res_file, const char* tex_file);
-        ~Differentator  ();
-        void    delete_subTree   (Node** head);
-        void    printTree        (Node* root);
-        void    inFilePrint      ();
-        void    inFilePrint_dot  (Node* head);
-        void    inFilePrint_tex  (Node* head1, Node* head2);
-        void    buildTree        ();
-        void    alterTree        (Node** curNodePtr);
-        void    derivative       ();
-        char*   sprintTree       (Node* curNodePtr, char* dest);//const + free
-    private:
-
-		Node* GetExprNode();
-		Node* GetSumSubNode();
-		Node* GetMulDivNode();
-		Node* GetPowNode();
-		Node* GetBracesNode();
-		Node* GetNumberNode();
+/* FUNCTION REGISTRY */
 
-        Node*	_derivative      (Node* curNodePtr);
-        Node*	_nodeDerivMul    (Node* left_node, Node* right_node);
-        Node*	_nodeDerivSum    (Node* left_node, Node* right_node);
-        Node*	_nodeDerivSub    (Node* left_node, Node* right_node);
-        Node*	_nodeDerivDiv    (Node* left_node, Node* right_node);
-        Node*	_nodeDerivPow    (Node* left_node, Node* right_node);
-        Node*	_nodePow         (Node* left_node, double deg);
-        Node*	_buildTree       (Node*  curNodePtr);
-        void	_printTree       (Node*  curNodePtr);
-        void	_sprintTree      (Node*  curNodePtr, char* tree_str);
-        void	_inFilePrint     (Node*  curNodePtr);  
-        void	_inFilePrint_dot (Node*  curNodePtr, FILE* gv_f);
-        void	_inFilePrint_tex (Node*  curNodePtr);
-        void	_countTree       (Node*  curNodePtr);
-        void	_zeroMul         (Node*  curNodePtr);
-        void	_zeroSum         (Node** curNodePtr);
-        void	_zeroSub         (Node** curNodePtr);
-        void	_zeroDiv         (Node*  curNodePtr);
-        void	_zeroPow         (Node*  curNodePtr);
-        void	_unitMul         (Node** curNodePtr);
-        void	_unitDiv         (Node** curNodePtr);
-        int		_d_equal         (double a, double b);
-#define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)                \
-        Node*  _##funcName##Der(Node* curNodePtr);  \
-        void   _##funcName##Calc(Node* node);
-#include "MATH_FUNCTIONS"
-#undef  MATH_FUNC
-#undef  _FUNCTIONS_
+class Differentator;
 
-        Node*   root_;
-        Node*   new_root_;
-        FILE*   file_to_write_;
-		FILE*	tx_f;
-        char*   expr_;
-        int     expr_offset_;
+//one entry per line of MATH_FUNCTIONS, indexed by MATH_FUNC_ID
+struct MathFunc
+{
+    const char* name_;
+    const char* tex_;
+    double    (*eval_)   (double arg);
+    void      (*batch_)  (const double* arg, double* res, int n);
+    void      (*taylor_) (const double* arg, double* res, double* tmp, int order); //tmp holds 3 series
+    void      (*interval_)(const double* arg, double* res);                         //[lo, hi] pairs
+    Node*     (Differentator::*deriv_)(Node* curNodePtr, int var);
 };
 
-Differentator::Differentator(FILE* file_to_read, FILE* res_file, const char* tex_file):
-    root_           (NULL),
-    new_root_       (NULL),
-    file_to_write_  (res_file),
-	tx_f			(NULL),
-    expr_           (0),
-    expr_offset_    (0)
-    {
-		(tex_file)?tx_f = fopen(tex_file, "w"):tx_f = fopen("MathShit.txt", "w");
-	    if (!tx_f)
-	    {
-	        printf("Differentator: error: cannot open/create .tex file\n");
-	        exit(EXIT_FAILURE);
-	    }
-        unsigned int file_size = 0;
-        fseek(file_to_read, 0, SEEK_END);
-        file_size = (unsigned int) ftell(file_to_read);
-        rewind(file_to_read);
-        assert(MAX_TREE_FILE_LEN >= 1024);
-        if (file_size > MAX_TREE_FILE_LEN)
-        {
-            printf("Your expression is too big\nI think you're tryina get my prog down, aren't ya?\n");
-            exit(1);
-        }
-        expr_ = (char*) calloc (file_size, sizeof(char));
-        printf("fileSize is %u\n", file_size);
-        if (!expr_)
-        {
-            printf("Cannot find memory to read file\n");
-            exit(0);
-        }
-        if (fscanf(file_to_read, "%s", expr_) == EOF)
-		{
-			printf("Differentator: Error reading expression file: %s\n", strerror(errno));
-			exit(EXIT_FAILURE);
-		}
-    }
+extern const MathFunc math_funcs[FUNC_CNT];
 
-Differentator::~Differentator()
+/* COMPILED EVALUATION */
+
+enum
 {
-    //printf("in diff ditor\n");
-    delete_subTree(&root_);
-    delete_subTree(&new_root_);
-    file_to_write_= NULL;
-    free(expr_);
-    expr_         = NULL;
-    expr_offset_  = 0;
-}
+    EVAL_BLOCK    = 256,    //points per pass of evalBatch
+    EVAL_POW_MAX  = 64,     //integer powers up to this are multiplications, pow() beyond
+    EVAL_POLY_MAX = 64,     //polynomials up to this degree are compiled in Horner form
+    EVAL_CHUNK    = 1 << 16 //points of a data file read, evaluated and written at a time
+};
 
-void Differentator::delete_subTree(Node** head)
+enum EVAL_OP
 {
-    if (*head)
-    {
-        delete_subTree(&(*head)->left_dec_);
-        delete_subTree(&(*head)->right_dec_);
-        delete *head;
-        *head = NULL;
-    }
-}
+    OP_CONST,
+    OP_VAR,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_POW,
+    OP_FUNC,
+    OP_SINCOS,  //sin and cos of one slot: the own slot gets cos if cos_own is set, sin otherwise, slot b the other
+    OP_NOP      //slot written by an OP_SINCOS before it
+};
 
-/*void Differentator::visitor(Node* node_ptr)
+struct EvalInstr
 {
-        node_ptr->printNode();
-    if (node_ptr->left_dec_)
-        visitor(node_ptr->left_dec_);
-    if (node_ptr->right_dec_)
-        visitor(node_ptr->right_dec_);
-}*/
+    EVAL_OP op;
+    int     a;      //slot of the left operand, var id for OP_VAR
+    int     b;      //slot of the right operand, MATH_FUNC_ID for OP_FUNC
+    double  val;    //value of OP_CONST
+    int     cos_own; //OP_SINCOS writes cos to its own slot, sin to slot b
+};
 
-void Differentator::buildTree()
+//Trees are flattened into a list of instructions, each writing its own slot.
+//Nodes are memorized by address, so a subtree shared by several outputs is
+//computed once; the trees must stay alive until the last addOutput call.
+class EvalProgram
 {
-    //root_ = _buildTree(root_);
-	root_ = GetExprNode();
-	printTree(root_);
-}
+    public:
+        EvalProgram ();
+        ~EvalProgram();
+        EvalProgram (const EvalProgram&)            = delete;
+        EvalProgram& operator=(const EvalProgram&)  = delete;
+        int     addOutput   (Node* head);
+        void    balanceChains();
+        void    keepPowers  ();
+        void    eval        (const double* vars, double* res);
+        void    evalTaylor  (const double* vars, int var, int order, double* res);
+        void    evalBatch   (const double* vars, int n_points, double* res);
+        void    evalInterval(const double* vars_lo, const double* vars_hi, double* res_lo, double* res_hi);
 
+        int     n_outs_;
+    private:
+        int     _compile    (Node* curNodePtr);
+        int     _compilePoly(Node* curNodePtr);
+        int     _emitPowInt (int base, int degree);
+        int     _emitFunc   (int arg, int func);
+        int     _emit       (EVAL_OP op, int a, int b, double val);
+        int     _memoFind   (Node* curNodePtr);
+        void    _memoAdd    (Node* curNodePtr, int slot);
 
-/* BUILDING TREE OUT OF INF EXPRESSION */
+        EvalInstr*  code_;
+        int         size_;
+        int         cap_;
+        int*        outs_;
+        double*     slots_;
+        Node**      memo_keys_;
+        int*        memo_vals_;
+        int         memo_cap_;
+        int         memo_size_;
+        int         balance_;   //n-ary nodes are computed as balanced trees, not left to right
+        int*        trig_;      //by slot: 1 + the sin or cos instruction taking it, 0 if none
+        int         powers_;    //integer powers and polynomials stay OP_POW, for evalInterval
+};
 
+EvalProgram::EvalProgram():
+    n_outs_     (0),
+    code_       (NULL),
+    size_       (0),
+    cap_        (0),
+    outs_       (NULL),
+    slots_      (NULL),
+    memo_keys_  (NULL),
+    memo_vals_  (NULL),
+    memo_cap_   (0),
+    memo_size_  (0),
+    balance_    (0),
+    trig_       (NULL),
+    powers_     (0)
+    {}
 
-Node* Differentator::GetExprNode()
+EvalProgram::~EvalProgram()
 {
-	 Node* head = GetSumSubNode();
+    free(code_);
+    free(outs_);
+    free(slots_);
+    free(memo_keys_);
+    free(memo_vals_);
+    free(trig_);
+    trig_  = NULL;
+    code_  = NULL;
+    outs_  = NULL;
+    slots_ = NULL;
+}
 
-	if (expr_[expr_offset_] == '\0')
-		return head;
-	return NULL;
+int EvalProgram::addOutput(Node* head)
+{
+    int slot = _compile(head);
+    outs_ = (int*) realloc (outs_, (size_t) (n_outs_ + 1) * sizeof(int));
+    slots_ = (double*) realloc (slots_, (size_t) (size_ + 1) * sizeof(double));
+    if (!outs_ || !slots_)
+    {
+        printf("EvalProgram: error finding memory for outputs\n");
+        exit(2);
+    }
+    outs_[n_outs_++] = slot;
+    return n_outs_ - 1;
 }
 
-Node* Differentator::GetSumSubNode()
-{               
-	Node* l = GetMulDivNode();
-	Node* SumSubNode = NULL;
-	while (expr_[expr_offset_] == '-' || expr_[expr_offset_] == '+')
-	{
-		SumSubNode = (expr_[expr_offset_] == '+')?new Node("+"):new Node("-");
-		expr_offset_++;
-		SumSubNode->right_dec_ = GetMulDivNode();
-	}	
-	SumSubNode?SumSubNode->left_dec_ = l:SumSubNode = l;
-	return SumSubNode;
+//Operands of sums and products are paired up level by level, so a chain of n
+//has log n dependent instructions instead of n. Rounding differs from the
+//left to right order, hence it is up to the caller.
+void EvalProgram::balanceChains()
+{
+    balance_ = 1;
 }
 
-Node* Differentator::GetMulDivNode()
+//x * x over [-1, 1] is [-1, 1] in interval arithmetic while x^2 is [0, 1], so
+//a program for evalInterval computes powers and polynomials as they are written
+void EvalProgram::keepPowers()
 {
-	Node* l = GetPowNode();
-	Node* MulDivNode = NULL;
-	while (expr_[expr_offset_] == '*' || expr_[expr_offset_] == '/')
-	{
-		MulDivNode = (expr_[expr_offset_] == '*')?new Node("*"):new Node("/");
-		expr_offset_++;
-		MulDivNode->right_dec_ = GetPowNode();
-	}
-	MulDivNode?MulDivNode->left_dec_ = l:MulDivNode = l;
-	return MulDivNode;
+    powers_ = 1;
 }
 
-Node* Differentator::GetPowNode()
+int EvalProgram::_emit(EVAL_OP op, int a, int b, double val)
 {
-	Node* l = GetBracesNode();
-	Node* PowNode = NULL;
-	printf("Diff: braceNode: before while %c\n", expr_[expr_offset_]);
-	while (expr_[expr_offset_] == '^')
-	{
-		printf("Diff: braceNode: %c\n", expr_[expr_offset_]);
-		PowNode = new Node("^");
-		expr_offset_++;
-		PowNode->right_dec_ = GetBracesNode();
-	}
-	PowNode?PowNode->left_dec_ = l: PowNode = l;
-	return PowNode;
+    if (size_ == cap_)
+    {
+        cap_  = (cap_)?cap_ * 2:64;
+        code_ = (EvalInstr*) realloc (code_, (size_t) cap_ * sizeof(EvalInstr));
+        trig_ = (int*)       realloc (trig_, (size_t) cap_ * sizeof(int));
+        if (!code_ || !trig_)
+        {
+            printf("EvalProgram: error finding memory for %i instructions\n", cap_);
+            exit(2);
+        }
+    }
+    code_[size_].op  = op;
+    code_[size_].a   = a;
+    code_[size_].b   = b;
+    code_[size_].val = val;
+    code_[size_].cos_own = 0;
+    trig_[size_]     = 0;
+    return size_++;
 }
 
-Node* Differentator::GetBracesNode()
+static unsigned int ptr_hash(const void* ptr)
 {
-	if (expr_[expr_offset_] == '(')
-	{
-		expr_offset_++;
-		Node* BracesNode = GetSumSubNode();
-		if (expr_[expr_offset_] == ')')
-		{
-			expr_offset_++;
-			return BracesNode;
-		}
-		else
-		{
-			printf("Something's wrong with your math: closing brace not found\n");
-			exit(0);
-		}
-	}
-	else	return GetNumberNode();
+    unsigned long long key = (unsigned long long) ptr;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (unsigned int) key;
 }
 
-Node* Differentator::GetNumberNode()
+int EvalProgram::_memoFind(Node* curNodePtr)
 {
-	double val = 0;
-	int rem_offset = expr_offset_;
-	Node* LeafNode = NULL;
-	if ( isalpha(expr_[expr_offset_]) )
-	{
-		char var_name[2] = {};
-		var_name[0] = expr_[expr_offset_];
-		LeafNode = new Node(var_name);
-		expr_offset_++;
-		return LeafNode;
-	}
-	int if_fract = 0;
-	int fract_counter = 0;
-	while ( ('0' <= expr_[expr_offset_] && expr_[expr_offset_] <= '9') || 
-					expr_[expr_offset_] == '.')
-	{
-		if (expr_[expr_offset_] == '.') 
-		{
-			if_fract = 1;
-			expr_offset_++;
-			continue;
-		}
-		if (if_fract) fract_counter++;
-		val = val * 10 + (expr_[expr_offset_] - '0');
-		expr_offset_++;
-	}
-	val /= pow(10, fract_counter);
-	LeafNode = new Node(val);
-	if (rem_offset != expr_offset_) return LeafNode;//if there is at least one digit
-	else			return NULL;
+    if (!memo_cap_)
+        return -1;
+    unsigned int mask = (unsigned int) memo_cap_ - 1;
+    for (unsigned int i = ptr_hash(curNodePtr) & mask; memo_keys_[i]; i = (i + 1) & mask)
+        if (memo_keys_[i] == curNodePtr)
+            return memo_vals_[i];
+    return -1;
 }
 
-Node* Differentator::_buildTree(Node* curNodePtr)
+void EvalProgram::_memoAdd(Node* curNodePtr, int slot)
 {
-    int stopCharPtr = 0;
-    expr_offset_++;    // move tree ptr to a char that's next to '('
-    assert (MAX_NODE_STR_LEN >= 128);
-    char* curData = (char*) calloc (MAX_NODE_STR_LEN, sizeof(char));
-    if (!curData)
+    if (2 * (memo_size_ + 1) > memo_cap_)
     {
-        printf("error finding memory for putting another node data\n");
-        exit(2);
-    }
-    if (sscanf(expr_ + expr_offset_, "%127[^()_]%n", curData, &stopCharPtr))
-        switch (expr_[expr_offset_ + stopCharPtr])
+        Node** old_keys = memo_keys_;
+        int*   old_vals = memo_vals_;
+        int    old_cap  = memo_cap_;
+        memo_cap_  = (memo_cap_)?memo_cap_ * 2:256;
+        memo_keys_ = (Node**) calloc ((size_t) memo_cap_, sizeof(Node*));
+        memo_vals_ = (int*)   calloc ((size_t) memo_cap_, sizeof(int));
+        if (!memo_keys_ || !memo_vals_)
         {
-            case '(':
-                expr_offset_ += stopCharPtr;
-                curNodePtr = new Node(curData);
-                
-                curNodePtr->left_dec_   = _buildTree(curNodePtr->left_dec_);
+            printf("EvalProgram: error finding memory for node table\n");
+            exit(2);
+        }
+        memo_size_ = 0;
+        for (int i = 0; i < old_cap; i++)
+            if (old_keys[i])
+                _memoAdd(old_keys[i], old_vals[i]);
+        free(old_keys);
+        free(old_vals);
+    }
+    unsigned int mask = (unsigned int) memo_cap_ - 1;
+    unsigned int i    = ptr_hash(curNodePtr) & mask;
+    while (memo_keys_[i])
+        i = (i + 1) & mask;
+    memo_keys_[i] = curNodePtr;
+    memo_vals_[i] = slot;
+    memo_size_++;
+}
 
-                curNodePtr->right_dec_  = _buildTree(curNodePtr->right_dec_);
-                expr_offset_++; //skipping closing brace
+int EvalProgram::_compile(Node* curNodePtr)
+{
+    int slot = _memoFind(curNodePtr);
+    if (slot >= 0)
+        return slot;
+
+    switch(curNodePtr->type_)
+    {
+        case TYPE_CONST:
+        {
+            slot = _emit(OP_CONST, 0, 0, curNodePtr->value_);
+            break;
+        }
+        case TYPE_VAR:
+            slot = _emit(OP_VAR, curNodePtr->var_id_, 0, 0.0);
+            break;
+        case TYPE_ACT:
+        {
+            Node* r = curNodePtr->right_dec_;
+            if (!powers_ && curNodePtr->data_[0] == '^' && r->type_ == TYPE_CONST &&
+                exact_equal(r->value_, floor(r->value_)) && fabs(r->value_) <= EVAL_POW_MAX)
+            {
+                slot = _emitPowInt(_compile(curNodePtr->left_dec_), (int) r->value_);
                 break;
-            case ')': //curnodeptr = null + ret cyrnodtr        
-                expr_offset_ += stopCharPtr + 1;
-                curNodePtr = new Node(curData);
+            }
+            if (!powers_ && curNodePtr->data_[0] == '+' && (slot = _compilePoly(curNodePtr)) >= 0)
                 break;
-            case '_':
-                expr_offset_++;
-                curNodePtr = NULL;
+            int a = _compile(curNodePtr->left_dec_);
+            int b = _compile(r);
+            switch(curNodePtr->data_[0])
+            {
+                case '+': slot = _emit(OP_ADD, a, b, 0.0); break;
+                case '-': slot = _emit(OP_SUB, a, b, 0.0); break;
+                case '*': slot = _emit(OP_MUL, a, b, 0.0); break;
+                case '/': slot = _emit(OP_DIV, a, b, 0.0); break;
+                case '^': slot = _emit(OP_POW, a, b, 0.0); break;
+                default:
+                    printf("EvalProgram: unknown action '%c'\n", curNodePtr->data_[0]);
+                    exit(4);
+            }
+            break;
+        }
+        case TYPE_SUM:
+        case TYPE_PROD:
+        {
+            if (!powers_ && curNodePtr->type_ == TYPE_SUM && (slot = _compilePoly(curNodePtr)) >= 0)
                 break;
-            default:
-                printf("got unknown ruling char '%c' near %i char; worked at %i line\n", expr_[expr_offset_], expr_offset_ + 1, __LINE__);
-                exit(0);
+            //n-ary nodes go as a chain of binary instructions
+            EVAL_OP op = (curNodePtr->type_ == TYPE_SUM)?OP_ADD:OP_MUL;
+            if (balance_)
+            {
+                int  n     = curNodePtr->n_kids_;
+                int* level = (int*) calloc ((size_t) n, sizeof(int));
+                if (!level)
+                {
+                    printf("EvalProgram: error finding memory for %i operands\n", n);
+                    exit(2);
+                }
+                for (int i = 0; i < n; i++)
+                    level[i] = _compile(curNodePtr->kids_[i]);
+                for (; n > 1; n = (n + 1) / 2)
+                    for (int i = 0; i < n; i += 2)
+                        level[i / 2] = (i + 1 < n)?_emit(op, level[i], level[i + 1], 0.0):level[i];
+                slot = level[0];
+                free(level);
                 break;
+            }
+            slot = _compile(curNodePtr->kids_[0]);
+            for (int i = 1; i < curNodePtr->n_kids_; i++)
+            {
+                int b = _compile(curNodePtr->kids_[i]);
+                slot  = _emit(op, slot, b, 0.0);
+            }
+            break;
         }
-    else
-        printf("error reading expression\n");
-    free(curData);
-    return curNodePtr;
-}
-
-void Differentator::inFilePrint()
-{
-    _inFilePrint(root_);
+        case TYPE_FUNC:
+        {
+            if (curNodePtr->func_id_ < 0)
+            {
+                printf("EvalProgram: unknown function '%s'\n", curNodePtr->data_);
+                exit(4);
+            }
+            int a = _compile(curNodePtr->left_dec_);
+            slot = _emitFunc(a, curNodePtr->func_id_);
+            break;
+        }
+        case TYPE_DEF:
+        default:
+            printf("EvalProgram: node %p type is not set\n", curNodePtr);
+            curNodePtr->printNode();
+            exit(4);
+    }
+    _memoAdd(curNodePtr, slot);
+    return slot;
 }
 
-void Differentator::_inFilePrint(Node* curNodePtr)
+//sin and cos of one slot come together, as in f and f' of sin(u), and are computed by one sincos
+int EvalProgram::_emitFunc(int arg, int func)
 {
-    fprintf(file_to_write_, "(%s", curNodePtr->data_);
-    if(curNodePtr->left_dec_)
-        _inFilePrint(curNodePtr->left_dec_);
-    if(curNodePtr->right_dec_)
-        _inFilePrint(curNodePtr->right_dec_);
-    fprintf(file_to_write_,")");
+    if (func != FUNC_sin && func != FUNC_cos)
+        return _emit(OP_FUNC, arg, func, 0.0);
+    int prev = trig_[arg] - 1;
+    if (prev < 0)
+    {
+        int slot = _emit(OP_FUNC, arg, func, 0.0);
+        trig_[arg] = slot + 1;
+        return slot;
+    }
+    EvalInstr* in = &code_[prev];
+    if (in->op == OP_FUNC && in->b == func)
+        return prev;
+    if (in->op == OP_SINCOS)
+        return (in->cos_own == (func == FUNC_cos))?prev:in->b;
+    int slot = _emit(OP_NOP, arg, func, 0.0);
+    in = &code_[prev];
+    in->op      = OP_SINCOS;
+    in->cos_own = (in->b == FUNC_cos);
+    in->b       = slot;
+    return slot;
 }
 
-void Differentator::inFilePrint_dot(Node* head)
+//base^degree by squaring: a multiplication per bit and one per set bit, 1 / x^n for negative n
+int EvalProgram::_emitPowInt(int base, int degree)
 {
-    if (head)
+    unsigned int n   = (unsigned int) ((degree < 0)?-degree:degree);
+    int          res = -1;
+    for (int sq = base; n; n >>= 1)
     {
-        FILE* gv_f = fopen("expr_tree.gv", "w");//
-        fprintf(gv_f, "digraph G{\n");
-       _inFilePrint_dot(head, gv_f);
-        fprintf(gv_f, "\n}");
-        fclose(gv_f);
-        if (system("xdot expr_tree.gv") == -1)
-            printf("inFilePrint_dot: could not run .gv compiling\n");
-    
-        if (system("dot -Tpng expr_tree.gv -o tree.png") == -1)
-            printf("inFilePrint_dot: could not evince dot tree picture\n");
+        if (n & 1)
+            res = (res < 0)?sq:_emit(OP_MUL, res, sq, 0.0);
+        if (n > 1)
+            sq = _emit(OP_MUL, sq, sq, 0.0);
     }
+    if (res < 0)
+        res = _emit(OP_CONST, 0, 0, 1.0);
+    if (degree < 0)
+        res = _emit(OP_DIV, _emit(OP_CONST, 0, 0, 1.0), res, 0.0);
+    return res;
 }
 
-void Differentator::_inFilePrint_dot(Node* curNodePtr, FILE* gv_f)
+//c * x^k as a const coefficient and a degree, the product may have several consts and x factors
+static int poly_term(Node* term, Node** var, int* degree, double* coeff)
 {
-    fprintf(gv_f, "_node_%p [label=\"data_ '%s'[%p]\\l"
-                            "left_dec_ptr  = %p\\l"
-                            "right_dec_ptr = %p\\l"
-                            "ancestor_ptr  = %p\\l"
-                            "node_type is  = %i\\l"
-                            "node priority = %i\\l"
-                            "its ptr         %p\"]\n", curNodePtr, 
-                                                       curNodePtr->data_, 
-                                                       curNodePtr->data_, 
-                                                       curNodePtr->left_dec_,
-                                                       curNodePtr->right_dec_,
-                                                       curNodePtr->ancestor_,
-                                                       curNodePtr->type_,
-                                                       curNodePtr->priority_,
-                                                       curNodePtr);
-    if (curNodePtr->left_dec_)
+    Node*  pair[2] = {term->left_dec_, term->right_dec_};
+    Node** factors = &term;
+    int    n       = 1;
+    if (term->type_ == TYPE_PROD || (term->type_ == TYPE_ACT && term->data_[0] == '*'))
     {
-        fprintf(gv_f, "_node_%p -> _node_%p\n", curNodePtr, curNodePtr->left_dec_);
-        _inFilePrint_dot(curNodePtr->left_dec_,  gv_f);
+        factors = (term->kids_)?term->kids_:pair;
+        n       = (term->kids_)?term->n_kids_:2;
     }
-    if (curNodePtr->right_dec_)
+    *degree = 0;
+    *coeff  = 1.0;
+    for (int i = 0; i < n; i++)
     {
-        fprintf(gv_f, "_node_%p -> _node_%p\n\n", curNodePtr, curNodePtr->right_dec_);
-        _inFilePrint_dot(curNodePtr->right_dec_, gv_f);
-    }    
+        Node* f = factors[i];
+        Node* x = f;
+        int   k = 1;
+        if (f->type_ == TYPE_CONST)
+        {
+            *coeff *= f->value_;
+            continue;
+        }
+        if (f->type_ == TYPE_ACT && f->data_[0] == '^' && f->right_dec_->type_ == TYPE_CONST)
+        {
+            double deg = f->right_dec_->value_;
+            if (!exact_equal(deg, floor(deg)) || deg < 1.0 || deg > EVAL_POLY_MAX)
+                return 0;
+            x = f->left_dec_;
+            k = (int) deg;
+        }
+        if (x->type_ != TYPE_VAR || (*var && (*var)->var_id_ != x->var_id_))
+            return 0;
+        *var     = x;
+        *degree += k;
+    }
+    return *degree <= EVAL_POLY_MAX;
 }
 
-void Differentator::inFilePrint_tex(Node* head1, Node* head2)
+//multiplications _emitPowInt spends on x^k, k > 0
+static int pow_int_cost(int k)
 {
-    fprintf(tx_f,   "\\documentclass{article}\n"
-                    "\\title{\\LaTeX\\ Derivation}\n"
-                    "\\author{Arbuce Lee}\n"
-                    "\\begin{document}\n"
-                    "\n\\maketitle\n\n"
-                    "\\fontsize{10}{10pt}\\selectfont\n"
-                    "\\begin{equation}\n");
-
-    fprintf(tx_f, "\\left[");
-    _inFilePrint_tex(head1);
-    fprintf(tx_f, "\\right]'=");
+    int cost = -1;
+    for (; k; k >>= 1)
+        cost += (k > 1) + (k & 1);
+    return cost;
+}
 
-    _inFilePrint_tex(head2);
-    fprintf(tx_f, "\n\\end{equation}\n\n\\end{document}");
+//A sum of c * x^k terms of one var and degree 2 or more is computed in Horner
+//form, or in Estrin form if chains are balanced; -1 if the sum is not such, or
+//if it is too sparse for that to beat a power per term (x^64 + 1).
+int EvalProgram::_compilePoly(Node* curNodePtr)
+{
+    Node*  pair[2] = {curNodePtr->left_dec_, curNodePtr->right_dec_};
+    Node** terms   = (curNodePtr->kids_)?curNodePtr->kids_:pair;
+    int    n_terms = (curNodePtr->kids_)?curNodePtr->n_kids_:2;
+    double coeffs[EVAL_POLY_MAX + 1] = {};
+    Node*  var = NULL;
+    int    max_degree = 0;
+    for (int i = 0; i < n_terms; i++)
+    {
+        int    degree = 0;
+        double coeff  = 0.0;
+        if (!poly_term(terms[i], &var, &degree, &coeff))
+            return -1;
+        coeffs[degree] += coeff;
+        if (degree > max_degree)
+            max_degree = degree;
+    }
+    if (!var || max_degree < 2)
+        return -1;
+    int sparse_cost = 0;
+    for (int k = 1; k <= max_degree; k++)
+        if (!exact_equal(coeffs[k], 0.0))
+            sparse_cost += pow_int_cost(k) + 1;
+    if (sparse_cost < max_degree)
+        return -1;
 
-    fclose(tx_f);
-    if (system("pdflatex MathShit.tex") == -1)
-        printf("inFilePrint_tex: could not run .tex compiling\n");
-    if (system("evince MathShit.pdf")	== -1)
-        printf("inFilePrint_tex: could not evince pdf\n");
+    int x = _compile(var);
+    if (!balance_)
+    {
+        int res = _emit(OP_CONST, 0, 0, coeffs[max_degree]);
+        for (int k = max_degree - 1; k >= 0; k--)
+        {
+            res = _emit(OP_MUL, res, x, 0.0);
+            if (!exact_equal(coeffs[k], 0.0))
+                res = _emit(OP_ADD, res, _emit(OP_CONST, 0, 0, coeffs[k]), 0.0);
+        }
+        return res;
+    }
+    //Estrin: pairs c_2i + c_2i+1 x, then pairs of those by x^2, by x^4...
+    int level[EVAL_POLY_MAX + 1] = {};
+    int n = max_degree + 1;
+    for (int k = 0; k < n; k++)
+        level[k] = _emit(OP_CONST, 0, 0, coeffs[k]);
+    for (int power = x; n > 1; )
+    {
+        for (int i = 0; i < n; i += 2)
+            level[i / 2] = (i + 1 < n)?_emit(OP_ADD, level[i], _emit(OP_MUL, level[i + 1], power, 0.0), 0.0):level[i];
+        n = (n + 1) / 2;
+        if (n > 1)
+            power = _emit(OP_MUL, power, power, 0.0);
+    }
+    return level[0];
 }
 
-void Differentator::_inFilePrint_tex(Node* curNodePtr)
+void EvalProgram::eval(const double* vars, double* res)
 {
-	if (!curNodePtr) goto skip;
-    switch(curNodePtr->type_)
+    for (int i = 0; i < size_; i++)
     {
-        case TYPE_DEF:
-            printf("_inFilePrint_tex: node %p type is not set\n", curNodePtr);
-			curNodePtr->printNode();
-            exit(4);
-        case TYPE_CONST:
-            fprintf(tx_f, "%s", curNodePtr->data_);
-            break;
-        case TYPE_VAR:
-            fprintf(tx_f, "%s", curNodePtr->data_);
-            break;
-        case TYPE_FUNC:
-            fprintf(tx_f, "%s\\left({", curNodePtr->data_);
-            _inFilePrint_tex(curNodePtr->left_dec_);
-            fprintf(tx_f, "}\\right)");
-            break;
-        case TYPE_ACT:
-            switch(curNodePtr->data_[0])
+        const EvalInstr* in = &code_[i];
+        switch(in->op)
+        {
+            case OP_CONST: slots_[i] = in->val;                                 break;
+            case OP_VAR:   slots_[i] = vars[in->a];                             break;
+            case OP_ADD:   slots_[i] = slots_[in->a] + slots_[in->b];           break;
+            case OP_SUB:   slots_[i] = slots_[in->a] - slots_[in->b];           break;
+            case OP_MUL:   slots_[i] = slots_[in->a] * slots_[in->b];           break;
+            case OP_DIV:   slots_[i] = slots_[in->a] / slots_[in->b];           break;
+            case OP_POW:   slots_[i] = pow(slots_[in->a], slots_[in->b]);       break;
+            case OP_FUNC:  slots_[i] = math_funcs[in->b].eval_(slots_[in->a]);  break;
+            case OP_SINCOS:
             {
-                case '+':
-                    fprintf(tx_f, "{");
-                    _inFilePrint_tex(curNodePtr->left_dec_);
-                    fprintf(tx_f, "}+{");
-                    _inFilePrint_tex(curNodePtr->right_dec_);
-                    fprintf(tx_f, "}");
-                    break;
-                case '-':
-                    fprintf(tx_f, "{");
-                    _inFilePrint_tex(curNodePtr->left_dec_);
-                    fprintf(tx_f, "}-{");
-                    _inFilePrint_tex(curNodePtr->right_dec_);
-                    fprintf(tx_f, "}");
-                    break;
-                case '*':
-                    if (curNodePtr->priority_ > curNodePtr->left_dec_->priority_)
-                    {
-                        (curNodePtr->left_dec_->type_ == TYPE_ACT)?fprintf(tx_f, "\\left({"):fprintf(tx_f, "{");
-                        _inFilePrint_tex(curNodePtr->left_dec_);
-                        (curNodePtr->left_dec_->type_ == TYPE_ACT)?fprintf(tx_f, "}\\right)*"):fprintf(tx_f, "}");
-                    }
-                    else
-                    {
-                        fprintf(tx_f, "{");
-                        _inFilePrint_tex(curNodePtr->left_dec_);
-                        fprintf(tx_f, "}");
-                    }
-                    if (curNodePtr->priority_ > curNodePtr->right_dec_->priority_)
-                    {
-                        (curNodePtr->right_dec_->type_ == TYPE_ACT)?fprintf(tx_f, "*\\left({"):fprintf(tx_f, "*{");
-                        _inFilePrint_tex(curNodePtr->right_dec_);
-                        (curNodePtr->right_dec_->type_ == TYPE_ACT)?fprintf(tx_f, "}\\right)"):fprintf(tx_f, "}");
-                    }
-                    else
-                    {
-                        fprintf(tx_f, "*{");
-                        _inFilePrint_tex(curNodePtr->right_dec_);
-                        fprintf(tx_f, "}");
-                    }
-                    break;
-                case '/':
-                    fprintf(tx_f, "\\frac{");
-                    _inFilePrint_tex(curNodePtr->left_dec_);
-                    fprintf(tx_f, "}{");
-                    _inFilePrint_tex(curNodePtr->right_dec_);
-                    fprintf(tx_f, "}");
-                    break;
-                case '^':
-                    fprintf(tx_f, "{\\left({");
-                    _inFilePrint_tex(curNodePtr->left_dec_);
-                    (curNodePtr->right_dec_->type_ != TYPE_CONST)?fprintf(tx_f, "}\\right)}^{\\left({"):fprintf(tx_f, "}\\right)}^{");
-                    _inFilePrint_tex(curNodePtr->right_dec_);
-                    (curNodePtr->right_dec_->type_ != TYPE_CONST)?fprintf(tx_f, "}\\right)}"):fprintf(tx_f, "}");
-                    break;
-                default:
-                    printf("Unknown arythmetic action!\n");
-                    exit(2);
+                double sin_a = 0.0, cos_a = 0.0;
+                sincos(slots_[in->a], &sin_a, &cos_a);
+                slots_[i]     = (in->cos_own)?cos_a:sin_a;
+                slots_[in->b] = (in->cos_own)?sin_a:cos_a;
+                break;
             }
-            break;
-        default:
-            printf("_inFilePrint_tex: got unknown node type %p\n", curNodePtr);
-            exit(4);
+            case OP_NOP:                                                        break;
+            default:
+                printf("EvalProgram: unknown instruction %i\n", in->op);
+                exit(4);
+        }
     }
-	skip: ;
+    for (int i = 0; i < n_outs_; i++)
+        res[i] = slots_[outs_[i]];
 }
 
-void Differentator::printTree(Node* root)
+
+//series helpers for evalTaylor, every series holds order + 1 coefficients
+
+static void taylor_mul(const double* a, const double* b, double* c, int order)
 {
-    printf("\n");
-    _printTree(root);
-    printf("\n");
+    for (int k = 0; k <= order; k++)
+    {
+        double sum = 0.0;
+        for (int j = 0; j <= k; j++)
+            sum += a[j] * b[k - j];
+        c[k] = sum;
+    }
 }
 
-void Differentator::_printTree(Node* curNodePtr)
+static void taylor_div(const double* a, const double* b, double* c, int order)
 {
-    printf("(");
-	if (curNodePtr)
-	{
-	    if (curNodePtr->data_)
-	        printf("%s", curNodePtr->data_);
-    
-		if (curNodePtr->left_dec_)
-	        _printTree(curNodePtr->left_dec_);
-
-		if (curNodePtr->right_dec_)
-			_printTree(curNodePtr->right_dec_);
-	}
-    printf(")");
+    for (int k = 0; k <= order; k++)
+    {
+        double sum = a[k];
+        for (int j = 1; j <= k; j++)
+            sum -= b[j] * c[k - j];
+        c[k] = sum / b[0];
+    }
 }
 
-char* Differentator::sprintTree(Node *curNodePtr, char* dest)
+static void taylor_exp(const double* a, double* c, int order)
 {
-    if (!dest)
+    c[0] = exp(a[0]);
+    for (int k = 1; k <= order; k++)
     {
-        printf("sprintTree: Got invalid str ptr\n");
-        return NULL;
+        double sum = 0.0;
+        for (int j = 1; j <= k; j++)
+            sum += j * a[j] * c[k - j];
+        c[k] = sum / k;
     }
-    strcpy(dest, "");
-    _sprintTree(curNodePtr, dest);
-    return dest;
 }
 
-void Differentator::_sprintTree(Node* curNodePtr, char* tree_str)
+static void taylor_ln(const double* a, double* c, int order)
 {
-    strcat(tree_str, "(");
-	if (curNodePtr)
-	{
-	    if (curNodePtr->data_)
-	        strcat(tree_str, curNodePtr->data_);
-
-		if (curNodePtr->left_dec_)
-	        _sprintTree(curNodePtr->left_dec_, tree_str);
-
-		if (curNodePtr->right_dec_)
-			_sprintTree(curNodePtr->right_dec_, tree_str);
-	}
-    strcat(tree_str, ")");
+    c[0] = log(a[0]);
+    for (int k = 1; k <= order; k++)
+    {
+        double sum = 0.0;
+        for (int j = 1; j < k; j++)
+            sum += j * c[j] * a[k - j];
+        c[k] = (a[k] - sum / k) / a[0];
+    }
 }
 
-#define _FUNCTIONS_
-#define MATH_FUNC(funcName, cppFuncName)                    \
-void Differentator::_##funcName##Calc(Node* node)           \
-{                                                           \
-    if (node->left_dec_->type_ == TYPE_CONST)               \
-    {                                                       \
-        double argument = 0.0;                              \
-        sscanf(node->left_dec_->data_, "%lg", &argument);   \
-        sprintf(node->data_, "%lg", cppFuncName(argument)); \
-        delete node->left_dec_;                             \
-        node->left_dec_ = NULL;                             \
-        node->type_ = TYPE_CONST;                           \
-    }                                                       \
+static void taylor_sincos(const double* a, double* s, double* c, int order)
+{
+    s[0] = sin(a[0]);
+    c[0] = cos(a[0]);
+    for (int k = 1; k <= order; k++)
+    {
+        double sum_s = 0.0, sum_c = 0.0;
+        for (int j = 1; j <= k; j++)
+        {
+            sum_s += j * a[j] * c[k - j];
+            sum_c += j * a[j] * s[k - j];
+        }
+        s[k] =  sum_s / k;
+        c[k] = -sum_c / k;
+    }
 }
-#include "MATH_FUNCTIONS"
-#undef MATH_FUNC
-#undef _FUNCTIONS_
 
-void Differentator::alterTree(Node** head)
+static void taylor_pow(const double* a, const double* b, double* c, double* tmp, int order)
 {
-    char* str1     = (char*) calloc (MAX_NODE_STR_LEN, sizeof(char));
-    char* tree_str = (char*) calloc (MAX_NODE_STR_LEN, sizeof(char));
-    str1 = strcat(str1, "mum soap frame");
-    if (!tree_str)
+    int const_degree = 1;
+    for (int k = 1; k <= order; k++)
+        if (!exact_equal(b[k], 0.0))
+            const_degree = 0;
+    double deg = b[0];
+
+    if (const_degree && !exact_equal(a[0], 0.0))
     {
-        printf("alterTree: Error finding memory for tree str\n");
-        exit(4);
+        //(a^r)' * a = r * a^r * a'  gives  c_k = sum (r j - (k - j)) a_j c_(k-j) / (k a_0)
+        c[0] = pow(a[0], deg);
+        for (int k = 1; k <= order; k++)
+        {
+            double sum = 0.0;
+            for (int j = 1; j <= k; j++)
+                sum += (deg * j - (k - j)) * a[j] * c[k - j];
+            c[k] = sum / (k * a[0]);
+        }
+        return;
     }
-    tree_str = sprintTree(*head, tree_str);
-    while (strcmp(str1, tree_str))
+    if (const_degree && deg >= 0.0 && exact_equal(deg, floor(deg)) && deg < 64.0)
     {
-		
-        printf("IN ALTER TREEE\n");
-        _countTree(*head);
-		_printTree(*head);	
-        _zeroMul(*head);
-		_printTree(*head);
-        _zeroSum(head);
-
-        _zeroSub(head);
-
-        _zeroPow(*head);
-
-        _unitMul(head);
-
-        _unitDiv(head);
-
-        str1 = strncpy(str1, tree_str, MAX_NODE_STR_LEN);
-        tree_str = sprintTree(*head, tree_str);
-        printf( "before iteration {%s}\n"
-                "after iteration  {%s}\n", str1, tree_str);
+        //a_0 is 0 here, so the recurrence above divides by it: multiply out instead
+        int n = (int) deg;
+        for (int k = 0; k <= order; k++)
+            c[k] = (k)?0.0:1.0;
+        double* res = tmp;
+        for (int i = 0; i < n; i++)
+        {
+            taylor_mul(c, a, res, order);
+            memcpy(c, res, (size_t) (order + 1) * sizeof(double));
+        }
+        return;
     }
-    free(tree_str);
-    free(str1);
+    //a^b = exp(b ln a)
+    double* ln_a = tmp;
+    double* prod = tmp + order + 1;
+    taylor_ln(a, ln_a, order);
+    taylor_mul(b, ln_a, prod, order);
+    taylor_exp(prod, c, order);
 }
 
-void Differentator::_countTree(Node* curNodePtr)
+void EvalProgram::evalTaylor(const double* vars, int var, int order, double* res)
 {
-	if (curNodePtr)
-	{
-	    if(curNodePtr->left_dec_)
-	        _countTree(curNodePtr->left_dec_);
-	
-	    if(curNodePtr->right_dec_)
-	        _countTree(curNodePtr->right_dec_);
-	
-	    if (curNodePtr->left_dec_ && curNodePtr->right_dec_ 
-	                              && curNodePtr->type_              == TYPE_ACT 
-	                              && curNodePtr->left_dec_->type_   == TYPE_CONST 
-	                              && curNodePtr->right_dec_->type_  == TYPE_CONST)
-	    {
-	        curNodePtr->act();
-	        delete curNodePtr->left_dec_;
-	        delete curNodePtr->right_dec_;
-	        curNodePtr->left_dec_ = curNodePtr->right_dec_ = NULL;
-	        curNodePtr->type_ = TYPE_CONST;
-	    }
-	    if (curNodePtr->type_ == TYPE_FUNC)
-	    {
+    //truncated taylor arithmetic: every slot is a series in (vars[var] + h),
+    //res gets order + 1 coefficients of h^k for each output
+    int     len    = order + 1;
+    double* series = (double*) calloc ((size_t) (size_ + 3) * (size_t) len, sizeof(double));
+    if (!series)
+    {
+        printf("evalTaylor: error finding memory for %i series of %i coefficients\n", size_, len);
+        exit(2);
+    }
+    double* tmp = series + (size_t) size_ * (size_t) len;
+    for (int i = 0; i < size_; i++)
+    {
+        const EvalInstr* in = &code_[i];
+        double*       c = series + (size_t) i     * (size_t) len;
+        const double* a = series + (size_t) in->a * (size_t) len;
+        const double* b = series + (size_t) in->b * (size_t) len;
+        switch(in->op)
+        {
+            case OP_CONST:
+                c[0] = in->val;
+                break;
+            case OP_VAR:
+                c[0] = vars[in->a];
+                if (order && in->a == var)
+                    c[1] = 1.0;
+                break;
+            case OP_ADD:
+                for (int k = 0; k < len; k++)
+                    c[k] = a[k] + b[k];
+                break;
+            case OP_SUB:
+                for (int k = 0; k < len; k++)
+                    c[k] = a[k] - b[k];
+                break;
+            case OP_MUL:
+                taylor_mul(a, b, c, order);
+                break;
+            case OP_DIV:
+                taylor_div(a, b, c, order);
+                break;
+            case OP_POW:
+                taylor_pow(a, b, c, tmp, order);
+                break;
+            case OP_FUNC:
+                math_funcs[in->b].taylor_(a, c, tmp, order);
+                break;
+            case OP_SINCOS:
+            {
+                double* other = series + (size_t) in->b * (size_t) len;
+                (in->cos_own)?taylor_sincos(a, other, c, order):taylor_sincos(a, c, other, order);
+                break;
+            }
+            case OP_NOP:
+                break;
+            default:
+                printf("evalTaylor: unknown instruction %i\n", in->op);
+                exit(4);
+        }
+    }
+    for (int i = 0; i < n_outs_; i++)
+        memcpy(res + (size_t) i * (size_t) len, series + (size_t) outs_[i] * (size_t) len,
+               (size_t) len * sizeof(double));
+    free(series);
+}
+
+//vars[var * n_points + p] is var at point p, res[out * n_points + p] gets the outputs;
+//points go in blocks, so every instruction is one loop over EVAL_BLOCK values.
+//The program is not changed, threads may evaluate it at once
+void EvalProgram::evalBatch(const double* vars, int n_points, double* res)
+{
+    double* block = (double*) calloc ((size_t) size_ * EVAL_BLOCK + 1, sizeof(double));
+    if (!block)
+    {
+        printf("evalBatch: error finding memory for %i slots\n", size_);
+        exit(2);
+    }
+    for (int start = 0; start < n_points; start += EVAL_BLOCK)
+    {
+        int n = (n_points - start < EVAL_BLOCK)?n_points - start:EVAL_BLOCK;
+        for (int i = 0; i < size_; i++)
+        {
+            const EvalInstr* in = &code_[i];
+            double* c = block + (size_t) i * EVAL_BLOCK;
+            if (in->op == OP_CONST)
+            {
+                for (int p = 0; p < n; p++)
+                    c[p] = in->val;
+                continue;
+            }
+            if (in->op == OP_VAR)
+            {
+                memcpy(c, vars + (size_t) in->a * (size_t) n_points + start, (size_t) n * sizeof(double));
+                continue;
+            }
+            if (in->op == OP_NOP)
+                continue;
+            const double* a = block + (size_t) in->a * EVAL_BLOCK;
+            const double* b = block + (size_t) in->b * EVAL_BLOCK;
+            switch(in->op)
+            {
+                case OP_ADD:
+                    for (int p = 0; p < n; p++)
+                        c[p] = a[p] + b[p];
+                    break;
+                case OP_SUB:
+                    for (int p = 0; p < n; p++)
+                        c[p] = a[p] - b[p];
+                    break;
+                case OP_MUL:
+                    for (int p = 0; p < n; p++)
+                        c[p] = a[p] * b[p];
+                    break;
+                case OP_DIV:
+                    for (int p = 0; p < n; p++)
+                        c[p] = a[p] / b[p];
+                    break;
+                case OP_POW:
+                    for (int p = 0; p < n; p++)
+                        c[p] = pow(a[p], b[p]);
+                    break;
+                case OP_FUNC:
+                    math_funcs[in->b].batch_(a, c, n);
+                    break;
+                case OP_SINCOS:
+                {
+                    double* sin_c = (in->cos_own)?block + (size_t) in->b * EVAL_BLOCK:c;
+                    double* cos_c = (in->cos_own)?c:block + (size_t) in->b * EVAL_BLOCK;
+                    for (int p = 0; p < n; p++)
+                        sincos(a[p], &sin_c[p], &cos_c[p]);
+                    break;
+                }
+                case OP_CONST:
+                case OP_VAR:
+                case OP_NOP:
+                default:
+                    printf("evalBatch: unknown instruction %i\n", in->op);
+                    exit(4);
+            }
+        }
+        for (int i = 0; i < n_outs_; i++)
+            memcpy(res + (size_t) i * (size_t) n_points + start, block + (size_t) outs_[i] * EVAL_BLOCK,
+                   (size_t) n * sizeof(double));
+    }
+    free(block);
+}
+
+//c = a^(1/2):  c^2 = a  gives  c_k = (a_k - sum c_j c_(k-j)) / (2 c_0)
+static void taylor_sqrt(const double* a, double* c, int order)
+{
+    c[0] = sqrt(a[0]);
+    for (int k = 1; k <= order; k++)
+    {
+        double sum = a[k];
+        for (int j = 1; j < k; j++)
+            sum -= c[j] * c[k - j];
+        c[k] = sum / (2 * c[0]);
+    }
+}
+
+//c' = a' / r for c_0 set by the caller:  r c' = a'  gives  c_k = (k a_k - sum j c_j r_(k-j)) / (k r_0)
+static void taylor_quot_int(const double* a, const double* r, double* c, int order)
+{
+    for (int k = 1; k <= order; k++)
+    {
+        double sum = k * a[k];
+        for (int j = 1; j < k; j++)
+            sum -= j * c[j] * r[k - j];
+        c[k] = sum / (k * r[0]);
+    }
+}
+
+//entries of math_funcs: MathFunc::taylor_ takes the same tmp for every function
+
+static void taylor_func_ln(const double* a, double* c, double* tmp, int order)
+{
+    (void) tmp;
+    taylor_ln(a, c, order);
+}
+
+static void taylor_func_sin(const double* a, double* c, double* tmp, int order)
+{
+    taylor_sincos(a, c, tmp, order);
+}
+
+static void taylor_func_cos(const double* a, double* c, double* tmp, int order)
+{
+    taylor_sincos(a, tmp, c, order);
+}
+
+static void taylor_func_exp(const double* a, double* c, double* tmp, int order)
+{
+    (void) tmp;
+    taylor_exp(a, c, order);
+}
+
+//tan' = 1 + tan^2, the square is built up along with c
+static void taylor_func_tan(const double* a, double* c, double* tmp, int order)
+{
+    double* w = tmp;
+    c[0] = tan(a[0]);
+    w[0] = 1 + c[0] * c[0];
+    for (int k = 1; k <= order; k++)
+    {
+        double sum = 0.0;
+        for (int j = 1; j <= k; j++)
+            sum += j * a[j] * w[k - j];
+        c[k] = sum / k;
+        w[k] = 0.0;
+        for (int j = 0; j <= k; j++)
+            w[k] += c[j] * c[k - j];
+    }
+}
+
+static void taylor_func_sqrt(const double* a, double* c, double* tmp, int order)
+{
+    (void) tmp;
+    taylor_sqrt(a, c, order);
+}
+
+//asin' = 1 / (1 - a^2)^(1/2)
+static void taylor_func_asin(const double* a, double* c, double* tmp, int order)
+{
+    int     len = order + 1;
+    double* sq  = tmp;
+    double* r   = tmp + len;
+    taylor_mul(a, a, sq, order);
+    for (int k = 0; k < len; k++)
+        sq[k] = (k)?-sq[k]:1 - sq[k];
+    taylor_sqrt(sq, r, order);
+    c[0] = asin(a[0]);
+    taylor_quot_int(a, r, c, order);
+}
+
+//acos = pi/2 - asin
+static void taylor_func_acos(const double* a, double* c, double* tmp, int order)
+{
+    taylor_func_asin(a, c, tmp, order);
+    c[0] = acos(a[0]);
+    for (int k = 1; k <= order; k++)
+        c[k] = -c[k];
+}
+
+//atan' = 1 / (1 + a^2)
+static void taylor_func_atan(const double* a, double* c, double* tmp, int order)
+{
+    double* r = tmp;
+    taylor_mul(a, a, r, order);
+    r[0] += 1;
+    c[0] = atan(a[0]);
+    taylor_quot_int(a, r, c, order);
+}
+
+//math_funcs[].batch_, one loop per function over a block of evalBatch
 #define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)\
-if(!strcmp(curNodePtr->data_, #funcName))\
-    _##funcName##Calc(curNodePtr);
+#define MATH_FUNC(funcName, cppFuncName, notused_tex)                       \
+static void batch_##funcName(const double* a, double* c, int n)             \
+{                                                                           \
+    for (int p = 0; p < n; p++)                                             \
+        c[p] = cppFuncName(a[p]);                                           \
+}
 #include "MATH_FUNCTIONS"
 #undef MATH_FUNC
 #undef _FUNCTIONS_
-		}
-	}
+
+//Interval arithmetic: a and c are [lo, hi] pairs. A result is rounded to
+//nearest and then moved out by an ulp, two for libm functions, so it holds
+//every value the operation takes over its arguments; [-inf, inf] stands for
+//"anything", as where a function is not defined or a bound comes out NaN.
+
+static void iv_whole(double* c)
+{
+    c[0] = -INFINITY;
+    c[1] =  INFINITY;
 }
 
-int Differentator::_d_equal(double a, double b)
+static void iv_set(double* c, double lo, double hi, int ulps)
 {
-    if(fabs(a - b) < 0.00001)
-        return 1;
-    return 0;
+    if (std::isnan(lo) || std::isnan(hi))
+    {
+        iv_whole(c);
+        return;
+    }
+    for (int i = 0; i < ulps; i++)
+    {
+        lo = nextafter(lo, -INFINITY);
+        hi = nextafter(hi,  INFINITY);
+    }
+    c[0] = lo;
+    c[1] = hi;
 }
 
-void Differentator::_zeroMul(Node* curNodePtr)
+//bounds of the four products or quotients of the ends
+static void iv_ends(const double* p, double* c)
 {
-	if (!curNodePtr) goto skip;
-    if (curNodePtr->data_ && curNodePtr->data_[0] == '*' &&
-        curNodePtr->left_dec_ && curNodePtr->right_dec_)
+    double lo = p[0], hi = p[0];
+    for (int i = 0; i < 4; i++)
     {
-        NODE_TYPE l_type = curNodePtr->left_dec_->type_;
-        NODE_TYPE r_type = curNodePtr->right_dec_->type_;
-            double a = 1.0, b = 1.0;
-            if (l_type == TYPE_CONST)
-                sscanf(curNodePtr->left_dec_->data_, "%lg", &a);
-            if (r_type == TYPE_CONST)
-                sscanf(curNodePtr->right_dec_->data_, "%lg", &b);
-    
-            if (_d_equal(a, 0.0) || _d_equal(b, 0.0))
-            {
-                curNodePtr->data_[0]    = '0';
-                curNodePtr->type_       = TYPE_CONST;
-                curNodePtr->priority_   = PR_LOW,
+        if (std::isnan(p[i]))
+        {
+            iv_whole(c);
+            return;
+        }
+        lo = (p[i] < lo)?p[i]:lo;
+        hi = (p[i] > hi)?p[i]:hi;
+    }
+    iv_set(c, lo, hi, 1);
+}
 
-                delete_subTree(&curNodePtr->left_dec_);
-                printf("left one is deleted\n");
-                delete_subTree(&curNodePtr->right_dec_);
-                curNodePtr->left_dec_ = curNodePtr->right_dec_ = NULL;
-                printf("right is deleted\n");
-            }
+static void iv_mul(const double* a, const double* b, double* c)
+{
+    double p[4] = {a[0] * b[0], a[0] * b[1], a[1] * b[0], a[1] * b[1]};
+    iv_ends(p, c);
+}
+
+static void iv_div(const double* a, const double* b, double* c)
+{
+    if (b[0] <= 0.0 && b[1] >= 0.0)
+    {
+        iv_whole(c);
+        return;
     }
-    if (curNodePtr->left_dec_)
-        _zeroMul(curNodePtr->left_dec_);
-        
-    if (curNodePtr->right_dec_)
-        _zeroMul(curNodePtr->right_dec_);
-	skip: ;
+    double p[4] = {a[0] / b[0], a[0] / b[1], a[1] / b[0], a[1] / b[1]};
+    iv_ends(p, c);
 }
 
-void Differentator::_zeroPow(Node* curNodePtr)
+//sin or cos: the ends, and 1 or -1 if a maximum at max_at + 2 pi k or a
+//minimum half a period away lies in between
+static void iv_periodic(const double* a, double* c, double (*fn)(double), double max_at)
 {
-	if (!curNodePtr) goto skip;
-    if (curNodePtr->data_     && curNodePtr->data_[0] == '^' &&
-        curNodePtr->left_dec_ && curNodePtr->right_dec_)
+    const double period = 2.0 * M_PI;
+    if (!(a[1] - a[0] < period) || fabs(a[0]) > 1e6 || fabs(a[1]) > 1e6)
     {
-            double degree;
-            sscanf(curNodePtr->right_dec_->data_, "%lg", &degree);
-            if (_d_equal(degree, 0.0))
-            {
-                curNodePtr->data_[0]    = '1';
-                curNodePtr->type_       = TYPE_CONST;
-                curNodePtr->priority_   = PR_LOW;
-                delete_subTree(&curNodePtr->left_dec_);
-                delete_subTree(&curNodePtr->right_dec_);
-                curNodePtr->right_dec_  = curNodePtr->left_dec_ = NULL;
-            }
+        c[0] = -1.0;
+        c[1] =  1.0;
+        return;
     }
-    if (curNodePtr->left_dec_)
-        _zeroPow(curNodePtr->left_dec_);
-    if (curNodePtr->right_dec_)
-        _zeroPow(curNodePtr->right_dec_);
-	skip: ;
+    double f_lo = fn(a[0]), f_hi = fn(a[1]);
+    double lo = (f_lo < f_hi)?f_lo:f_hi;
+    double hi = (f_lo < f_hi)?f_hi:f_lo;
+    if (max_at + period * ceil((a[0] - max_at) / period) <= a[1])
+        hi = 1.0;
+    if (max_at + M_PI + period * ceil((a[0] - max_at - M_PI) / period) <= a[1])
+        lo = -1.0;
+    iv_set(c, lo, hi, 2);
+    c[0] = (c[0] < -1.0)?-1.0:c[0];
+    c[1] = (c[1] >  1.0)? 1.0:c[1];
 }
 
-void Differentator::_unitDiv(Node** curNodePtr)
+//math_funcs[].interval_
+static void interval_func_ln(const double* a, double* c)
 {
-	if (!*curNodePtr) goto skip;
-    if ((*curNodePtr)->data_ &&(*curNodePtr)->data_[0] == '/' &&
-        (*curNodePtr)->left_dec_ && (*curNodePtr)->right_dec_)
+    if (!(a[1] > 0.0))
     {
-            double r_val = 42.0;
-            if ((*curNodePtr)->right_dec_->type_ == TYPE_CONST)
-            {
-                sscanf((*curNodePtr)->right_dec_->data_, "%lg", &r_val);
-                if (_d_equal(r_val, 1.0))
-                {
-                    Node* node_to_bridge = (*curNodePtr)->left_dec_;
-                    delete *curNodePtr;
-                    *curNodePtr = node_to_bridge;
-                }
-            }
+        iv_whole(c);
+        return;
     }
-    if ((*curNodePtr)->left_dec_)
-        _unitDiv( &((*curNodePtr)->left_dec_) );
-    if ((*curNodePtr)->right_dec_)
-        _unitDiv( &((*curNodePtr)->right_dec_) );
-	skip: ;
+    iv_set(c, (a[0] > 0.0)?log(a[0]):-INFINITY, log(a[1]), 2);
 }
 
-#define ZERO_UNIT_NODE_ACTION(funcName, actChar, nodeValue)                 \
-void Differentator::funcName(Node** curNodePtr)                             \
-{																			\
-	if (!*curNodePtr) goto skip;											\
-    if ((*curNodePtr)->data_ && (*curNodePtr)->data_[0] == actChar			\
-							 && !isdigit((*curNodePtr)->data_[1]))          \
-    {                                                                       \
-        if ((*curNodePtr)->left_dec_ && (*curNodePtr)->right_dec_)          \
-        {                                                                   \
-            printf("IN %s node %p: [%s]\n", #funcName, *curNodePtr, (*curNodePtr)->data_);\
-            double l_val = -1.0, r_val = -1.0;                              \
-            if ((*curNodePtr)->left_dec_->type_  == TYPE_CONST)             \
-                sscanf((*curNodePtr)->left_dec_->data_,  "%lg", &l_val);    \
-            if ((*curNodePtr)->right_dec_->type_ == TYPE_CONST)             \
-                sscanf((*curNodePtr)->right_dec_->data_, "%lg", &r_val);    \
-            if(_d_equal(l_val, nodeValue))                                  \
-            {                                                               \
-				Node* node_to_bridge = NULL;								\
-				if (_d_equal(l_val, 0.0))									\
-				{															\
-					node_to_bridge = new Node("*");							\
-					node_to_bridge->left_dec_= new Node("-1");				\
-					node_to_bridge->right_dec_ = (*curNodePtr)->right_dec_->Dup();\
-				}															\
-				else	node_to_bridge = (*curNodePtr)->right_dec_->Dup();	\
-                delete *curNodePtr;                                         \
-                *curNodePtr = node_to_bridge;                               \
-            }                                                               \
-            else                                                            \
-                if(_d_equal(r_val, nodeValue))                              \
-                {                                                           \
-                    Node* node_to_bridge = (*curNodePtr)->left_dec_;        \
-                    delete *curNodePtr;                                     \
-                    *curNodePtr = node_to_bridge;                           \
-                }                                                           \
-        }                                                                   \
-        else                                                                \
-        {                                                                   \
-            printf("Arguments for '%c' action requiered\n", actChar);       \
-			(*curNodePtr)->printNode();										\
-            exit(0);                                                        \
-        }                                                                   \
-    }                                                                       \
-    if ((*curNodePtr)->left_dec_)                                           \
-        funcName( &((*curNodePtr)->left_dec_) );                            \
-    if((*curNodePtr)->right_dec_)                                           \
-        funcName( &((*curNodePtr)->right_dec_) );                           \
-	skip: ;																	\
+static void interval_func_sin(const double* a, double* c)
+{
+    iv_periodic(a, c, sin, M_PI / 2);
 }
-ZERO_UNIT_NODE_ACTION(_unitMul, '*', 1.0)
-ZERO_UNIT_NODE_ACTION(_zeroSum, '+', 0.0)
-ZERO_UNIT_NODE_ACTION(_zeroSub, '-', 0.0)
-#undef ZERO_UNIT_NODE_ACTION
 
-#define NODE_DERIV_SUM_SUB_FUNC(actChar, funcName)              \
-Node* Differentator::funcName(Node* left_node, Node* right_node)\
-{                                                               \
-    Node* new_node       = new Node(actChar);                   \
-    new_node->left_dec_  = _derivative(left_node);              \
-    new_node->right_dec_ = _derivative(right_node);             \
-    new_node->left_dec_->ancestor_  = new_node;                 \
-    new_node->right_dec_->ancestor_ = new_node;                 \
-    return new_node;                                            \
+static void interval_func_cos(const double* a, double* c)
+{
+    iv_periodic(a, c, cos, 0.0);
 }
-NODE_DERIV_SUM_SUB_FUNC('+', _nodeDerivSum)
-NODE_DERIV_SUM_SUB_FUNC('-', _nodeDerivSub)
-#undef NODE_SUM_SUB_FUNC
 
-Node* Differentator::_nodeDerivMul(Node* left_dec, Node* right_dec)
+static void interval_func_exp(const double* a, double* c)
 {
-    Node* new_sum_node   = new Node('+');
-    Node* new_l = new Node('*');
-    Node* new_r = new Node('*');
-    new_l->left_dec_  = _derivative(left_dec);
-    new_l->right_dec_ = right_dec->Dup();
+    iv_set(c, exp(a[0]), exp(a[1]), 2);
+    c[0] = (c[0] < 0.0)?0.0:c[0];
+}
+
+//one branch between two poles, pi / 2 + pi k, or the whole line
+static void interval_func_tan(const double* a, double* c)
+{
+    if (!(a[1] - a[0] < M_PI) || floor(a[0] / M_PI + 0.5) < floor(a[1] / M_PI + 0.5) ||
+        tan(a[0]) > tan(a[1]))
+    {
+        iv_whole(c);
+        return;
+    }
+    iv_set(c, tan(a[0]), tan(a[1]), 2);
+}
+
+static void interval_func_sqrt(const double* a, double* c)
+{
+    if (!(a[1] >= 0.0))
+    {
+        iv_whole(c);
+        return;
+    }
+    iv_set(c, sqrt((a[0] > 0.0)?a[0]:0.0), sqrt(a[1]), 2);
+    c[0] = (c[0] < 0.0)?0.0:c[0];
+}
+
+static void interval_func_asin(const double* a, double* c)
+{
+    if (!(a[0] >= -1.0 && a[1] <= 1.0))
+    {
+        iv_whole(c);
+        return;
+    }
+    iv_set(c, asin(a[0]), asin(a[1]), 2);
+}
+
+static void interval_func_acos(const double* a, double* c)
+{
+    if (!(a[0] >= -1.0 && a[1] <= 1.0))
+    {
+        iv_whole(c);
+        return;
+    }
+    iv_set(c, acos(a[1]), acos(a[0]), 2);
+}
+
+static void interval_func_atan(const double* a, double* c)
+{
+    iv_set(c, atan(a[0]), atan(a[1]), 2);
+}
+
+//a^n for an integer n by the monotone pieces of x^|n|, exp(b * ln a) otherwise
+static void iv_pow(const double* a, const double* b, double* c)
+{
+    if (exact_equal(b[0], b[1]) && exact_equal(b[0], floor(b[0])) && fabs(b[0]) <= 1e9)
+    {
+        int n = (int) fabs(b[0]);
+        double p_lo = pow(a[0], n), p_hi = pow(a[1], n);
+        if (!n)
+            iv_set(c, 1.0, 1.0, 0);
+        else if (n % 2)
+            iv_set(c, p_lo, p_hi, 2);
+        else if (a[0] <= 0.0 && a[1] >= 0.0)
+            iv_set(c, 0.0, (p_lo > p_hi)?p_lo:p_hi, 2);
+        else
+            iv_set(c, (p_lo < p_hi)?p_lo:p_hi, (p_lo < p_hi)?p_hi:p_lo, 2);
+        if (n % 2 == 0)
+            c[0] = (c[0] < 0.0)?0.0:c[0];
+        if (b[0] < 0.0)
+        {
+            double one[2] = {1.0, 1.0}, den[2] = {c[0], c[1]};
+            iv_div(one, den, c);
+        }
+        return;
+    }
+    if (!(a[0] > 0.0))
+    {
+        iv_whole(c);
+        return;
+    }
+    double ln_a[2] = {}, prod[2] = {};
+    interval_func_ln(a, ln_a);
+    iv_mul(b, ln_a, prod);
+    interval_func_exp(prod, c);
+}
+
+//vars_lo[var] <= var <= vars_hi[var], res_lo[out] and res_hi[out] get bounds
+//of every output that hold over the whole box
+void EvalProgram::evalInterval(const double* vars_lo, const double* vars_hi, double* res_lo, double* res_hi)
+{
+    double* iv = (double*) calloc (2 * (size_t) size_ + 2, sizeof(double));
+    if (!iv)
+    {
+        printf("evalInterval: error finding memory for %i intervals\n", size_);
+        exit(2);
+    }
+    for (int i = 0; i < size_; i++)
+    {
+        const EvalInstr* in = &code_[i];
+        double*       c = iv + 2 * (size_t) i;
+        const double* a = iv + 2 * (size_t) in->a;
+        const double* b = iv + 2 * (size_t) in->b;
+        switch(in->op)
+        {
+            case OP_CONST:
+                c[0] = c[1] = in->val;
+                break;
+            case OP_VAR:
+                c[0] = vars_lo[in->a];
+                c[1] = vars_hi[in->a];
+                break;
+            case OP_ADD:
+                iv_set(c, a[0] + b[0], a[1] + b[1], 1);
+                break;
+            case OP_SUB:
+                iv_set(c, a[0] - b[1], a[1] - b[0], 1);
+                break;
+            case OP_MUL:
+                iv_mul(a, b, c);
+                break;
+            case OP_DIV:
+                iv_div(a, b, c);
+                break;
+            case OP_POW:
+                iv_pow(a, b, c);
+                break;
+            case OP_FUNC:
+                math_funcs[in->b].interval_(a, c);
+                break;
+            case OP_SINCOS:
+            {
+                double* other = iv + 2 * (size_t) in->b;
+                interval_func_sin(a, (in->cos_own)?other:c);
+                interval_func_cos(a, (in->cos_own)?c:other);
+                break;
+            }
+            case OP_NOP:
+                break;
+            default:
+                printf("evalInterval: unknown instruction %i\n", in->op);
+                exit(4);
+        }
+    }
+    for (int i = 0; i < n_outs_; i++)
+    {
+        res_lo[i] = iv[2 * (size_t) outs_[i]];
+        res_hi[i] = iv[2 * (size_t) outs_[i] + 1];
+    }
+    free(iv);
+}
+
+
+/* ROOT FINDING */
+
+enum SOLVE_STATUS
+{
+    SOLVE_ACTIVE,
+    SOLVE_CONVERGED,
+    SOLVE_FLAT,         //f' is 0 or not finite where the iteration got to
+    SOLVE_STALLED,      //no fraction of the newton step makes |f| smaller
+    SOLVE_MAX_ITER,
+    SOLVE_UNBOUNDED,    //f went to -inf, for minimize
+    SOLVE_UNDEFINED,    //f is not finite at the start, as ln(x) for x < 0
+    SOLVE_STATUS_CNT
+};
+
+static const char* const solve_status_names[SOLVE_STATUS_CNT] =
+    {"active", "converged", "flat", "stalled", "max_iter", "unbounded", "undefined"};
+
+enum
+{
+    SOLVE_MAX_ITERS    = 100,   //accepted newton steps from one start
+    SOLVE_MAX_HALVINGS = 40,    //of one step before the start is given up as stalled
+    MAX_THREADS        = 64
+};
+
+static const double SOLVE_TOL = 1e-10;  //newton step relative to 1 + |x| that counts as converged
+
+//workers for n_tasks independent tasks, one per online cpu at most
+static int thread_count(int n_tasks)
+{
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int  n      = (n_cpus < 1)?1:(n_cpus > MAX_THREADS)?MAX_THREADS:(int) n_cpus;
+    return (n_tasks < n)?((n_tasks < 1)?1:n_tasks):n;
+}
+
+//runs fn on each of n_jobs jobs of job_size bytes, job 0 in the calling thread;
+//a job that gets no thread of its own is run there as well
+static void run_threads(void* (*fn)(void*), void* jobs, size_t job_size, int n_jobs)
+{
+    pthread_t threads[MAX_THREADS] = {};
+    int       started[MAX_THREADS] = {};
+    for (int t = 1; t < n_jobs; t++)
+        started[t] = !pthread_create(&threads[t], NULL, fn, (char*) jobs + (size_t) t * job_size);
+    fn(jobs);
+    for (int t = 1; t < n_jobs; t++)
+        if (started[t])
+            pthread_join(threads[t], NULL);
+        else
+            fn((char*) jobs + (size_t) t * job_size);
+}
+
+//starts [begin_, end_) of one thread, the program has f and f' as outputs
+struct SolveJob
+{
+    EvalProgram*    prog_;
+    int             var_;
+    int             n_vars_;
+    const double*   point_;     //values of the other vars
+    double*         x_;         //starts, replaced by where the iteration ended
+    int*            iters_;
+    int*            status_;
+    int             begin_;
+    int             end_;
+};
+
+//Safeguarded newton: a step that does not make |f| smaller is halved until it
+//does. Starts go EVAL_BLOCK at a time through evalBatch, each block iterates
+//until none of its starts is active.
+static void* solve_thread(void* arg)
+{
+    SolveJob* job = (SolveJob*) arg;
+    int       nv  = job->n_vars_;
+    double* vars   = (double*) calloc ((size_t) nv * EVAL_BLOCK + 1, sizeof(double));
+    double* out    = (double*) calloc (2 * EVAL_BLOCK, sizeof(double));
+    double* f      = (double*) calloc (2 * EVAL_BLOCK, sizeof(double));
+    double* lambda = (double*) calloc (EVAL_BLOCK, sizeof(double));
+    if (!vars || !out || !f || !lambda)
+    {
+        printf("solve: error finding memory for a block\n");
+        exit(2);
+    }
+    double* df = f + EVAL_BLOCK;
+    for (int start = job->begin_; start < job->end_; start += EVAL_BLOCK)
+    {
+        int     n      = (job->end_ - start < EVAL_BLOCK)?job->end_ - start:EVAL_BLOCK;
+        double* x      = job->x_      + start;
+        int*    iters  = job->iters_  + start;
+        int*    status = job->status_ + start;
+        double* x_try  = vars + (size_t) job->var_ * (size_t) n;
+        for (int v = 0; v < nv; v++)
+            for (int p = 0; p < n; p++)
+                vars[(size_t) (v * n + p)] = (v == job->var_)?x[p]:job->point_[v];
+        job->prog_->evalBatch(vars, n, out);
+        for (int p = 0; p < n; p++)
+        {
+            f[p]      = out[p];
+            df[p]     = out[n + p];
+            lambda[p] = 1.0;
+            iters[p]  = 0;
+            status[p] = SOLVE_ACTIVE;
+        }
+
+        for (;;)
+        {
+            int n_active = 0;
+            for (int p = 0; p < n; p++)
+            {
+                x_try[p] = x[p];
+                if (status[p] != SOLVE_ACTIVE)
+                    continue;
+                double step = (fabs(df[p]) > 0.0)?f[p] / df[p]:0.0;
+                if (!std::isfinite(f[p]))
+                    status[p] = SOLVE_UNDEFINED;
+                else if (exact_equal(f[p], 0.0))
+                    status[p] = SOLVE_CONVERGED;
+                else if (!(fabs(df[p]) > 0.0) || !std::isfinite(step))
+                    status[p] = SOLVE_FLAT;
+                else if (fabs(step) <= SOLVE_TOL * (1.0 + fabs(x[p])))
+                {
+                    x[p]     -= step;
+                    status[p] = SOLVE_CONVERGED;
+                }
+                else if (iters[p] == SOLVE_MAX_ITERS)
+                    status[p] = SOLVE_MAX_ITER;
+                else
+                {
+                    x_try[p] = x[p] - lambda[p] * step;
+                    n_active++;
+                }
+            }
+            if (!n_active)
+                break;
+            job->prog_->evalBatch(vars, n, out);
+            for (int p = 0; p < n; p++)
+            {
+                if (status[p] != SOLVE_ACTIVE)
+                    continue;
+                if (fabs(out[p]) < fabs(f[p]))
+                {
+                    x[p]      = x_try[p];
+                    f[p]      = out[p];
+                    df[p]     = out[n + p];
+                    lambda[p] = 1.0;
+                    iters[p]++;
+                }
+                else if ((lambda[p] *= 0.5) < ldexp(1.0, -SOLVE_MAX_HALVINGS))
+                    status[p] = SOLVE_STALLED;
+            }
+        }
+    }
+    free(vars);
+    free(out);
+    free(f);
+    free(lambda);
+    return NULL;
+}
+
+
+/* MINIMIZATION */
+
+enum
+{
+    LBFGS_MEM       = 8,    //(s, y) pairs kept for the inverse hessian
+    LBFGS_MAX_ITERS = 1000
+};
+
+static const double LBFGS_TOL    = 1e-8;    //max |partial| relative to 1 + |f| that counts as a minimum
+static const double LBFGS_ARMIJO = 1e-4;    //part of the decrease predicted by the slope a step must give
+
+//starts [begin_, end_) of one thread, the program has f and its n_vars_ partials as outputs
+struct MinimizeJob
+{
+    EvalProgram*    prog_;
+    int             n_vars_;
+    double*         x_;         //start-major, n_vars_ per start, replaced by where the iteration ended
+    double*         f_;
+    int*            iters_;
+    int*            status_;
+    int             begin_;
+    int             end_;
+};
+
+//L-BFGS state of one start, all arrays are n_vars long
+struct LbfgsState
+{
+    double* x_;
+    double* g_;
+    double* d_;                 //search direction
+    double* s_[LBFGS_MEM];      //x and g differences of the last steps, a ring from head_
+    double* y_[LBFGS_MEM];
+    double  rho_[LBFGS_MEM];    //1 / (y, s)
+    int     n_pairs_;
+    int     head_;
+    double  f_;
+    double  slope_;             //(g, d)
+    double  alpha_;             //step being tried
+};
+
+static double dot(const double* a, const double* b, int n)
+{
+    double sum = 0.0;
+    for (int i = 0; i < n; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+//d = -H g by the two-loop recursion, the steepest descent if that is not downhill
+static void lbfgs_direction(LbfgsState* st, int n)
+{
+    double a[LBFGS_MEM] = {};
+    double* q = st->d_;
+    memcpy(q, st->g_, (size_t) n * sizeof(double));
+    for (int k = 0; k < st->n_pairs_; k++)
+    {
+        int i = (st->head_ - 1 - k + LBFGS_MEM) % LBFGS_MEM;
+        a[i] = st->rho_[i] * dot(st->s_[i], q, n);
+        for (int j = 0; j < n; j++)
+            q[j] -= a[i] * st->y_[i][j];
+    }
+    if (st->n_pairs_)
+    {
+        int    i     = (st->head_ - 1 + LBFGS_MEM) % LBFGS_MEM;
+        double gamma = dot(st->s_[i], st->y_[i], n) / dot(st->y_[i], st->y_[i], n);
+        for (int j = 0; j < n; j++)
+            q[j] *= gamma;
+    }
+    for (int k = st->n_pairs_ - 1; k >= 0; k--)
+    {
+        int    i = (st->head_ - 1 - k + LBFGS_MEM) % LBFGS_MEM;
+        double b = st->rho_[i] * dot(st->y_[i], q, n);
+        for (int j = 0; j < n; j++)
+            q[j] += (a[i] - b) * st->s_[i][j];
+    }
+    for (int j = 0; j < n; j++)
+        q[j] = -q[j];
+    st->slope_ = dot(st->g_, st->d_, n);
+    st->alpha_ = 1.0;
+    if (!(st->slope_ < 0.0))
+    {
+        st->n_pairs_ = 0;
+        for (int j = 0; j < n; j++)
+            st->d_[j] = -st->g_[j];
+        st->slope_ = -dot(st->g_, st->g_, n);
+    }
+    //without curvature pairs the first step is at most 1 long
+    if (!st->n_pairs_ && -st->slope_ > 1.0)
+        st->alpha_ = 1.0 / sqrt(-st->slope_);
+}
+
+//L-BFGS with backtracking (Armijo) line search. Like solve_thread, a block
+//of starts iterates in lockstep: every round each active start asks for f
+//and the gradient at one point, and the block gets them from one evalBatch.
+static void* minimize_thread(void* arg)
+{
+    MinimizeJob* job = (MinimizeJob*) arg;
+    int    nv     = job->n_vars_;
+    size_t n_vecs = 3 + 2 * LBFGS_MEM;
+    double*     vars   = (double*)     calloc ((size_t) nv * EVAL_BLOCK + 1, sizeof(double));
+    double*     out    = (double*)     calloc ((size_t) (nv + 1) * EVAL_BLOCK, sizeof(double));
+    double*     vecs   = (double*)     calloc (n_vecs * (size_t) nv * EVAL_BLOCK + 1, sizeof(double));
+    LbfgsState* states = (LbfgsState*) calloc (EVAL_BLOCK, sizeof(LbfgsState));
+    if (!vars || !out || !vecs || !states)
+    {
+        printf("minimize: error finding memory for a block of %i vars\n", nv);
+        exit(2);
+    }
+    for (int p = 0; p < EVAL_BLOCK; p++)
+    {
+        double* v = vecs + (size_t) p * n_vecs * (size_t) nv;
+        states[p].g_ = v;
+        states[p].d_ = v + nv;
+        for (int i = 0; i < LBFGS_MEM; i++)
+        {
+            states[p].s_[i] = v + (size_t) (2 + 2 * i) * (size_t) nv;
+            states[p].y_[i] = v + (size_t) (3 + 2 * i) * (size_t) nv;
+        }
+    }
+    for (int start = job->begin_; start < job->end_; start += EVAL_BLOCK)
+    {
+        int  n      = (job->end_ - start < EVAL_BLOCK)?job->end_ - start:EVAL_BLOCK;
+        int* iters  = job->iters_  + start;
+        int* status = job->status_ + start;
+        for (int p = 0; p < n; p++)
+        {
+            LbfgsState* st = &states[p];
+            st->x_       = job->x_ + (size_t) (start + p) * (size_t) nv;
+            st->n_pairs_ = 0;
+            st->head_    = 0;
+            iters[p]     = 0;
+            status[p]    = SOLVE_ACTIVE;
+            for (int j = 0; j < nv; j++)
+                vars[(size_t) (j * n + p)] = st->x_[j];
+        }
+        job->prog_->evalBatch(vars, n, out);
+        for (int p = 0; p < n; p++)
+        {
+            states[p].f_ = out[p];
+            for (int j = 0; j < nv; j++)
+                states[p].g_[j] = out[(size_t) ((j + 1) * n + p)];
+            lbfgs_direction(&states[p], nv);
+        }
+
+        for (;;)
+        {
+            int n_active = 0;
+            for (int p = 0; p < n; p++)
+            {
+                LbfgsState* st = &states[p];
+                if (status[p] != SOLVE_ACTIVE)
+                    continue;
+                double g_max = 0.0;
+                for (int j = 0; j < nv; j++)
+                    g_max = (fabs(st->g_[j]) > g_max)?fabs(st->g_[j]):g_max;
+                if (!std::isfinite(st->f_))
+                    status[p] = (st->f_ < 0.0)?SOLVE_UNBOUNDED:SOLVE_FLAT;
+                else if (g_max <= LBFGS_TOL * (1.0 + fabs(st->f_)))
+                    status[p] = SOLVE_CONVERGED;
+                else if (!std::isfinite(st->slope_))
+                    status[p] = SOLVE_FLAT;
+                else if (iters[p] == LBFGS_MAX_ITERS)
+                    status[p] = SOLVE_MAX_ITER;
+                else
+                {
+                    for (int j = 0; j < nv; j++)
+                        vars[(size_t) (j * n + p)] = st->x_[j] + st->alpha_ * st->d_[j];
+                    n_active++;
+                }
+            }
+            if (!n_active)
+                break;
+            job->prog_->evalBatch(vars, n, out);
+            for (int p = 0; p < n; p++)
+            {
+                LbfgsState* st = &states[p];
+                if (status[p] != SOLVE_ACTIVE)
+                    continue;
+                double f_try = out[p];
+                if (!(f_try <= st->f_ + LBFGS_ARMIJO * st->alpha_ * st->slope_))
+                {
+                    if ((st->alpha_ *= 0.5) < ldexp(1.0, -SOLVE_MAX_HALVINGS))
+                        status[p] = SOLVE_STALLED;
+                    continue;
+                }
+                //the step is taken, (s, y) is kept if the curvature along it is positive
+                double* s = st->s_[st->head_];
+                double* y = st->y_[st->head_];
+                for (int j = 0; j < nv; j++)
+                {
+                    double x_new = vars[(size_t) (j * n + p)];
+                    double g_new = out[(size_t) ((j + 1) * n + p)];
+                    s[j]       = x_new - st->x_[j];
+                    y[j]       = g_new - st->g_[j];
+                    st->x_[j]  = x_new;
+                    st->g_[j]  = g_new;
+                }
+                double sy = dot(s, y, nv);
+                if (sy > 0.0)
+                {
+                    st->rho_[st->head_] = 1.0 / sy;
+                    st->head_           = (st->head_ + 1) % LBFGS_MEM;
+                    st->n_pairs_       += (st->n_pairs_ < LBFGS_MEM);
+                }
+                st->f_ = f_try;
+                iters[p]++;
+                lbfgs_direction(st, nv);
+            }
+        }
+        for (int p = 0; p < n; p++)
+            job->f_[start + p] = states[p].f_;
+    }
+    free(vars);
+    free(out);
+    free(vecs);
+    free(states);
+    return NULL;
+}
+
+
+/* SAMPLING */
+
+enum
+{
+    SAMPLE_MIN_START = 16   //uniform points sample starts from before refining
+};
+
+static const double SAMPLE_TOL = 1e-9;  //interpolation error relative to 1 + the range of f that needs no refining
+
+//points [begin_, end_) of vars[var * stride_ + p], outputs go to res[out * stride_ + p]
+struct BatchJob
+{
+    EvalProgram*    prog_;
+    const double*   vars_;
+    double*         res_;
+    int             n_vars_;
+    int             stride_;
+    int             begin_;
+    int             end_;
+};
+
+static void* batch_thread(void* arg)
+{
+    BatchJob* job    = (BatchJob*) arg;
+    int       n_outs = job->prog_->n_outs_;
+    double* vars = (double*) calloc ((size_t) job->n_vars_ * EVAL_BLOCK + 1, sizeof(double));
+    double* res  = (double*) calloc ((size_t) n_outs * EVAL_BLOCK + 1, sizeof(double));
+    if (!vars || !res)
+    {
+        printf("evaluation: error finding memory for a block\n");
+        exit(2);
+    }
+    for (int start = job->begin_; start < job->end_; start += EVAL_BLOCK)
+    {
+        int n = (job->end_ - start < EVAL_BLOCK)?job->end_ - start:EVAL_BLOCK;
+        for (int v = 0; v < job->n_vars_; v++)
+            memcpy(vars + (size_t) (v * n), job->vars_ + (size_t) v * (size_t) job->stride_ + start,
+                   (size_t) n * sizeof(double));
+        job->prog_->evalBatch(vars, n, res);
+        for (int i = 0; i < n_outs; i++)
+            memcpy(job->res_ + (size_t) i * (size_t) job->stride_ + start, res + (size_t) (i * n),
+                   (size_t) n * sizeof(double));
+    }
+    free(vars);
+    free(res);
+    return NULL;
+}
+
+//evalBatch with the points split between threads
+static void eval_threads(EvalProgram* prog, int n_vars, const double* vars, int n_points, double* res)
+{
+    int n_blocks  = (n_points + EVAL_BLOCK - 1) / EVAL_BLOCK;
+    int n_threads = thread_count(n_blocks);
+    int per_job   = (n_blocks + n_threads - 1) / n_threads * EVAL_BLOCK;
+    BatchJob jobs[MAX_THREADS] = {};
+    for (int t = 0; t < n_threads; t++)
+    {
+        jobs[t] = {prog, vars, res, n_vars, n_points,
+                   (t * per_job < n_points)?t * per_job:n_points,
+                   ((t + 1) * per_job < n_points)?(t + 1) * per_job:n_points};
+    }
+    run_threads(batch_thread, jobs, sizeof(BatchJob), n_threads);
+}
+
+//f and f' at xs[0..m) of var, the other vars at point; vars has room for
+//n_vars * m values and res for 2 * m
+static void sample_eval(EvalProgram* prog, int n_vars, int var, const double* point,
+                        const double* xs, int m, double* vars, double* res)
+{
+    for (int v = 0; v < n_vars; v++)
+        for (int p = 0; p < m; p++)
+            vars[(size_t) (v * m + p)] = (v == var)?xs[p]:point[v];
+    eval_threads(prog, n_vars, vars, m, res);
+}
+
+static int cmp_doubles_desc(const void* a, const void* b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+    return (x < y) - (x > y);
+}
+
+
+/* SPARSITY */
+
+//var set of a subtree and the upper-triangle (i <= j, key i * n_vars + j)
+//second partials that are not zero by structure
+struct DepInfo
+{
+    int*        vars_;
+    int         n_vars_;
+    long long*  pairs_;
+    int         n_pairs_;
+};
+
+struct SparseHessian
+{
+    int     nnz_;
+    int*    rows_;      //COO, upper triangle in row-major order
+    int*    cols_;
+    Node**  entries_;
+    int*    row_ptr_;   //CSR over the same entries, n_vars + 1 items
+};
+
+//operand of a '+' or '*' being put in canonical order
+struct CanonItem
+{
+    Node*   node_;
+    int     rank_;      //0 for consts, 1 for vars, 2 for the rest
+    unsigned long long key_;   //var id or _treeHash
+    int     pos_;       //place before sorting, keeps equal keys in order
+};
+
+//node of the printed trees for the let-binding output
+struct LetItem
+{
+    Node*   node_;
+    int     uses_;      //parents among the printed trees
+    int     id_;        //number of its temporary, 0 if it is printed in place
+    double  size_;      //nodes of the expanded subtree, may be far beyond int
+};
+
+#define SORTED_UNION_FUNC(funcName, type)                                       \
+static type* funcName(const type* a, int n_a, const type* b, int n_b, int* n_res)\
+{                                                                               \
+    type* res = (type*) calloc ((size_t) (n_a + n_b) + 1, sizeof(type));        \
+    if (!res)                                                                   \
+    {                                                                           \
+        printf(#funcName ": error finding memory for %i items\n", n_a + n_b);   \
+        exit(2);                                                                \
+    }                                                                           \
+    int i = 0, j = 0, k = 0;                                                    \
+    while (i < n_a || j < n_b)                                                  \
+    {                                                                           \
+        if (j == n_b || (i < n_a && a[i] < b[j]))                               \
+            res[k++] = a[i++];                                                  \
+        else if (i == n_a || b[j] < a[i])                                       \
+            res[k++] = b[j++];                                                  \
+        else                                                                    \
+        {                                                                       \
+            res[k++] = a[i++];                                                  \
+            j++;                                                                \
+        }                                                                       \
+    }                                                                           \
+    *n_res = k;                                                                 \
+    return res;                                                                 \
+}
+SORTED_UNION_FUNC(union_ints,  int)
+SORTED_UNION_FUNC(union_pairs, long long)
+#undef SORTED_UNION_FUNC
+
+static int cmp_pairs(const void* a, const void* b)
+{
+    long long l = *(const long long*) a, r = *(const long long*) b;
+    return (l > r) - (l < r);
+}
+
+static int cmp_canon(const void* a, const void* b)
+{
+    const CanonItem* l = (const CanonItem*) a;
+    const CanonItem* r = (const CanonItem*) b;
+    if (l->rank_ != r->rank_)
+        return l->rank_ - r->rank_;
+    if (l->key_ != r->key_)
+        return (l->key_ > r->key_) - (l->key_ < r->key_);
+    return l->pos_ - r->pos_;
+}
+
+/* PERSISTENT CACHE */
+
+struct DiskCacheHeader
+{
+    char                magic_[8];
+    unsigned int        version_;
+    unsigned int        n_buckets_;     //power of two
+    unsigned long long  table_off_;     //offset of the current bucket table
+    unsigned long long  data_end_;      //everything after it is unused file space
+    unsigned long long  n_items_;
+};
+
+struct DiskCacheBucket
+{
+    unsigned long long  hash_;
+    unsigned long long  check_;         //second hash of the key, hash_ alone may collide
+    unsigned long long  offset_;        //record offset, 0 for an empty bucket
+};
+
+enum
+{
+    DISK_CACHE_VERSION   = 2,
+    DISK_CACHE_BUCKETS   = 1024
+};
+
+//Append-only memory mapped cache file: a header, bucket tables and records
+//(unsigned int length + tree body of tree_bin.h). Records never move; when the table
+//fills up a twice bigger one is appended and the header is pointed at it.
+class DiskCache
+{
+    public:
+        DiskCache   (const char* path);
+        ~DiskCache  ();
+        DiskCache   (const DiskCache&)              = delete;
+        DiskCache&  operator=(const DiskCache&)     = delete;
+        const unsigned char* find(unsigned long long hash, unsigned long long check, unsigned int* len);  //valid until the next call
+        void    add         (unsigned long long hash, unsigned long long check, const unsigned char* rec, unsigned int len);
+    private:
+        void    _map        (size_t min_size);
+        DiskCacheHeader* _header();
+        DiskCacheBucket* _probe(unsigned long long hash, unsigned long long check);
+        int     _valid      ();
+
+        int             fd_;
+        unsigned char*  base_;
+        size_t          size_;
+};
+
+DiskCache::DiskCache(const char* path):
+    fd_     (-1),
+    base_   (NULL),
+    size_   (0)
+    {
+        fd_ = open(path, O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0)
+        {
+            printf("DiskCache: cannot open '%s': %s\n", path, strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        flock(fd_, LOCK_EX);
+        struct stat st = {};
+        fstat(fd_, &st);
+        if (st.st_size == 0)
+        {
+            size_t init_size = sizeof(DiskCacheHeader) + DISK_CACHE_BUCKETS * sizeof(DiskCacheBucket);
+            _map(init_size * 2);
+            DiskCacheHeader* head = _header();
+            memcpy(head->magic_, "DIFFCACH", 8);
+            head->version_   = DISK_CACHE_VERSION;
+            head->n_buckets_ = DISK_CACHE_BUCKETS;
+            head->table_off_ = sizeof(DiskCacheHeader);
+            head->data_end_  = init_size;
+            head->n_items_   = 0;
+        }
+        else
+            _map(0);
+        if (size_ < sizeof(DiskCacheHeader) || memcmp(_header()->magic_, "DIFFCACH", 8) ||
+            _header()->version_ != DISK_CACHE_VERSION)
+        {
+            printf("DiskCache: '%s' is not a derivative cache of version %i\n", path, DISK_CACHE_VERSION);
+            exit(EXIT_FAILURE);
+        }
+        if (!_valid())
+        {
+            printf("DiskCache: '%s' is truncated or broken\n", path);
+            exit(EXIT_FAILURE);
+        }
+        flock(fd_, LOCK_UN);
+    }
+
+DiskCache::~DiskCache()
+{
+    if (base_)
+        munmap(base_, size_);
+    if (fd_ >= 0)
+        close(fd_);
+    base_ = NULL;
+    fd_   = -1;
+}
+
+void DiskCache::_map(size_t min_size)
+{
+    struct stat st = {};
+    fstat(fd_, &st);
+    size_t new_size = (size_t) st.st_size;
+    if (new_size < min_size)
+    {
+        new_size = (min_size > 2 * new_size)?min_size:2 * new_size;
+        if (ftruncate(fd_, (off_t) new_size))
+        {
+            printf("DiskCache: cannot grow cache file: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (base_ && new_size == size_)
+        return;
+    if (base_)
+        munmap(base_, size_);
+    base_ = (unsigned char*) mmap(NULL, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (base_ == MAP_FAILED)
+    {
+        printf("DiskCache: cannot map cache file: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    size_ = new_size;
+}
+
+DiskCacheHeader* DiskCache::_header()
+{
+    return (DiskCacheHeader*) base_;
+}
+
+//the header is read from the file, which a killed run may have left half
+//written: the table must lie in the used part of the mapping and have a power
+//of two buckets
+int DiskCache::_valid()
+{
+    DiskCacheHeader*   head = _header();
+    unsigned long long n    = head->n_buckets_;
+    return n && !(n & (n - 1)) && head->data_end_ <= size_ &&
+           head->table_off_ >= sizeof(DiskCacheHeader) && head->table_off_ <= head->data_end_ &&
+           n * sizeof(DiskCacheBucket) <= head->data_end_ - head->table_off_;
+}
+
+//the bucket of the key or the empty one where it goes, NULL if the table has neither
+DiskCacheBucket* DiskCache::_probe(unsigned long long hash, unsigned long long check)
+{
+    DiskCacheHeader* head   = _header();
+    DiskCacheBucket* table  = (DiskCacheBucket*) (base_ + head->table_off_);
+    unsigned int     mask   = head->n_buckets_ - 1;
+    unsigned int     i      = (unsigned int) hash & mask;
+    for (unsigned int n = 0; n <= mask; n++, i = (i + 1) & mask)
+        if (!table[i].offset_ || (table[i].hash_ == hash && table[i].check_ == check))
+            return &table[i];
+    return NULL;
+}
+
+const unsigned char* DiskCache::find(unsigned long long hash, unsigned long long check, unsigned int* len)
+{
+    flock(fd_, LOCK_SH);
+    if (_header()->data_end_ > size_)
+        _map(0);    //another process has appended to the file
+    //a record that does not fit the used part of the file is a miss
+    DiskCacheBucket*     bucket = (_valid())?_probe(hash, check):NULL;
+    unsigned long long   end    = _header()->data_end_;
+    const unsigned char* rec    = NULL;
+    if (bucket && bucket->offset_ && bucket->offset_ <= end - sizeof(unsigned int))
+    {
+        memcpy(len, base_ + bucket->offset_, sizeof(unsigned int));
+        if (*len <= end - bucket->offset_ - sizeof(unsigned int))
+            rec = base_ + bucket->offset_ + sizeof(unsigned int);
+    }
+    flock(fd_, LOCK_UN);
+    return rec;
+}
+
+void DiskCache::add(unsigned long long hash, unsigned long long check, const unsigned char* rec, unsigned int len)
+{
+    flock(fd_, LOCK_EX);
+    _map(0);
+    DiskCacheBucket* found = (_valid())?_probe(hash, check):NULL;
+    if (!found || found->offset_)
+    {
+        flock(fd_, LOCK_UN);
+        return;
+    }
+    DiskCacheHeader* head = _header();
+    if (2 * (head->n_items_ + 1) > head->n_buckets_)
+    {
+        unsigned int       n_buckets = head->n_buckets_ * 2;
+        unsigned long long table_off = head->data_end_;
+        _map(table_off + n_buckets * sizeof(DiskCacheBucket));
+        head = _header();
+        DiskCacheBucket* old_table = (DiskCacheBucket*) (base_ + head->table_off_);
+        DiskCacheBucket* new_table = (DiskCacheBucket*) (base_ + table_off);
+        memset(new_table, 0, n_buckets * sizeof(DiskCacheBucket));
+        for (unsigned int i = 0; i < head->n_buckets_; i++)
+            if (old_table[i].offset_)
+            {
+                unsigned int j = (unsigned int) old_table[i].hash_ & (n_buckets - 1);
+                while (new_table[j].offset_)
+                    j = (j + 1) & (n_buckets - 1);
+                new_table[j] = old_table[i];
+            }
+        head->data_end_  = table_off + n_buckets * sizeof(DiskCacheBucket);
+        head->table_off_ = table_off;
+        head->n_buckets_ = n_buckets;
+    }
+    unsigned long long offset = head->data_end_;
+    _map(offset + sizeof(unsigned int) + len);
+    head = _header();
+    memcpy(base_ + offset, &len, sizeof(unsigned int));
+    memcpy(base_ + offset + sizeof(unsigned int), rec, len);
+    head->data_end_ = offset + sizeof(unsigned int) + len;
+
+    DiskCacheBucket* bucket = _probe(hash, check);
+    if (!bucket)
+    {
+        flock(fd_, LOCK_UN);
+        return;
+    }
+    bucket->hash_   = hash;
+    bucket->check_  = check;
+    bucket->offset_ = offset;
+    head->n_items_++;
+    flock(fd_, LOCK_UN);
+}
+
+/* RENDERING */
+
+//What happens to the .gv and .tex files written along the way: sync runs
+//the tools and waits for them as before, async hands them to a worker thread
+//through a bounded queue, none (--headless) only writes the files.
+enum RENDER_MODE
+{
+    RENDER_SYNC,
+    RENDER_ASYNC,
+    RENDER_NONE
+};
+
+enum
+{
+    RENDER_QUEUE    = 8,    //jobs waiting for the worker, one more is dropped
+    RENDER_MAX_ARGS = 8,
+    RENDER_ARG_LEN  = 64
+};
+
+//a tool command line; viewers (xdot, evince) are not waited for by the worker
+struct RenderCmd
+{
+    char    args_[RENDER_MAX_ARGS][RENDER_ARG_LEN];
+    int     n_args_;
+    int     viewer_;
+};
+
+//commands run one after another, as pdflatex before evince
+struct RenderJob
+{
+    RenderCmd   cmds_[2];
+    int         n_cmds_;
+};
+
+//adds the command of the space separated line to the job
+static void render_cmd(RenderJob* job, int viewer, const char* line)
+{
+    RenderCmd* cmd = &job->cmds_[job->n_cmds_++];
+    cmd->viewer_ = viewer;
+    cmd->n_args_ = 0;
+    while (*line && cmd->n_args_ < RENDER_MAX_ARGS)
+    {
+        int len = (int) strcspn(line, " ");
+        if (len)
+            snprintf(cmd->args_[cmd->n_args_++], RENDER_ARG_LEN, "%.*s", len, line);
+        line += len + (line[len] == ' ');
+    }
+}
+
+class Renderer
+{
+    public:
+        Renderer    ();
+        ~Renderer   ();
+        Renderer    (const Renderer&)               = delete;
+        Renderer&   operator=(const Renderer&)      = delete;
+        void    setMode     (RENDER_MODE mode);
+        void    submit      (const RenderJob* job);
+        RENDER_MODE mode_;
+    private:
+        static void* _worker(void* arg);
+        void    _run        (const RenderJob* job);
+
+        RenderJob*      queue_;     //RENDER_QUEUE jobs, a ring from head_
+        int             head_;
+        int             size_;
+        int             closing_;
+        int             started_;
+        int             dropped_;
+        pthread_t       thread_;
+        pthread_mutex_t lock_;
+        pthread_cond_t  ready_;
+};
+
+Renderer::Renderer():
+    mode_       (RENDER_SYNC),
+    queue_      (NULL),
+    head_       (0),
+    size_       (0),
+    closing_    (0),
+    started_    (0),
+    dropped_    (0),
+    thread_     (),
+    lock_       (),
+    ready_      ()
+    {
+        queue_ = (RenderJob*) calloc (RENDER_QUEUE, sizeof(RenderJob));
+        if (!queue_)
+        {
+            printf("Renderer: error finding memory for the queue\n");
+            exit(2);
+        }
+        pthread_mutex_init(&lock_, NULL);
+        pthread_cond_init(&ready_, NULL);
+    }
+
+//the jobs still queued are run before the program ends, viewers are left open
+Renderer::~Renderer()
+{
+    if (started_)
+    {
+        pthread_mutex_lock(&lock_);
+        closing_ = 1;
+        pthread_cond_signal(&ready_);
+        pthread_mutex_unlock(&lock_);
+        pthread_join(thread_, NULL);
+    }
+    if (dropped_)
+        printf("Renderer: %i jobs dropped, the queue was full\n", dropped_);
+    pthread_mutex_destroy(&lock_);
+    pthread_cond_destroy(&ready_);
+    free(queue_);
+    queue_ = NULL;
+}
+
+void Renderer::setMode(RENDER_MODE mode)
+{
+    mode_ = mode;
+    if (mode_ == RENDER_ASYNC && !started_)
+    {
+        started_ = !pthread_create(&thread_, NULL, _worker, this);
+        if (!started_)
+        {
+            printf("Renderer: could not start a worker thread, rendering in place\n");
+            mode_ = RENDER_SYNC;
+        }
+    }
+}
+
+//never waits in async mode: a job that does not fit in the queue is dropped
+void Renderer::submit(const RenderJob* job)
+{
+    if (mode_ == RENDER_NONE)
+        return;
+    if (mode_ == RENDER_SYNC)
+    {
+        _run(job);
+        return;
+    }
+    pthread_mutex_lock(&lock_);
+    if (size_ == RENDER_QUEUE)
+        dropped_++;
+    else
+    {
+        queue_[(head_ + size_) % RENDER_QUEUE] = *job;
+        size_++;
+        pthread_cond_signal(&ready_);
+    }
+    pthread_mutex_unlock(&lock_);
+}
+
+void* Renderer::_worker(void* arg)
+{
+    Renderer* rend = (Renderer*) arg;
+    pthread_mutex_lock(&rend->lock_);
+    for (;;)
+    {
+        while (!rend->size_ && !rend->closing_)
+            pthread_cond_wait(&rend->ready_, &rend->lock_);
+        if (!rend->size_)
+            break;
+        RenderJob job = rend->queue_[rend->head_];
+        rend->head_ = (rend->head_ + 1) % RENDER_QUEUE;
+        rend->size_--;
+        pthread_mutex_unlock(&rend->lock_);
+        rend->_run(&job);
+        pthread_mutex_lock(&rend->lock_);
+    }
+    pthread_mutex_unlock(&rend->lock_);
+    return NULL;
+}
+
+//the commands of the job in a child process each; in async mode the tools
+//read nothing and write nowhere, and the viewers are not waited for
+void Renderer::_run(const RenderJob* job)
+{
+    int async = (mode_ == RENDER_ASYNC);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (async)
+    {
+        posix_spawn_file_actions_addopen(&actions, STDIN_FILENO,  "/dev/null", O_RDONLY, 0);
+        posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    for (int i = 0; i < job->n_cmds_; i++)
+    {
+        RenderCmd cmd = job->cmds_[i];
+        char* argv[RENDER_MAX_ARGS + 1] = {};
+        for (int k = 0; k < cmd.n_args_; k++)
+            argv[k] = cmd.args_[k];
+        pid_t pid = 0;
+        if (posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ))
+            printf("Renderer: could not run %s\n", argv[0]);
+        else if (!async || !cmd.viewer_)
+            waitpid(pid, NULL, 0);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    //viewers closed since the last job
+    while (waitpid(-1, NULL, WNOHANG) > 0)
+        ;
+}
+
+/* DERIVATIVE CACHE */
+
+struct DerivCacheItem
+{
+    unsigned long long  hash_;
+    int                 var_;
+    Node*               tree_;      //shared key subtree, compared on a hash match
+    Node*               deriv_;     //shared simplified derivative of tree_ by var_
+};
+
+class Differentator
+{
+    public:    
+        Differentator   (FILE* file_to_read, FILE* res_file, const char* tex_file);
+        ~Differentator  ();
+        void    delete_subTree   (Node** head);
+        void    printTree        (Node* root);
+        void    inFilePrint      ();
+        void    inFilePrint_dot  (Node* head);
+        void    inFilePrint_tex  (Node* head1, Node* head2);
+        void    inFilePrint_jacobian(Node** jac);
+        void    buildTree        ();
+        void    buildTrees       ();
+        void    alterTree        (Node** curNodePtr);
+        void    derivative       (const char* var_name = NULL, const double* point = NULL);
+        void    jacobian         ();
+        Node*   partial          (Node* head, int var_id);
+        Node**  gradient         (Node* head);
+        Node**  jacobian         (Node** heads, int n_heads);
+        void    shareSubtrees    (Node** head);
+        int     varId            (const char* var_name);
+        void    useDiskCache     (const char* path);
+        void    useBinaryOutput  ();
+        void    useLetBindings   (int min_size);
+        void    useReassociation ();
+        void    useRenderer      (RENDER_MODE mode);
+        void    inFilePrint_bin  (Node* head);
+        void    hessian          (Node* head, SparseHessian* hes);
+        void    hessian          (const double* point);
+        void    freeHessian      (SparseHessian* hes);
+        double* readPoint        (char** args, int n_args);
+        void    readBox          (char** args, int n_args, double** box_lo, double** box_hi);
+        void    bound            (const double* box_lo, const double* box_hi);
+        void    solve            (const char* var_range, int n_starts, const double* point);
+        void    minimize         (int n_starts, const double* box_lo, const double* box_hi);
+        void    sample           (const char* var_range, int n_samples, const double* point);
+        void    evalFile         (const char* data_path, char** outs, int n_outs);
+        void    taylor           (const char* var_at, int order, const double* point);
+        char*   sprintTree       (Node* curNodePtr, char* dest);//const + free
+
+        //derivative rules of MATH_FUNCTIONS, math_funcs takes their addresses
+#define _FUNCTIONS_
+#define MATH_FUNC(funcName, notused, notused_tex)           \
+        Node*  _##funcName##Der(Node* curNodePtr, int var);
+#include "MATH_FUNCTIONS"
+#undef  MATH_FUNC
+#undef  _FUNCTIONS_
+    private:
+
+		Node* GetExprNode();
+		Node* GetSumSubNode();
+		Node* GetMulDivNode();
+		Node* GetPowNode();
+		Node* GetBracesNode();
+		Node* GetNumberNode();
+		Node* GetNameNode();
+		void  SkipSpaces();
+
+        Node*	_derivative      (Node* curNodePtr, int var);
+        Node*	_derivRule       (Node* curNodePtr, int var);
+        void	_boundMin        (EvalProgram* prog, const double* box_lo, const double* box_hi,
+                                  double sign, double* res, int* n_boxes);
+        unsigned long long _treeHash(Node* curNodePtr);
+        int		_treeEqual       (Node* a, Node* b);
+        DerivCacheItem* _dcacheFind(Node* curNodePtr, int var);
+        void	_dcacheAdd       (Node* curNodePtr, int var, Node* deriv);
+        Node*	_cseNode         (Node* curNodePtr);
+        LetItem* _letFind        (Node* curNodePtr);
+        void	_letCount        (Node* curNodePtr);
+        void	_letNumber       (Node* curNodePtr);
+        void	_letBuild        (Node** heads, int n_heads);
+        void	_letWrite        ();
+        void	_letWrite_tex    ();
+        void	_letFree         ();
+        int 	_letRef          (Node* curNodePtr);
+        void	_cseAdd          (Node* curNodePtr);
+        unsigned long long _persistHash(Node* curNodePtr, unsigned long long seed);
+        Node*   _internConst     (double val);
+        void	_packTree        (Node*  curNodePtr, Blob* blob);
+        void	_packNode        (Node*  curNodePtr, Blob* ops, Blob* consts, Blob* syms, int* sym_ids, int* n_syms, int* n_nodes);
+        Node*	_unpackTree      (const unsigned char* rec, unsigned int len);
+        Node*	_nodeDerivMul    (Node* left_node, Node* right_node, int var);
+        Node*	_nodeDerivSum    (Node* left_node, Node* right_node, int var);
+        Node*	_nodeDerivSub    (Node* left_node, Node* right_node, int var);
+        Node*	_nodeDerivDiv    (Node* left_node, Node* right_node, int var);
+        Node*	_nodeDerivPow    (Node* left_node, Node* right_node, int var);
+        Node*	_nodePow         (Node* left_node, double deg);
+        Node*	_nodeDerivNary   (Node* curNodePtr, int var);
+        Node*	_joinNode        (char actChar, Node* left_node, Node* right_node);
+        void	_flatTree        (Node** curNodePtr);
+        void	_canonTree       (Node** curNodePtr);
+        void	_dropHashes      (Node*  curNodePtr);
+        void	_balanceTree     (Node** curNodePtr);
+        Node*	_opsNode         (char actChar, Node** ops, int n_ops);
+        Node*	_asinRoot        (Node* arg_node);
+        Node*	_buildTree       (Node*  curNodePtr);
+        int 	_internVar       (const char* name, size_t len);
+        int 	_varSlot         (const char* name, size_t len);
+        void	_bridge          (Node** curNodePtr, Node* node_to_bridge);
+        void	_printTree       (Node*  curNodePtr);
+        void	_sprintTree      (Node*  curNodePtr, char* tree_str);
+        void	_inFilePrint     (Node*  curNodePtr);  
+        void	_inFilePrint_dot (Node*  curNodePtr, FILE* gv_f);
+        void	_inFilePrint_tex (Node*  curNodePtr);
+        void	_texCompile      ();
+        void	_depAnalysis     (Node*  curNodePtr, DepInfo* dep);
+        void	_depCross        (DepInfo* dep, const int* a, int n_a, const int* b, int n_b);
+        void	_depFree         (DepInfo* dep);
+        void	_countTree       (Node*  curNodePtr);
+        void	_zeroMul         (Node*  curNodePtr);
+        void	_zeroSum         (Node** curNodePtr);
+        void	_zeroSub         (Node** curNodePtr);
+        void	_zeroDiv         (Node*  curNodePtr);
+        void	_zeroPow         (Node*  curNodePtr);
+        void	_unitMul         (Node** curNodePtr);
+        void	_unitDiv         (Node** curNodePtr);
+        int		_d_equal         (double a, double b);
+        void	_funcCalc        (Node*  node);
+
+        Node*   root_;
+        Node*   new_root_;
+        Node**  roots_;       //every expression of the file, root_ is the first one
+        int     n_roots_;
+        char**  vars_;        //var names, Node::var_id_ indexes this table
+        int     n_vars_;
+        int     vars_cap_;
+        int*    var_slots_;   //open addressing table of var ids keyed by name, -1 is empty
+        int     var_slots_cap_;
+        int     alter_cnt_;   //rewrites made by the current alterTree pass
+        DerivCacheItem* dcache_;  //open addressing table of derivated subtrees
+        int     dcache_cap_;
+        int     dcache_size_;
+        Node**  cse_;         //open addressing table of the distinct simplified subtrees, by _treeHash
+        int     cse_cap_;
+        int     cse_size_;
+        DiskCache* disk_cache_;   //derivatives kept between runs, NULL if not used
+        int     bin_out_;     //resfile gets tree_bin.h files instead of prefix text, samples as raw doubles
+        int     reassoc_;     //chains may be regrouped, so results can differ in the last bits
+        int     let_min_;     //shared subtrees of this size are printed once as temporaries, 0 if off
+        LetItem* let_;        //open addressing table of the printed nodes, by address
+        int     let_cap_;
+        int     let_size_;
+        Node**  let_order_;   //bound subtrees by temporary number, children before parents
+        int     n_lets_;
+        Node*   let_open_;    //temporary being written, printed in full instead of by name
+        char    let_name_[16];
+        Node**  consts_;      //open addressing table of the literals met by the parser
+        int     consts_cap_;
+        int     consts_size_;
+        FILE*   file_to_write_;
+		FILE*	tx_f;
+        Renderer renderer_;   //runs xdot, dot, pdflatex and evince on the written files
+        int     n_dots_;      //.gv files written, they are numbered unless rendering is sync
+        char*   expr_;
+        int     expr_offset_;
+        unsigned int expr_len_;
+};
+
+const MathFunc math_funcs[FUNC_CNT] =
+{
+#define _FUNCTIONS_
+#define MATH_FUNC(funcName, cppFuncName, texName)                           \
+    {#funcName, texName, cppFuncName, batch_##funcName, taylor_func_##funcName, interval_func_##funcName,   \
+     &Differentator::_##funcName##Der},
+#include "MATH_FUNCTIONS"
+#undef MATH_FUNC
+#undef _FUNCTIONS_
+};
+
+Differentator::Differentator(FILE* file_to_read, FILE* res_file, const char* tex_file):
+    root_           (NULL),
+    new_root_       (NULL),
+    roots_          (NULL),
+    n_roots_        (0),
+    vars_           (NULL),
+    n_vars_         (0),
+    vars_cap_       (0),
+    var_slots_      (NULL),
+    var_slots_cap_  (0),
+    alter_cnt_      (0),
+    dcache_         (NULL),
+    dcache_cap_     (0),
+    dcache_size_    (0),
+    cse_            (NULL),
+    cse_cap_        (0),
+    cse_size_       (0),
+    disk_cache_     (NULL),
+    bin_out_        (0),
+    reassoc_        (0),
+    let_min_        (0),
+    let_            (NULL),
+    let_cap_        (0),
+    let_size_       (0),
+    let_order_      (NULL),
+    n_lets_         (0),
+    let_open_       (NULL),
+    let_name_       (),
+    consts_         (NULL),
+    consts_cap_     (0),
+    consts_size_    (0),
+    file_to_write_  (res_file),
+	tx_f			(NULL),
+    renderer_       (),
+    n_dots_         (0),
+    expr_           (0),
+    expr_offset_    (0),
+    expr_len_       (0)
+    {
+		(tex_file)?tx_f = fopen(tex_file, "w"):tx_f = fopen("MathShit.txt", "w");
+	    if (!tx_f)
+	    {
+	        printf("Differentator: error: cannot open/create .tex file\n");
+	        exit(EXIT_FAILURE);
+	    }
+        unsigned int file_size = 0;
+        fseek(file_to_read, 0, SEEK_END);
+        file_size = (unsigned int) ftell(file_to_read);
+        rewind(file_to_read);
+        //packed trees (tree_bin.h) are not limited, they are decoded in one pass
+        char magic[8] = {};
+        int  packed   = fread(magic, sizeof(char), 8, file_to_read) == 8 && !memcmp(magic, TREE_BIN_MAGIC, 8);
+        rewind(file_to_read);
+        assert(MAX_TREE_FILE_LEN >= 1024);
+        if (!packed && file_size > MAX_TREE_FILE_LEN)
+        {
+            printf("Your expression is too big\nI think you're tryina get my prog down, aren't ya?\n");
+            exit(1);
+        }
+        expr_ = (char*) calloc (file_size + 1, sizeof(char));
+        printf("fileSize is %u\n", file_size);
+        if (!expr_)
+        {
+            printf("Cannot find memory to read file\n");
+            exit(0);
+        }
+        //the whole file is read: every line is an expression of its own
+        if (fread(expr_, sizeof(char), file_size, file_to_read) != file_size)
+		{
+			printf("Differentator: Error reading expression file: %s\n", strerror(errno));
+			exit(EXIT_FAILURE);
+		}
+        expr_len_ = file_size;
+    }
+
+Differentator::~Differentator()
+{
+    //printf("in diff ditor\n");
+    delete_subTree(&root_);
+    delete_subTree(&new_root_);
+    for (int i = 0; i < n_roots_; i++)
+        delete_subTree(&roots_[i]);
+    free(roots_);
+    for (int i = 0; i < n_vars_; i++)
+        free(vars_[i]);
+    free(vars_);
+    free(var_slots_);
+    var_slots_    = NULL;
+    for (int i = 0; i < dcache_cap_; i++)
+    {
+        delete_subTree(&dcache_[i].tree_);
+        delete_subTree(&dcache_[i].deriv_);
+    }
+    free(dcache_);
+    dcache_       = NULL;
+    for (int i = 0; i < cse_cap_; i++)
+        delete_subTree(&cse_[i]);
+    free(cse_);
+    cse_          = NULL;
+    _letFree();
+    for (int i = 0; i < consts_cap_; i++)
+        delete_subTree(&consts_[i]);
+    free(consts_);
+    consts_       = NULL;
+    delete disk_cache_;
+    disk_cache_   = NULL;
+    roots_        = NULL;
+    vars_         = NULL;
+    file_to_write_= NULL;
+    free(expr_);
+    expr_         = NULL;
+    expr_offset_  = 0;
+}
+
+void Differentator::delete_subTree(Node** head)
+{
+    if (*head)
+    {
+        if (--(*head)->refs_ == 0)
+        {
+            delete_subTree(&(*head)->left_dec_);
+            delete_subTree(&(*head)->right_dec_);
+            for (int i = 0; i < (*head)->n_kids_; i++)
+                delete_subTree(&(*head)->kids_[i]);
+            delete *head;
+        }
+        *head = NULL;
+    }
+}
+
+void Differentator::_bridge(Node** curNodePtr, Node* node_to_bridge)
+{
+    //node_to_bridge is usually a child of *curNodePtr, so grab it before letting go
+    node_to_bridge->Share();
+    delete_subTree(curNodePtr);
+    *curNodePtr = node_to_bridge;
+    alter_cnt_++;
+}
+
+/*void Differentator::visitor(Node* node_ptr)
+{
+        node_ptr->printNode();
+    if (node_ptr->left_dec_)
+        visitor(node_ptr->left_dec_);
+    if (node_ptr->right_dec_)
+        visitor(node_ptr->right_dec_);
+}*/
+
+void Differentator::buildTree()
+{
+    //root_ = _buildTree(root_);
+	if (blob_get_header((const unsigned char*) expr_, expr_len_))
+	{
+		buildTrees();
+		return;
+	}
+	root_ = GetExprNode();
+	if (!root_)
+	{
+		printf("Something's wrong with your math: cannot parse near %i char\n", expr_offset_ + 1);
+		exit(0);
+	}
+	printTree(root_);
+}
+
+void Differentator::buildTrees()
+{
+	const unsigned char* body = blob_get_header((const unsigned char*) expr_, expr_len_);
+	if (body)
+	{
+		roots_ = (Node**) calloc (1, sizeof(Node*));
+		if (!roots_)
+		{
+			printf("buildTrees: error finding memory for expression list\n");
+			exit(2);
+		}
+		roots_[n_roots_++] = _unpackTree(body, expr_len_ - TREE_BIN_HEADER_LEN);
+		root_ = roots_[0]->Share();
+		return;
+	}
+	while (expr_[expr_offset_] != '\0')
+	{
+		if (expr_[expr_offset_] == '\n' || expr_[expr_offset_] == '\r' || expr_[expr_offset_] == ';' ||
+			expr_[expr_offset_] == ' '  || expr_[expr_offset_] == '\t')
+		{
+			expr_offset_++;
+			continue;
+		}
+		Node* head = GetExprNode();
+		if (!head)
+		{
+			printf("Something's wrong with your math: cannot parse expression %i near %i char\n",
+					n_roots_ + 1, expr_offset_ + 1);
+			exit(0);
+		}
+		roots_ = (Node**) realloc (roots_, (size_t) (n_roots_ + 1) * sizeof(Node*));
+		if (!roots_)
+		{
+			printf("buildTrees: error finding memory for expression list\n");
+			exit(2);
+		}
+		roots_[n_roots_++] = head;
+	}
+	if (!n_roots_)
+	{
+		printf("buildTrees: expression file is empty\n");
+		exit(0);
+	}
+	root_ = roots_[0]->Share();
+}
+
+static unsigned long long hash_mix(unsigned long long key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return key;
+}
+
+static unsigned long long mem_hash(const char* str, size_t len)
+{
+    unsigned long long key = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++)
+        key = (key ^ (unsigned char) str[i]) * 0x100000001b3ULL;
+    return key;
+}
+
+static unsigned long long str_hash(const char* str)
+{
+    return mem_hash(str, (str)?strlen(str):0);
+}
+
+//slot of var_slots_ that holds the name or the empty one where it goes
+int Differentator::_varSlot(const char* name, size_t len)
+{
+	int mask = var_slots_cap_ - 1;
+	int slot = (int) (mem_hash(name, len) & (unsigned long long) mask);
+	for (; var_slots_[slot] >= 0; slot = (slot + 1) & mask)
+	{
+		const char* var = vars_[var_slots_[slot]];
+		if (!strncmp(var, name, len) && var[len] == '\0')
+			break;
+	}
+	return slot;
+}
+
+//names are interned when they are read, nodes keep only the dense id
+int Differentator::_internVar(const char* name, size_t len)
+{
+	if (2 * (n_vars_ + 1) > var_slots_cap_)
+	{
+		free(var_slots_);
+		var_slots_cap_ = (var_slots_cap_)?var_slots_cap_ * 2:64;
+		var_slots_     = (int*) calloc ((size_t) var_slots_cap_, sizeof(int));
+		if (!var_slots_)
+		{
+			printf("_internVar: error finding memory for %i names\n", var_slots_cap_);
+			exit(2);
+		}
+		for (int i = 0; i < var_slots_cap_; i++)
+			var_slots_[i] = -1;
+		for (int i = 0; i < n_vars_; i++)
+			var_slots_[_varSlot(vars_[i], strlen(vars_[i]))] = i;
+	}
+	int slot = _varSlot(name, len);
+	if (var_slots_[slot] >= 0)
+		return var_slots_[slot];
+
+	if (n_vars_ == vars_cap_)
+	{
+		vars_cap_ = (vars_cap_)?vars_cap_ * 2:16;
+		vars_     = (char**) realloc (vars_, (size_t) vars_cap_ * sizeof(char*));
+	}
+	if (!vars_ || !(vars_[n_vars_] = strndup(name, len)))
+	{
+		printf("_internVar: error finding memory for var table\n");
+		exit(2);
+	}
+	var_slots_[slot] = n_vars_;
+	return n_vars_++;
+}
+
+int Differentator::varId(const char* var_name)
+{
+	if (!var_slots_cap_)
+		return -1;
+	return var_slots_[_varSlot(var_name, strlen(var_name))];
+}
+
+/* BUILDING TREE OUT OF INF EXPRESSION */
+
+
+Node* Differentator::GetExprNode()
+{
+	 Node* head = GetSumSubNode();
+
+	if (expr_[expr_offset_] == '\0' || expr_[expr_offset_] == '\n' ||
+		expr_[expr_offset_] == '\r' || expr_[expr_offset_] == ';')
+		return head;
+	delete_subTree(&head);
+	return NULL;
+}
+
+Node* Differentator::GetSumSubNode()
+{               
+	Node* SumSubNode = GetMulDivNode();
+	while (SumSubNode && (expr_[expr_offset_] == '-' || expr_[expr_offset_] == '+'))
+	{
+		char  act = expr_[expr_offset_++];
+		Node* r   = GetMulDivNode();
+		if (!r)
+			delete_subTree(&SumSubNode);
+		else
+			SumSubNode = _joinNode(act, SumSubNode, r);
+	}	
+	return SumSubNode;
+}
+
+Node* Differentator::GetMulDivNode()
+{
+	Node* MulDivNode = GetPowNode();
+	while (MulDivNode && (expr_[expr_offset_] == '*' || expr_[expr_offset_] == '/'))
+	{
+		char  act = expr_[expr_offset_++];
+		Node* r   = GetPowNode();
+		if (!r)
+			delete_subTree(&MulDivNode);
+		else
+			MulDivNode = _joinNode(act, MulDivNode, r);
+	}
+	return MulDivNode;
+}
+
+//left actChar right; a chain of '+' or '*' grows one n-ary node instead of getting deeper
+Node* Differentator::_joinNode(char actChar, Node* left_node, Node* right_node)
+{
+    if ((actChar == '+' || actChar == '*') && left_node->data_[0] == actChar && left_node->refs_ == 1)
+    {
+        if (left_node->kids_)
+        {
+            left_node->kids_ = (Node**) realloc (left_node->kids_, (size_t) (left_node->n_kids_ + 2) * sizeof(Node*));
+            if (!left_node->kids_)
+            {
+                printf("_joinNode: error finding memory for %i operands\n", left_node->n_kids_ + 1);
+                exit(2);
+            }
+            left_node->kids_[left_node->n_kids_++] = right_node;
+            return left_node;
+        }
+        if (left_node->type_ == TYPE_ACT)
+        {
+            Node* res = new Node(actChar, 3);
+            res->kids_[0] = left_node->left_dec_;
+            res->kids_[1] = left_node->right_dec_;
+            res->kids_[2] = right_node;
+            left_node->left_dec_  = NULL;
+            left_node->right_dec_ = NULL;
+            delete_subTree(&left_node);
+            return res;
+        }
+    }
+    Node* res = new Node(actChar);
+    res->left_dec_  = left_node;
+    res->right_dec_ = right_node;
+    return res;
+}
+
+Node* Differentator::GetPowNode()
+{
+	Node* l = GetBracesNode();
+	if (l && expr_[expr_offset_] == '^')
+	{
+		//right associative: x^2^3 is x^(2^3)
+		Node* PowNode = new Node("^");
+		expr_offset_++;
+		PowNode->left_dec_  = l;
+		PowNode->right_dec_ = GetPowNode();
+		if (!PowNode->right_dec_)
+			delete_subTree(&PowNode);
+		return PowNode;
+	}
+	return l;
+}
+
+Node* Differentator::GetBracesNode()
+{
+	SkipSpaces();
+	if (expr_[expr_offset_] == '(')
+	{
+		expr_offset_++;
+		Node* BracesNode = GetSumSubNode();
+		if (expr_[expr_offset_] == ')')
+		{
+			expr_offset_++;
+			SkipSpaces();
+			return BracesNode;
+		}
+		else
+		{
+			printf("Something's wrong with your math: closing brace not found\n");
+			exit(0);
+		}
+	}
+	else	return GetNumberNode();
+}
+
+Node* Differentator::GetNumberNode()
+{
+	double val = 0;
+	if ( isalpha(expr_[expr_offset_]) )
+		return GetNameNode();
+	const char* num_end = num_parse(expr_ + expr_offset_, expr_ + expr_len_, &val);
+	if (!num_end) return NULL;//there must be at least one digit
+	expr_offset_ = (int) (num_end - expr_);
+	SkipSpaces();
+	return _internConst(val);
+}
+
+//a letter, then letters, digits and '_'; a function name takes a braced argument
+Node* Differentator::GetNameNode()
+{
+	int start = expr_offset_;
+	while (isalnum(expr_[expr_offset_]) || expr_[expr_offset_] == '_')
+		expr_offset_++;
+	size_t len = (size_t) (expr_offset_ - start);
+	if (len >= MAX_NODE_STR_LEN)
+	{
+		printf("Something's wrong with your math: name near %i char is longer than %i chars\n",
+				start + 1, MAX_NODE_STR_LEN - 1);
+		exit(0);
+	}
+	char name[MAX_NODE_STR_LEN] = {};
+	memcpy(name, expr_ + start, len);
+	SkipSpaces();
+
+	Node* LeafNode = new Node(name);
+	if (LeafNode->type_ == TYPE_FUNC)
+	{
+		if (expr_[expr_offset_] != '(')
+		{
+			printf("Something's wrong with your math: function '%s' needs a braced argument near %i char\n",
+					name, expr_offset_ + 1);
+			exit(0);
+		}
+		LeafNode->left_dec_ = GetBracesNode();
+		if (!LeafNode->left_dec_)
+			delete_subTree(&LeafNode);
+		return LeafNode;
+	}
+	LeafNode->var_id_ = _internVar(name, len);
+	return LeafNode;
+}
+
+void Differentator::SkipSpaces()
+{
+	while (expr_[expr_offset_] == ' ' || expr_[expr_offset_] == '\t')
+		expr_offset_++;
+}
+
+Node* Differentator::_buildTree(Node* curNodePtr)
+{
+    int stopCharPtr = 0;
+    expr_offset_++;    // move tree ptr to a char that's next to '('
+    assert (MAX_NODE_STR_LEN >= 128);
+    char* curData = (char*) calloc (MAX_NODE_STR_LEN, sizeof(char));
+    if (!curData)
+    {
+        printf("error finding memory for putting another node data\n");
+        exit(2);
+    }
+    if (sscanf(expr_ + expr_offset_, "%127[^()_]%n", curData, &stopCharPtr))
+        switch (expr_[expr_offset_ + stopCharPtr])
+        {
+            case '(':
+                expr_offset_ += stopCharPtr;
+                curNodePtr = new Node(curData);
+                
+                curNodePtr->left_dec_   = _buildTree(curNodePtr->left_dec_);
+
+                curNodePtr->right_dec_  = _buildTree(curNodePtr->right_dec_);
+                expr_offset_++; //skipping closing brace
+                break;
+            case ')': //curnodeptr = null + ret cyrnodtr        
+                expr_offset_ += stopCharPtr + 1;
+                curNodePtr = new Node(curData);
+                break;
+            case '_':
+                expr_offset_++;
+                curNodePtr = NULL;
+                break;
+            default:
+                printf("got unknown ruling char '%c' near %i char; worked at %i line\n", expr_[expr_offset_], expr_offset_ + 1, __LINE__);
+                exit(0);
+                break;
+        }
+    else
+        printf("error reading expression\n");
+    free(curData);
+    return curNodePtr;
+}
+
+void Differentator::inFilePrint()
+{
+    _inFilePrint(root_);
+}
+
+void Differentator::_inFilePrint(Node* curNodePtr)
+{
+    int let_id = _letRef(curNodePtr);
+    if (let_id)
+    {
+        fprintf(file_to_write_, "(%s%i)", let_name_, let_id);
+        return;
+    }
+    fprintf(file_to_write_, "(%s", curNodePtr->data_);
+    if(curNodePtr->left_dec_)
+        _inFilePrint(curNodePtr->left_dec_);
+    if(curNodePtr->right_dec_)
+        _inFilePrint(curNodePtr->right_dec_);
+    for (int i = 0; i < curNodePtr->n_kids_; i++)
+        _inFilePrint(curNodePtr->kids_[i]);
+    fprintf(file_to_write_,")");
+}
+
+void Differentator::inFilePrint_dot(Node* head)
+{
+    if (head)
+    {
+        //a queued job may not have read its file yet, so only sync rendering writes over one
+        char gv_name[MAX_NODE_STR_LEN]  = "expr_tree.gv";
+        char png_name[MAX_NODE_STR_LEN] = "tree.png";
+        n_dots_++;
+        if (renderer_.mode_ != RENDER_SYNC)
+        {
+            snprintf(gv_name,  sizeof(gv_name),  "expr_tree_%i.gv", n_dots_);
+            snprintf(png_name, sizeof(png_name), "tree_%i.png",     n_dots_);
+        }
+        FILE* gv_f = fopen(gv_name, "w");//
+        if (!gv_f)
+        {
+            printf("inFilePrint_dot: cannot open '%s'\n", gv_name);
+            return;
+        }
+        fprintf(gv_f, "digraph G{\n");
+       _inFilePrint_dot(head, gv_f);
+        fprintf(gv_f, "\n}");
+        fclose(gv_f);
+
+        RenderJob job = {};
+        char line[3 * MAX_NODE_STR_LEN] = {};
+        snprintf(line, sizeof(line), "xdot %s", gv_name);
+        render_cmd(&job, 1, line);
+        snprintf(line, sizeof(line), "dot -Tpng %s -o %s", gv_name, png_name);
+        render_cmd(&job, 0, line);
+        renderer_.submit(&job);
+    }
+}
+
+void Differentator::_inFilePrint_dot(Node* curNodePtr, FILE* gv_f)
+{
+    fprintf(gv_f, "_node_%p [label=\"data_ '%s'[%p]\\l"
+                            "left_dec_ptr  = %p\\l"
+                            "right_dec_ptr = %p\\l"
+                            "ancestor_ptr  = %p\\l"
+                            "node_type is  = %i\\l"
+                            "node priority = %i\\l"
+                            "its ptr         %p\"]\n", curNodePtr, 
+                                                       curNodePtr->data_, 
+                                                       curNodePtr->data_, 
+                                                       curNodePtr->left_dec_,
+                                                       curNodePtr->right_dec_,
+                                                       curNodePtr->ancestor_,
+                                                       curNodePtr->type_,
+                                                       curNodePtr->priority_,
+                                                       curNodePtr);
+    if (curNodePtr->left_dec_)
+    {
+        fprintf(gv_f, "_node_%p -> _node_%p\n", curNodePtr, curNodePtr->left_dec_);
+        _inFilePrint_dot(curNodePtr->left_dec_,  gv_f);
+    }
+    if (curNodePtr->right_dec_)
+    {
+        fprintf(gv_f, "_node_%p -> _node_%p\n\n", curNodePtr, curNodePtr->right_dec_);
+        _inFilePrint_dot(curNodePtr->right_dec_, gv_f);
+    }    
+    for (int i = 0; i < curNodePtr->n_kids_; i++)
+    {
+        fprintf(gv_f, "_node_%p -> _node_%p\n", curNodePtr, curNodePtr->kids_[i]);
+        _inFilePrint_dot(curNodePtr->kids_[i], gv_f);
+    }
+}
+
+void Differentator::inFilePrint_tex(Node* head1, Node* head2)
+{
+    fprintf(tx_f,   "\\documentclass{article}\n"
+                    "\\usepackage{amsmath}\n"
+                    "\\title{\\LaTeX\\ Derivation}\n"
+                    "\\author{Arbuce Lee}\n"
+                    "\\begin{document}\n"
+                    "\n\\maketitle\n\n"
+                    "\\fontsize{10}{10pt}\\selectfont\n");
+    if (n_lets_)
+    {
+        //temporaries and the result are lines of one aligned block
+        fprintf(tx_f, "\\begin{equation*}\n\\begin{aligned}\n");
+        for (int k = 1; k <= n_lets_; k++)
+        {
+            let_open_ = let_order_[k];
+            fprintf(tx_f, "%s_{%i} &= ", let_name_, k);
+            _inFilePrint_tex(let_order_[k]);
+            fprintf(tx_f, "\\\\\n");
+        }
+        let_open_ = NULL;
+        //the source shares nodes with its derivative, but reads better in full
+        int n_lets = n_lets_;
+        n_lets_ = 0;
+        fprintf(tx_f, "\\left[");
+        _inFilePrint_tex(head1);
+        fprintf(tx_f, "\\right]' &= ");
+        n_lets_ = n_lets;
+        _inFilePrint_tex(head2);
+        fprintf(tx_f, "\n\\end{aligned}\n\\end{equation*}\n\n\\end{document}");
+        _texCompile();
+        return;
+    }
+    fprintf(tx_f, "\\begin{equation}\n");
+
+    fprintf(tx_f, "\\left[");
+    _inFilePrint_tex(head1);
+    fprintf(tx_f, "\\right]'=");
+
+    _inFilePrint_tex(head2);
+    fprintf(tx_f, "\n\\end{equation}\n\n\\end{document}");
+
+    _texCompile();
+}
+
+void Differentator::inFilePrint_jacobian(Node** jac)
+{
+    _letBuild(jac, n_roots_ * n_vars_);
+    _letWrite();
+    for (int i = 0; i < n_roots_; i++)
+        for (int j = 0; j < n_vars_; j++)
+        {
+            fprintf(file_to_write_, "d%i/d%s ", i + 1, vars_[j]);
+            _inFilePrint(jac[i * n_vars_ + j]);
+            fprintf(file_to_write_, "\n");
+        }
+
+    fprintf(tx_f,   "\\documentclass{article}\n"
+                    "\\usepackage{amsmath}\n"
+                    "\\setcounter{MaxMatrixCols}{%i}\n"
+                    "\\title{\\LaTeX\\ Derivation}\n"
+                    "\\author{Arbuce Lee}\n"
+                    "\\begin{document}\n"
+                    "\n\\maketitle\n\n"
+                    "\\fontsize{10}{10pt}\\selectfont\n", n_vars_ + 1);
+    _letWrite_tex();
+    fprintf(tx_f, "\\begin{equation*}\n");
+
+    fprintf(tx_f, "\\frac{\\partial\\left(");
+    for (int i = 0; i < n_roots_; i++)
+        fprintf(tx_f, (i)?", f_{%i}":"f_{%i}", i + 1);
+    fprintf(tx_f, "\\right)}{\\partial\\left(");
+    for (int j = 0; j < n_vars_; j++)
+        fprintf(tx_f, (j)?", %s":"%s", vars_[j]);
+    fprintf(tx_f, "\\right)}=\\begin{pmatrix}\n");
+
+    for (int i = 0; i < n_roots_; i++)
+    {
+        for (int j = 0; j < n_vars_; j++)
+        {
+            if (j) fprintf(tx_f, " & ");
+            _inFilePrint_tex(jac[i * n_vars_ + j]);
+        }
+        fprintf(tx_f, "\\\\\n");
+    }
+    fprintf(tx_f, "\\end{pmatrix}\n\\end{equation*}\n\n\\end{document}");
+
+    _texCompile();
+    _letFree();
+}
+
+void Differentator::_texCompile()
+{
+    fclose(tx_f);
+    tx_f = NULL;
+    RenderJob job = {};
+    render_cmd(&job, 0, "pdflatex MathShit.tex");
+    render_cmd(&job, 1, "evince MathShit.pdf");
+    renderer_.submit(&job);
+}
+
+//sums, differences and n-ary nodes need parentheses as the right operand of
+//'-' or '/': --reassoc turns a-b-c-d into a-(b+c+d)
+static int tex_grouped(Node* node)
+{
+    if (node->type_ == TYPE_SUM || node->type_ == TYPE_PROD)
+        return 1;
+    return node->type_ == TYPE_ACT && (node->data_[0] == '+' || node->data_[0] == '-');
+}
+
+void Differentator::_inFilePrint_tex(Node* curNodePtr)
+{
+	if (!curNodePtr) goto skip;
+    if (_letRef(curNodePtr))
+    {
+        fprintf(tx_f, "%s_{%i}", let_name_, _letRef(curNodePtr));
+        return;
+    }
+    switch(curNodePtr->type_)
+    {
+        case TYPE_DEF:
+            printf("_inFilePrint_tex: node %p type is not set\n", curNodePtr);
+			curNodePtr->printNode();
+            exit(4);
+        case TYPE_CONST:
+        {
+            //"1.5e-07" is typeset as 1.5 \cdot 10^{-7}
+            const char* exp = strchr(curNodePtr->data_, 'e');
+            if (exp)
+                fprintf(tx_f, "%.*s \\cdot 10^{%d}", (int) (exp - curNodePtr->data_), curNodePtr->data_, atoi(exp + 1));
+            else
+                fprintf(tx_f, "%s", curNodePtr->data_);
+            break;
+        }
+        case TYPE_VAR:
+            fprintf(tx_f, "%s", curNodePtr->data_);
+            break;
+        case TYPE_FUNC:
+            fprintf(tx_f, "%s{\\left({", math_funcs[curNodePtr->func_id_].tex_);
+            _inFilePrint_tex(curNodePtr->left_dec_);
+            fprintf(tx_f, "}\\right)}");
+            break;
+        case TYPE_SUM:
+            for (int i = 0; i < curNodePtr->n_kids_; i++)
+            {
+                fprintf(tx_f, (i)?"+{":"{");
+                _inFilePrint_tex(curNodePtr->kids_[i]);
+                fprintf(tx_f, "}");
+            }
+            break;
+        case TYPE_PROD:
+            for (int i = 0; i < curNodePtr->n_kids_; i++)
+            {
+                Node* kid   = curNodePtr->kids_[i];
+                int   brace = kid->isAct() && curNodePtr->priority_ > kid->priority_;
+                if (i) fprintf(tx_f, "*");
+                fprintf(tx_f, (brace)?"\\left({":"{");
+                _inFilePrint_tex(kid);
+                fprintf(tx_f, (brace)?"}\\right)":"}");
+            }
+            break;
+        case TYPE_ACT:
+            switch(curNodePtr->data_[0])
+            {
+                case '+':
+                    fprintf(tx_f, "{");
+                    _inFilePrint_tex(curNodePtr->left_dec_);
+                    fprintf(tx_f, "}+{");
+                    _inFilePrint_tex(curNodePtr->right_dec_);
+                    fprintf(tx_f, "}");
+                    break;
+                case '-':
+                    fprintf(tx_f, "{");
+                    _inFilePrint_tex(curNodePtr->left_dec_);
+                    fprintf(tx_f, (tex_grouped(curNodePtr->right_dec_))?"}-\\left({":"}-{");
+                    _inFilePrint_tex(curNodePtr->right_dec_);
+                    fprintf(tx_f, (tex_grouped(curNodePtr->right_dec_))?"}\\right)":"}");
+                    break;
+                case '*':
+                    if (curNodePtr->priority_ > curNodePtr->left_dec_->priority_)
+                    {
+                        (curNodePtr->left_dec_->isAct())?fprintf(tx_f, "\\left({"):fprintf(tx_f, "{");
+                        _inFilePrint_tex(curNodePtr->left_dec_);
+                        (curNodePtr->left_dec_->isAct())?fprintf(tx_f, "}\\right)*"):fprintf(tx_f, "}");
+                    }
+                    else
+                    {
+                        fprintf(tx_f, "{");
+                        _inFilePrint_tex(curNodePtr->left_dec_);
+                        fprintf(tx_f, "}");
+                    }
+                    if (curNodePtr->priority_ > curNodePtr->right_dec_->priority_)
+                    {
+                        (curNodePtr->right_dec_->isAct())?fprintf(tx_f, "*\\left({"):fprintf(tx_f, "*{");
+                        _inFilePrint_tex(curNodePtr->right_dec_);
+                        (curNodePtr->right_dec_->isAct())?fprintf(tx_f, "}\\right)"):fprintf(tx_f, "}");
+                    }
+                    else
+                    {
+                        fprintf(tx_f, "*{");
+                        _inFilePrint_tex(curNodePtr->right_dec_);
+                        fprintf(tx_f, "}");
+                    }
+                    break;
+                case '/':
+                    fprintf(tx_f, "\\frac{");
+                    _inFilePrint_tex(curNodePtr->left_dec_);
+                    fprintf(tx_f, (tex_grouped(curNodePtr->right_dec_))?"}{\\left({":"}{");
+                    _inFilePrint_tex(curNodePtr->right_dec_);
+                    fprintf(tx_f, (tex_grouped(curNodePtr->right_dec_))?"}\\right)}":"}");
+                    break;
+                case '^':
+                    fprintf(tx_f, "{\\left({");
+                    _inFilePrint_tex(curNodePtr->left_dec_);
+                    (curNodePtr->right_dec_->type_ != TYPE_CONST)?fprintf(tx_f, "}\\right)}^{\\left({"):fprintf(tx_f, "}\\right)}^{");
+                    _inFilePrint_tex(curNodePtr->right_dec_);
+                    (curNodePtr->right_dec_->type_ != TYPE_CONST)?fprintf(tx_f, "}\\right)}"):fprintf(tx_f, "}");
+                    break;
+                default:
+                    printf("Unknown arythmetic action!\n");
+                    exit(2);
+            }
+            break;
+        default:
+            printf("_inFilePrint_tex: got unknown node type %p\n", curNodePtr);
+            exit(4);
+    }
+	skip: ;
+}
+
+void Differentator::printTree(Node* root)
+{
+    printf("\n");
+    _printTree(root);
+    printf("\n");
+}
+
+void Differentator::_printTree(Node* curNodePtr)
+{
+    printf("(");
+    if (curNodePtr)
+    {
+        if (curNodePtr->data_)
+            printf("%s", curNodePtr->data_);
+
+        if (curNodePtr->left_dec_)
+            _printTree(curNodePtr->left_dec_);
+
+        if (curNodePtr->right_dec_)
+            _printTree(curNodePtr->right_dec_);
+
+        for (int i = 0; i < curNodePtr->n_kids_; i++)
+            _printTree(curNodePtr->kids_[i]);
+    }
+    printf(")");
+}
+
+char* Differentator::sprintTree(Node *curNodePtr, char* dest)
+{
+    if (!dest)
+    {
+        printf("sprintTree: Got invalid str ptr\n");
+        return NULL;
+    }
+    strcpy(dest, "");
+    _sprintTree(curNodePtr, dest);
+    return dest;
+}
+
+void Differentator::_sprintTree(Node* curNodePtr, char* tree_str)
+{
+    strcat(tree_str, "(");
+    if (curNodePtr)
+    {
+        if (curNodePtr->data_)
+            strcat(tree_str, curNodePtr->data_);
+
+        if (curNodePtr->left_dec_)
+            _sprintTree(curNodePtr->left_dec_, tree_str);
+
+        if (curNodePtr->right_dec_)
+            _sprintTree(curNodePtr->right_dec_, tree_str);
+
+        for (int i = 0; i < curNodePtr->n_kids_; i++)
+            _sprintTree(curNodePtr->kids_[i], tree_str);
+    }
+    strcat(tree_str, ")");
+}
+
+void Differentator::_funcCalc(Node* node)
+{
+    if (node->left_dec_->type_ == TYPE_CONST)
+    {
+        node->setConst(math_funcs[node->func_id_].eval_(node->left_dec_->value_));
+        delete_subTree(&node->left_dec_);
+        alter_cnt_++;
+    }
+}
+
+void Differentator::alterTree(Node** head)
+{
+    //every rewrite bumps alter_cnt_, so a pass that leaves it untouched means the tree is done
+    do
+    {
+        alter_cnt_ = 0;
+        if (reassoc_)
+            _balanceTree(head);
+
+        _flatTree(head);
+
+        _countTree(*head);
+
+        _zeroMul(*head);
+
+        _zeroDiv(*head);
+
+        _zeroSum(head);
+
+        _zeroSub(head);
+
+        _zeroPow(*head);
+
+        _unitMul(head);
+
+        _unitDiv(head);
+
+        //operands are put in order once the rest is done, so their hashes stay valid
+        if (!alter_cnt_)
+            _canonTree(head);
+
+        if (alter_cnt_)
+            _dropHashes(*head);
+    }
+    while (alter_cnt_);
+}
+
+//hashes of the unfrozen nodes, their subtrees may have been rewritten
+void Differentator::_dropHashes(Node* curNodePtr)
+{
+    if (!curNodePtr || curNodePtr->frozen_)
+        return;
+    curNodePtr->hash_ = 0;
+    _dropHashes(curNodePtr->left_dec_);
+    _dropHashes(curNodePtr->right_dec_);
+    for (int i = 0; i < curNodePtr->n_kids_; i++)
+        _dropHashes(curNodePtr->kids_[i]);
+}
+
+void Differentator::_countTree(Node* curNodePtr)
+{
+	if (curNodePtr && !curNodePtr->frozen_)
+	{
+	    if(curNodePtr->left_dec_)
+	        _countTree(curNodePtr->left_dec_);
+	
+	    if(curNodePtr->right_dec_)
+	        _countTree(curNodePtr->right_dec_);
+
+	    for (int i = 0; i < curNodePtr->n_kids_; i++)
+	        _countTree(curNodePtr->kids_[i]);
+	
+	    if (curNodePtr->left_dec_ && curNodePtr->right_dec_ 
+	                              && curNodePtr->type_              == TYPE_ACT 
+	                              && curNodePtr->left_dec_->type_   == TYPE_CONST 
+	                              && curNodePtr->right_dec_->type_  == TYPE_CONST)
+	    {
+	        curNodePtr->act();
+	        delete_subTree(&curNodePtr->left_dec_);
+	        delete_subTree(&curNodePtr->right_dec_);
+	        alter_cnt_++;
+	    }
+	    if (curNodePtr->type_ == TYPE_FUNC)
+	        _funcCalc(curNodePtr);
+	}
+}
+
+//consts keep their exact values, so 1e-9 is not taken for zero any more
+int Differentator::_d_equal(double a, double b)
+{
+    return exact_equal(a, b);
+}
+
+//Operands of a '+' or '*' that are the same action are taken into it, so
+//chains become one n-ary node; 0 terms and 1 factors are dropped and a 0
+//factor zeroes the product. A node left with two operands is binary again.
+//The node is replaced rather than changed, it may be shared with other trees.
+void Differentator::_flatTree(Node** curNodePtr)
+{
+    Node* node = *curNodePtr;
+    if (!node || node->frozen_)
+        return;
+    _flatTree(&node->left_dec_);
+    _flatTree(&node->right_dec_);
+    for (int i = 0; i < node->n_kids_; i++)
+        _flatTree(&node->kids_[i]);
+
+    char act = node->data_[0];
+    if (!node->isAct() || (act != '+' && act != '*'))
+        return;
+    Node*  pair[2] = {node->left_dec_, node->right_dec_};
+    Node** ops     = (node->kids_)?node->kids_:pair;
+    int    n_ops   = (node->kids_)?node->n_kids_:2;
+    double neutral = (act == '+')?0.0:1.0;
+
+    int n_res = 0, changed = (node->kids_ && n_ops < 3);
+    for (int i = 0; i < n_ops; i++)
+    {
+        Node* op = ops[i];
+        if (op->type_ == TYPE_CONST && act == '*' && _d_equal(op->value_, 0.0))
+        {
+            delete_subTree(curNodePtr);
+            *curNodePtr = new Node(0.0);
+            alter_cnt_++;
+            return;
+        }
+        if (op->type_ == TYPE_CONST && _d_equal(op->value_, neutral))
+            changed = 1;
+        else if (op->isAct() && op->data_[0] == act)
+        {
+            n_res  += (op->kids_)?op->n_kids_:2;
+            changed = 1;
+        }
+        else
+            n_res++;
+    }
+    if (!changed)
+        return;
+
+    Node** flat = (Node**) calloc ((size_t) n_res + 1, sizeof(Node*));
+    if (!flat)
+    {
+        printf("_flatTree: error finding memory for %i operands\n", n_res);
+        exit(2);
+    }
+    int k = 0;
+    for (int i = 0; i < n_ops; i++)
+    {
+        Node* op = ops[i];
+        if (op->type_ == TYPE_CONST && _d_equal(op->value_, neutral))
+            continue;
+        if (op->isAct() && op->data_[0] == act && op->kids_)
+            for (int j = 0; j < op->n_kids_; j++)
+                flat[k++] = op->kids_[j]->Share();
+        else if (op->isAct() && op->data_[0] == act)
+        {
+            flat[k++] = op->left_dec_->Share();
+            flat[k++] = op->right_dec_->Share();
+        }
+        else
+            flat[k++] = op->Share();
+    }
+    Node* res = _opsNode(act, flat, n_res);
+    free(flat);
+    delete_subTree(curNodePtr);
+    *curNodePtr = res;
+    alter_cnt_++;
+}
+
+//With useReassociation: a-b-c-d is a-(b+c+d) and a/b/c/d is a/(b*c*d), so
+//the subtrahends and divisors become one n-ary node instead of a deep chain.
+void Differentator::_balanceTree(Node** curNodePtr)
+{
+    Node* node = *curNodePtr;
+    if (!node || node->frozen_)
+        return;
+    _balanceTree(&node->left_dec_);
+    _balanceTree(&node->right_dec_);
+    for (int i = 0; i < node->n_kids_; i++)
+        _balanceTree(&node->kids_[i]);
+
+    char act = node->data_[0];
+    if (node->type_ != TYPE_ACT || (act != '-' && act != '/'))
+        return;
+    int   n_rest = 1;
+    Node* head   = node->left_dec_;
+    for (; head->type_ == TYPE_ACT && head->data_[0] == act; head = head->left_dec_)
+        n_rest++;
+    if (n_rest < 2)
+        return;
+
+    Node** rest = (Node**) calloc ((size_t) n_rest + 1, sizeof(Node*));
+    if (!rest)
+    {
+        printf("_balanceTree: error finding memory for %i operands\n", n_rest);
+        exit(2);
+    }
+    Node* link = node;
+    for (int i = n_rest - 1; i >= 0; i--, link = link->left_dec_)
+        rest[i] = link->right_dec_->Share();
+    Node* res = new Node(act);
+    res->left_dec_  = head->Share();
+    res->right_dec_ = _opsNode((act == '-')?'+':'*', rest, n_rest);
+    free(rest);
+    delete_subTree(curNodePtr);
+    *curNodePtr = res;
+    alter_cnt_++;
+}
+
+//Operands of '+' and '*' go in one order: consts first, then vars by id, then
+//the other subtrees by _treeHash, and all consts of a group are folded into one.
+//Equal sums and products are then equal operand by operand, however they were built.
+void Differentator::_canonTree(Node** curNodePtr)
+{
+    Node* node = *curNodePtr;
+    if (!node || node->frozen_)
+        return;
+    _canonTree(&node->left_dec_);
+    _canonTree(&node->right_dec_);
+    for (int i = 0; i < node->n_kids_; i++)
+        _canonTree(&node->kids_[i]);
+
+    char act = node->data_[0];
+    if (!node->isAct() || (act != '+' && act != '*'))
+        return;
+    Node*  pair[2] = {node->left_dec_, node->right_dec_};
+    Node** ops     = (node->kids_)?node->kids_:pair;
+    int    n_ops   = (node->kids_)?node->n_kids_:2;
+    double folded  = (act == '+')?0.0:1.0;
+
+    CanonItem* items = (CanonItem*) calloc ((size_t) n_ops, sizeof(CanonItem));
+    if (!items)
+    {
+        printf("_canonTree: error finding memory for %i operands\n", n_ops);
+        exit(2);
+    }
+    int n_consts = 0, sorted = 1;
+    for (int i = 0; i < n_ops; i++)
+    {
+        Node* op = ops[i];
+        items[i].node_ = op;
+        items[i].pos_  = i;
+        items[i].rank_ = (op->type_ == TYPE_CONST)?0:(op->type_ == TYPE_VAR)?1:2;
+        items[i].key_  = (op->type_ == TYPE_CONST)?0:(op->type_ == TYPE_VAR)?(unsigned long long) op->var_id_:_treeHash(op);
+        if (op->type_ == TYPE_CONST)
+        {
+            folded = (act == '+')?folded + op->value_:folded * op->value_;
+            n_consts++;
+        }
+        if (i && cmp_canon(&items[i - 1], &items[i]) > 0)
+            sorted = 0;
+    }
+    if (sorted && n_consts < 2)
+    {
+        free(items);
+        return;
+    }
+    qsort(items, (size_t) n_ops, sizeof(CanonItem), cmp_canon);
+
+    Node** res_ops = (Node**) calloc ((size_t) n_ops + 1, sizeof(Node*));
+    if (!res_ops)
+    {
+        printf("_canonTree: error finding memory for %i operands\n", n_ops);
+        exit(2);
+    }
+    int n_res = 0;
+    if (act == '*' && n_consts && _d_equal(folded, 0.0))
+        res_ops[n_res++] = new Node(0.0);
+    else
+    {
+        if (n_consts == 1)
+            res_ops[n_res++] = items[0].node_->Share();
+        else if (n_consts && !_d_equal(folded, (act == '+')?0.0:1.0))
+            res_ops[n_res++] = new Node(folded);
+        for (int i = n_consts; i < n_ops; i++)
+            res_ops[n_res++] = items[i].node_->Share();
+    }
+    Node* res = _opsNode(act, res_ops, n_res);
+    free(res_ops);
+    free(items);
+    delete_subTree(curNodePtr);
+    *curNodePtr = res;
+    alter_cnt_++;
+}
+
+//sum or product of the n_ops references in ops: the neutral const for none,
+//the operand itself for one, a binary node for two, n-ary for more
+Node* Differentator::_opsNode(char actChar, Node** ops, int n_ops)
+{
+    if (n_ops == 0)
+        return new Node((actChar == '+')?0.0:1.0);
+    if (n_ops == 1)
+        return ops[0];
+    if (n_ops == 2)
+    {
+        Node* res = new Node(actChar);
+        res->left_dec_  = ops[0];
+        res->right_dec_ = ops[1];
+        return res;
+    }
+    Node* res = new Node(actChar, n_ops);
+    memcpy(res->kids_, ops, (size_t) n_ops * sizeof(Node*));
+    return res;
+}
+
+void Differentator::_zeroMul(Node* curNodePtr)
+{
+	if (!curNodePtr || curNodePtr->frozen_) goto skip;
+    if (curNodePtr->data_ && curNodePtr->data_[0] == '*' &&
+        curNodePtr->left_dec_ && curNodePtr->right_dec_)
+    {
+        NODE_TYPE l_type = curNodePtr->left_dec_->type_;
+        NODE_TYPE r_type = curNodePtr->right_dec_->type_;
+            double a = 1.0, b = 1.0;
+            if (l_type == TYPE_CONST)
+                a = curNodePtr->left_dec_->value_;
+            if (r_type == TYPE_CONST)
+                b = curNodePtr->right_dec_->value_;
+    
+            if (_d_equal(a, 0.0) || _d_equal(b, 0.0))
+            {
+                curNodePtr->setConst(0.0);
+
+                delete_subTree(&curNodePtr->left_dec_);
+                printf("left one is deleted\n");
+                delete_subTree(&curNodePtr->right_dec_);
+                printf("right is deleted\n");
+                alter_cnt_++;
+            }
+    }
+    if (curNodePtr->left_dec_)
+        _zeroMul(curNodePtr->left_dec_);
+        
+    if (curNodePtr->right_dec_)
+        _zeroMul(curNodePtr->right_dec_);
+    for (int i = 0; i < curNodePtr->n_kids_; i++)
+        _zeroMul(curNodePtr->kids_[i]);
+    skip: ;
+}
+
+void Differentator::_zeroDiv(Node* curNodePtr)
+{
+	if (!curNodePtr || curNodePtr->frozen_) goto skip;
+    if (curNodePtr->data_     && curNodePtr->data_[0] == '/' &&
+        curNodePtr->left_dec_ && curNodePtr->right_dec_ &&
+        curNodePtr->left_dec_->type_ == TYPE_CONST)
+    {
+            if (_d_equal(curNodePtr->left_dec_->value_, 0.0))
+            {
+                curNodePtr->setConst(0.0);
+                delete_subTree(&curNodePtr->left_dec_);
+                delete_subTree(&curNodePtr->right_dec_);
+                alter_cnt_++;
+            }
+    }
+    if (curNodePtr->left_dec_)
+        _zeroDiv(curNodePtr->left_dec_);
+    if (curNodePtr->right_dec_)
+        _zeroDiv(curNodePtr->right_dec_);
+    for (int i = 0; i < curNodePtr->n_kids_; i++)
+        _zeroDiv(curNodePtr->kids_[i]);
+    skip: ;
+}
+
+void Differentator::_zeroPow(Node* curNodePtr)
+{
+	if (!curNodePtr || curNodePtr->frozen_) goto skip;
+    if (curNodePtr->data_     && curNodePtr->data_[0] == '^' &&
+        curNodePtr->left_dec_ && curNodePtr->right_dec_)
+    {
+            double degree = 1.0;
+            if (curNodePtr->right_dec_->type_ == TYPE_CONST)
+                degree = curNodePtr->right_dec_->value_;
+            if (_d_equal(degree, 0.0))
+            {
+                curNodePtr->setConst(1.0);
+                delete_subTree(&curNodePtr->left_dec_);
+                delete_subTree(&curNodePtr->right_dec_);
+                alter_cnt_++;
+            }
+    }
+    if (curNodePtr->left_dec_)
+        _zeroPow(curNodePtr->left_dec_);
+    if (curNodePtr->right_dec_)
+        _zeroPow(curNodePtr->right_dec_);
+    for (int i = 0; i < curNodePtr->n_kids_; i++)
+        _zeroPow(curNodePtr->kids_[i]);
+    skip: ;
+}
+
+void Differentator::_unitDiv(Node** curNodePtr)
+{
+	if (!*curNodePtr || (*curNodePtr)->frozen_) goto skip;
+    if ((*curNodePtr)->data_ &&(*curNodePtr)->data_[0] == '/' &&
+        (*curNodePtr)->left_dec_ && (*curNodePtr)->right_dec_)
+    {
+            double r_val = 42.0;
+            if ((*curNodePtr)->right_dec_->type_ == TYPE_CONST)
+            {
+                r_val = (*curNodePtr)->right_dec_->value_;
+                if (_d_equal(r_val, 1.0))
+                    _bridge(curNodePtr, (*curNodePtr)->left_dec_);
+            }
+    }
+    if ((*curNodePtr)->left_dec_)
+        _unitDiv( &((*curNodePtr)->left_dec_) );
+    if ((*curNodePtr)->right_dec_)
+        _unitDiv( &((*curNodePtr)->right_dec_) );
+    for (int i = 0; i < (*curNodePtr)->n_kids_; i++)
+        _unitDiv(&(*curNodePtr)->kids_[i]);
+    skip: ;
+}
+
+#define ZERO_UNIT_NODE_ACTION(funcName, actChar, nodeValue)                 \
+void Differentator::funcName(Node** curNodePtr)                             \
+{																			\
+	if (!*curNodePtr || (*curNodePtr)->frozen_) goto skip;					\
+    if ((*curNodePtr)->data_ && (*curNodePtr)->data_[0] == actChar			\
+							 && (*curNodePtr)->type_ == TYPE_ACT)            \
+    {                                                                       \
+        if ((*curNodePtr)->left_dec_ && (*curNodePtr)->right_dec_)          \
+        {                                                                   \
+            printf("IN %s node %p: [%s]\n", #funcName, *curNodePtr, (*curNodePtr)->data_);\
+            double l_val = -1.0, r_val = -1.0;                              \
+            if ((*curNodePtr)->left_dec_->type_  == TYPE_CONST)             \
+                l_val = (*curNodePtr)->left_dec_->value_;                   \
+            if ((*curNodePtr)->right_dec_->type_ == TYPE_CONST)             \
+                r_val = (*curNodePtr)->right_dec_->value_;                  \
+            if(_d_equal(l_val, nodeValue))                                  \
+            {                                                               \
+				if (actChar == '-')											\
+				{															\
+					Node* node_to_bridge = new Node("*");					\
+					node_to_bridge->left_dec_= new Node("-1");				\
+					node_to_bridge->right_dec_ = (*curNodePtr)->right_dec_->Share();\
+					delete_subTree(curNodePtr);								\
+					*curNodePtr = node_to_bridge;							\
+					alter_cnt_++;											\
+				}															\
+				else	_bridge(curNodePtr, (*curNodePtr)->right_dec_);		\
+            }                                                               \
+            else                                                            \
+                if(_d_equal(r_val, nodeValue))                              \
+                    _bridge(curNodePtr, (*curNodePtr)->left_dec_);          \
+        }                                                                   \
+        else                                                                \
+        {                                                                   \
+            printf("Arguments for '%c' action requiered\n", actChar);       \
+			(*curNodePtr)->printNode();										\
+            exit(0);                                                        \
+        }                                                                   \
+    }                                                                       \
+    if ((*curNodePtr)->left_dec_)                                           \
+        funcName( &((*curNodePtr)->left_dec_) );                            \
+    if((*curNodePtr)->right_dec_)                                           \
+        funcName( &((*curNodePtr)->right_dec_) );                           \
+    for (int i = 0; i < (*curNodePtr)->n_kids_; i++)                        \
+        funcName(&(*curNodePtr)->kids_[i]);                                 \
+    skip: ;                                                                 \
+}
+ZERO_UNIT_NODE_ACTION(_unitMul, '*', 1.0)
+ZERO_UNIT_NODE_ACTION(_zeroSum, '+', 0.0)
+ZERO_UNIT_NODE_ACTION(_zeroSub, '-', 0.0)
+#undef ZERO_UNIT_NODE_ACTION
+
+#define NODE_DERIV_SUM_SUB_FUNC(actChar, funcName)                      \
+Node* Differentator::funcName(Node* left_node, Node* right_node, int var)\
+{                                                                       \
+    Node* new_node       = new Node(actChar);                           \
+    new_node->left_dec_  = _derivative(left_node,  var);                \
+    new_node->right_dec_ = _derivative(right_node, var);                \
+    new_node->left_dec_->ancestor_  = new_node;                         \
+    new_node->right_dec_->ancestor_ = new_node;                         \
+    return new_node;                                                    \
+}
+NODE_DERIV_SUM_SUB_FUNC('+', _nodeDerivSum)
+NODE_DERIV_SUM_SUB_FUNC('-', _nodeDerivSub)
+#undef NODE_SUM_SUB_FUNC
+
+//a sum gets the sum of derivatives, a product the sum over its factors of the
+//product with that factor derivated; operands that do not depend on var give no term
+Node* Differentator::_nodeDerivNary(Node* curNodePtr, int var)
+{
+    int    n     = curNodePtr->n_kids_;
+    Node** terms = (Node**) calloc ((size_t) n, sizeof(Node*));
+    int    n_res = 0;
+    if (!terms)
+    {
+        printf("_nodeDerivNary: error finding memory for %i terms\n", n);
+        exit(2);
+    }
+    for (int i = 0; i < n; i++)
+    {
+        Node* der = _derivative(curNodePtr->kids_[i], var);
+        if (der->type_ == TYPE_CONST && _d_equal(der->value_, 0.0))
+        {
+            delete_subTree(&der);
+            continue;
+        }
+        if (curNodePtr->type_ == TYPE_PROD)
+        {
+            Node* term = new Node('*', n);
+            for (int j = 0; j < n; j++)
+                term->kids_[j] = (j == i)?der:curNodePtr->kids_[j]->Share();
+            der = term;
+        }
+        terms[n_res++] = der;
+    }
+    //0 for no terms left, the term itself for one
+    Node* res = _opsNode('+', terms, n_res);
+    free(terms);
+    return res;
+}
+
+//operands are shared with the source tree instead of being copied,
+//so every partial of a jacobian points at the same subtrees of f
+Node* Differentator::_nodeDerivMul(Node* left_dec, Node* right_dec, int var)
+{
+    Node* new_sum_node   = new Node('+');
+    Node* new_l = new Node('*');
+    Node* new_r = new Node('*');
+    new_l->left_dec_  = _derivative(left_dec, var);
+    new_l->right_dec_ = right_dec->Share();
+
+    new_r->left_dec_  = left_dec->Share();
+    new_r->right_dec_ = _derivative(right_dec, var);
+    new_sum_node->left_dec_  = new_l;
+    new_sum_node->right_dec_ = new_r;
+    return new_sum_node;
+}
+
+Node* Differentator::_nodeDerivDiv(Node* left_dec, Node* right_dec, int var)
+{
+    Node* res_node   = new Node('/');
+    Node* new_l      = new Node('-');
+
+    Node* new_ll     = new Node('*');
+    Node* new_lr     = new Node('*');
+    new_ll->left_dec_   = _derivative(left_dec, var);
+    new_ll->right_dec_  = right_dec->Share();
+    new_lr->left_dec_   = left_dec->Share();
+    new_lr->right_dec_  = _derivative(right_dec, var);
+
+    Node* new_r         = _nodePow(right_dec, 2.0);
+    
+    new_l->left_dec_  = new_ll;
+    new_l->right_dec_ = new_lr;
+
+    res_node->left_dec_  = new_l;
+    res_node->right_dec_ = new_r;
+
+    return res_node;
+}
+
+Node* Differentator::_nodeDerivPow(Node* left_dec, Node* right_dec, int var)
+{
+    Node* res_node       = new Node('*');
+    if (right_dec->type_ != TYPE_CONST)
+    {
+        //(u^w)' = u^w * (w' * ln(u) + w * u' / u)
+        Node* pow_node = new Node('^');
+        pow_node->left_dec_  = left_dec->Share();
+        pow_node->right_dec_ = right_dec->Share();
+
+        Node* ln_node = new Node("ln");
+        ln_node->left_dec_ = left_dec->Share();
+
+        Node* new_l = new Node('*');
+        new_l->left_dec_  = _derivative(right_dec, var);
+        new_l->right_dec_ = ln_node;
+
+        Node* new_r = new Node('*');
+        new_r->left_dec_  = right_dec->Share();
+        new_r->right_dec_ = new Node('/');
+        new_r->right_dec_->left_dec_  = _derivative(left_dec, var);
+        new_r->right_dec_->right_dec_ = left_dec->Share();
+
+        res_node->left_dec_  = pow_node;
+        res_node->right_dec_ = new Node('+');
+        res_node->right_dec_->left_dec_  = new_l;
+        res_node->right_dec_->right_dec_ = new_r;
+        return res_node;
+    }
+    res_node->left_dec_  = new Node('*');
+    res_node->left_dec_->left_dec_  = right_dec->Share();
+    res_node->left_dec_->right_dec_ = new Node('^');
+    res_node->left_dec_->right_dec_->left_dec_  = left_dec->Share();
+    res_node->left_dec_->right_dec_->right_dec_ = new Node(right_dec->value_ - 1.0);
+    res_node->right_dec_ = _derivative(left_dec, var);
+    return res_node;
+}
+
+Node* Differentator::_nodePow(Node* left_node, double deg)
+{
+    Node* pow_node       = new Node('^');
+    pow_node->left_dec_  = left_node->Share();
+    pow_node->right_dec_ = new Node(deg);
+    return pow_node;
+}
+
+//by the bits of the value, so consts that print alike but differ do not collide; -0 is 0
+static unsigned long long const_hash(double val)
+{
+    unsigned long long bits = 0;
+    if (!exact_equal(val, 0.0))
+        memcpy(&bits, &val, sizeof(double));
+    return hash_mix(bits ^ 0x6a09e667f3bcc909ULL);
+}
+
+//equal literals of the source share one node
+//Equal subtrees of simplified trees become one shared node, so the tree is a
+//DAG: EvalProgram memorizes nodes by address and computes every distinct
+//subexpression once. The table lives as long as the Differentator, so the
+//entries of a jacobian or a hessian share with each other too. Nodes of the
+//table are frozen: the alterTree passes do not go into them, so their hashes,
+//the table and the derivative memo keyed by them stay valid.
+void Differentator::shareSubtrees(Node** head)
+{
+    Node* res = _cseNode(*head);
+    delete_subTree(head);
+    *head = res;
+}
+
+//returns a new reference to the node equal to curNodePtr that is kept in cse_
+Node* Differentator::_cseNode(Node* curNodePtr)
+{
+    if (!curNodePtr)
+        return NULL;
+    unsigned long long key = _treeHash(curNodePtr);
+    if (cse_cap_)
+    {
+        unsigned int mask = (unsigned int) cse_cap_ - 1;
+        for (unsigned int i = (unsigned int) key & mask; cse_[i]; i = (i + 1) & mask)
+            if (cse_[i] == curNodePtr || (cse_[i]->hash_ == key && _treeEqual(cse_[i], curNodePtr)))
+                return cse_[i]->Share();
+    }
+
+    Node* l = _cseNode(curNodePtr->left_dec_);
+    Node* r = _cseNode(curNodePtr->right_dec_);
+    delete_subTree(&curNodePtr->left_dec_);
+    delete_subTree(&curNodePtr->right_dec_);
+    curNodePtr->left_dec_  = l;
+    curNodePtr->right_dec_ = r;
+    for (int i = 0; i < curNodePtr->n_kids_; i++)
+    {
+        Node* kid = _cseNode(curNodePtr->kids_[i]);
+        delete_subTree(&curNodePtr->kids_[i]);
+        curNodePtr->kids_[i] = kid;
+    }
+    _cseAdd(curNodePtr);
+    return curNodePtr->Share();
+}
+
+void Differentator::_cseAdd(Node* curNodePtr)
+{
+    if (2 * (cse_size_ + 1) > cse_cap_)
+    {
+        Node** old     = cse_;
+        int    old_cap = cse_cap_;
+        cse_cap_ = (cse_cap_)?cse_cap_ * 2:256;
+        cse_     = (Node**) calloc ((size_t) cse_cap_, sizeof(Node*));
+        if (!cse_)
+        {
+            printf("_cseAdd: error finding memory for %i subtrees\n", cse_cap_);
+            exit(2);
+        }
+        unsigned int mask = (unsigned int) cse_cap_ - 1;
+        for (int i = 0; i < old_cap; i++)
+            if (old[i])
+            {
+                unsigned int j = (unsigned int) old[i]->hash_ & mask;
+                while (cse_[j])
+                    j = (j + 1) & mask;
+                cse_[j] = old[i];
+            }
+        free(old);
+    }
+    unsigned int mask = (unsigned int) cse_cap_ - 1;
+    unsigned int i    = (unsigned int) _treeHash(curNodePtr) & mask;
+    while (cse_[i])
+        i = (i + 1) & mask;
+    cse_[i] = curNodePtr->Share();
+    cse_size_++;
+    curNodePtr->frozen_ = 1;
+}
+
+Node* Differentator::_internConst(double val)
+{
+    if (2 * (consts_size_ + 1) > consts_cap_)
+    {
+        int    old_cap = consts_cap_;
+        Node** old     = consts_;
+        consts_cap_ = (consts_cap_)?consts_cap_ * 2:64;
+        consts_     = (Node**) calloc ((size_t) consts_cap_, sizeof(Node*));
+        if (!consts_)
+        {
+            printf("_internConst: error finding memory for %i consts\n", consts_cap_);
+            exit(2);
+        }
+        for (int i = 0; i < old_cap; i++)
+            if (old[i])
+            {
+                int slot = (int) (const_hash(old[i]->value_) & (unsigned long long) (consts_cap_ - 1));
+                while (consts_[slot])
+                    slot = (slot + 1) & (consts_cap_ - 1);
+                consts_[slot] = old[i];
+            }
+        free(old);
+    }
+    int slot = (int) (const_hash(val) & (unsigned long long) (consts_cap_ - 1));
+    for (; consts_[slot]; slot = (slot + 1) & (consts_cap_ - 1))
+        if (exact_equal(consts_[slot]->value_, val))
+            return consts_[slot]->Share();
+    consts_[slot] = new Node(val);
+    consts_size_++;
+    return consts_[slot]->Share();
+}
+
+//a stored hash stays valid for frozen nodes only, alterTree drops the others
+//after every round that rewrote something
+unsigned long long Differentator::_treeHash(Node* curNodePtr)
+{
+    if (!curNodePtr)
+        return 0x9e3779b97f4a7c15ULL;
+    if (curNodePtr->hash_)
+        return curNodePtr->hash_;
+
+    unsigned long long key = (curNodePtr->type_ == TYPE_VAR)?
+                             hash_mix((unsigned long long) curNodePtr->var_id_ + 1):
+                             (curNodePtr->type_ == TYPE_CONST)?const_hash(curNodePtr->value_):
+                             hash_mix(((unsigned long long) (curNodePtr->func_id_ + 1) << 8) | (unsigned char) curNodePtr->data_[0]);
+    if (curNodePtr->kids_)
+    {
+        //operands are summed up, so their order does not matter
+        unsigned long long ops = 0;
+        for (int i = 0; i < curNodePtr->n_kids_; i++)
+            ops += hash_mix(_treeHash(curNodePtr->kids_[i]) + 0x51ed270b27ULL);
+        key = hash_mix(key ^ ops ^ ((unsigned long long) curNodePtr->n_kids_ << 32) ^ (unsigned long long) curNodePtr->type_);
+        curNodePtr->hash_ = (key)?key:1;
+        return curNodePtr->hash_;
+    }
+    unsigned long long l = _treeHash(curNodePtr->left_dec_);
+    unsigned long long r = _treeHash(curNodePtr->right_dec_);
+    if (curNodePtr->type_ == TYPE_ACT && (curNodePtr->data_[0] == '+' || curNodePtr->data_[0] == '*') && l > r)
+    {
+        unsigned long long tmp = l;
+        l = r;
+        r = tmp;
+    }
+    key = hash_mix(key ^ hash_mix(l + 0x51ed270b27ULL) ^ hash_mix(r + 0x2545f4914fULL) ^ (unsigned long long) curNodePtr->type_);
+    curNodePtr->hash_ = (key)?key:1;
+    return curNodePtr->hash_;
+}
+
+int Differentator::_treeEqual(Node* a, Node* b)
+{
+    if (a == b)
+        return 1;
+    if (!a || !b || a->type_ != b->type_ || _treeHash(a) != _treeHash(b))
+        return 0;
+    if (a->type_ == TYPE_VAR)
+        return a->var_id_ == b->var_id_;
+    if (a->type_ == TYPE_CONST)
+        return exact_equal(a->value_, b->value_);
+    if (a->func_id_ != b->func_id_ || a->data_[0] != b->data_[0] || a->n_kids_ != b->n_kids_)
+        return 0;
+    if (a->kids_)
+    {
+        //the same operands in any order: every one of a is matched to a free one of b
+        int   n    = a->n_kids_;
+        int   same = 1;
+        for (int i = 0; i < n && same; i++)
+            same = _treeEqual(a->kids_[i], b->kids_[i]);
+        if (same)
+            return 1;
+        char* used = (char*) calloc ((size_t) n, sizeof(char));
+        if (!used)
+        {
+            printf("_treeEqual: error finding memory for %i operands\n", n);
+            exit(2);
+        }
+        same = 1;
+        for (int i = 0; i < n && same; i++)
+        {
+            same = 0;
+            for (int j = 0; j < n && !same; j++)
+                if (!used[j] && _treeEqual(a->kids_[i], b->kids_[j]))
+                {
+                    used[j] = 1;
+                    same    = 1;
+                }
+        }
+        free(used);
+        return same;
+    }
+    if (_treeEqual(a->left_dec_, b->left_dec_) && _treeEqual(a->right_dec_, b->right_dec_))
+        return 1;
+    return a->type_ == TYPE_ACT && (a->data_[0] == '+' || a->data_[0] == '*') &&
+           _treeEqual(a->left_dec_, b->right_dec_) && _treeEqual(a->right_dec_, b->left_dec_);
+}
+
+DerivCacheItem* Differentator::_dcacheFind(Node* curNodePtr, int var)
+{
+    if (!dcache_cap_)
+        return NULL;
+    unsigned long long key  = _treeHash(curNodePtr);
+    unsigned int       mask = (unsigned int) dcache_cap_ - 1;
+    for (unsigned int i = (unsigned int) hash_mix(key + (unsigned long long) var) & mask; dcache_[i].tree_; i = (i + 1) & mask)
+        if (dcache_[i].hash_ == key && dcache_[i].var_ == var && _treeEqual(dcache_[i].tree_, curNodePtr))
+            return &dcache_[i];
+    return NULL;
+}
+
+void Differentator::_dcacheAdd(Node* curNodePtr, int var, Node* deriv)
+{
+    if (2 * (dcache_size_ + 1) > dcache_cap_)
+    {
+        DerivCacheItem* old_items = dcache_;
+        int             old_cap   = dcache_cap_;
+        dcache_cap_ = (dcache_cap_)?dcache_cap_ * 2:256;
+        dcache_     = (DerivCacheItem*) calloc ((size_t) dcache_cap_, sizeof(DerivCacheItem));
+        if (!dcache_)
+        {
+            printf("_dcacheAdd: error finding memory for %i items\n", dcache_cap_);
+            exit(2);
+        }
+        unsigned int mask = (unsigned int) dcache_cap_ - 1;
+        for (int i = 0; i < old_cap; i++)
+            if (old_items[i].tree_)
+            {
+                unsigned int j = (unsigned int) hash_mix(old_items[i].hash_ + (unsigned long long) old_items[i].var_) & mask;
+                while (dcache_[j].tree_)
+                    j = (j + 1) & mask;
+                dcache_[j] = old_items[i];
+            }
+        free(old_items);
+    }
+    unsigned long long key  = _treeHash(curNodePtr);
+    unsigned int       mask = (unsigned int) dcache_cap_ - 1;
+    unsigned int       i    = (unsigned int) hash_mix(key + (unsigned long long) var) & mask;
+    while (dcache_[i].tree_)
+        i = (i + 1) & mask;
+    dcache_[i].hash_  = key;
+    dcache_[i].var_   = var;
+    dcache_[i].tree_  = curNodePtr->Share();
+    dcache_[i].deriv_ = deriv->Share();
+    dcache_size_++;
+}
+
+void Differentator::useBinaryOutput()
+{
+    bin_out_ = 1;
+}
+
+void Differentator::useRenderer(RENDER_MODE mode)
+{
+    renderer_.setMode(mode);
+}
+
+//Shared subtrees of at least min_size nodes are printed once, as t1 = ...
+//lines before the result, which names them instead of repeating them.
+//chains are regrouped by alterTree and evaluated as balanced trees
+void Differentator::useReassociation()
+{
+    reassoc_ = 1;
+}
+
+void Differentator::useLetBindings(int min_size)
+{
+    let_min_ = (min_size > 1)?min_size:2;
+}
+
+LetItem* Differentator::_letFind(Node* curNodePtr)
+{
+    unsigned int mask = (unsigned int) let_cap_ - 1;
+    unsigned int i    = ptr_hash(curNodePtr) & mask;
+    while (let_[i].node_ && let_[i].node_ != curNodePtr)
+        i = (i + 1) & mask;
+    return let_ + i;
+}
+
+//counts parents of every node and sizes of the subtrees as they would be printed
+void Differentator::_letCount(Node* curNodePtr)
+{
+    if (!curNodePtr)
+        return;
+    LetItem* item = _letFind(curNodePtr);
+    if (item->node_)
+    {
+        item->uses_++;
+        return;
+    }
+    if (2 * (let_size_ + 1) > let_cap_)
+    {
+        LetItem* old     = let_;
+        int      old_cap = let_cap_;
+        let_cap_ *= 2;
+        let_      = (LetItem*) calloc ((size_t) let_cap_, sizeof(LetItem));
+        if (!let_)
+        {
+            printf("_letCount: error finding memory for %i nodes\n", let_cap_);
+            exit(2);
+        }
+        for (int i = 0; i < old_cap; i++)
+            if (old[i].node_)
+                *_letFind(old[i].node_) = old[i];
+        free(old);
+    }
+    _letCount(curNodePtr->left_dec_);
+    _letCount(curNodePtr->right_dec_);
+    for (int i = 0; i < curNodePtr->n_kids_; i++)
+        _letCount(curNodePtr->kids_[i]);
+    double size = 1.0;
+    if (curNodePtr->left_dec_)
+        size += _letFind(curNodePtr->left_dec_)->size_;
+    if (curNodePtr->right_dec_)
+        size += _letFind(curNodePtr->right_dec_)->size_;
+    for (int i = 0; i < curNodePtr->n_kids_; i++)
+        size += _letFind(curNodePtr->kids_[i])->size_;
+    item = _letFind(curNodePtr);
+    item->node_ = curNodePtr;
+    item->uses_ = 1;
+    item->size_ = size;
+    let_size_++;
+}
+
+//numbers the temporaries so that every one is defined before it is used
+void Differentator::_letNumber(Node* curNodePtr)
+{
+    if (!curNodePtr)
+        return;
+    LetItem* item = _letFind(curNodePtr);
+    if (item->id_)
+        return;
+    item->id_ = -1;
+    _letNumber(curNodePtr->left_dec_);
+    _letNumber(curNodePtr->right_dec_);
+    for (int i = 0; i < curNodePtr->n_kids_; i++)
+        _letNumber(curNodePtr->kids_[i]);
+    if (item->uses_ > 1 && item->size_ >= let_min_)
+    {
+        item->id_ = ++n_lets_;
+        let_order_[n_lets_] = curNodePtr;
+    }
+}
+
+void Differentator::_letBuild(Node** heads, int n_heads)
+{
+    _letFree();
+    if (!let_min_)
+        return;
+    let_cap_ = 256;
+    let_     = (LetItem*) calloc ((size_t) let_cap_, sizeof(LetItem));
+    if (!let_)
+    {
+        printf("_letBuild: error finding memory for %i nodes\n", let_cap_);
+        exit(2);
+    }
+    for (int k = 0; k < n_heads; k++)
+        _letCount(heads[k]);
+    let_order_ = (Node**) calloc ((size_t) let_size_ + 1, sizeof(Node*));
+    if (!let_order_)
+    {
+        printf("_letBuild: error finding memory for %i temporaries\n", let_size_);
+        exit(2);
+    }
+    for (int k = 0; k < n_heads; k++)
+        _letNumber(heads[k]);
+
+    //t1, t2... unless a var looks like that, then tt1, tt2...
+    strcpy(let_name_, "t");
+    for (int i = 0; i < n_vars_; i++)
+    {
+        size_t len = strlen(let_name_);
+        if (!strncmp(vars_[i], let_name_, len) && vars_[i][len] && isdigit(vars_[i][len])
+            && vars_[i][len + strspn(vars_[i] + len, "0123456789")] == '\0'
+            && len + 2 < sizeof(let_name_))
+        {
+            strcat(let_name_, "t");
+            i = -1;
+        }
+    }
+}
+
+//number of the temporary printed instead of the node, 0 if it is printed in full
+int Differentator::_letRef(Node* curNodePtr)
+{
+    if (!n_lets_ || curNodePtr == let_open_)
+        return 0;
+    LetItem* item = _letFind(curNodePtr);
+    return (item->node_ && item->id_ > 0)?item->id_:0;
+}
+
+void Differentator::_letWrite()
+{
+    for (int k = 1; k <= n_lets_; k++)
+    {
+        let_open_ = let_order_[k];
+        fprintf(file_to_write_, "%s%i = ", let_name_, k);
+        _inFilePrint(let_order_[k]);
+        fprintf(file_to_write_, "\n");
+    }
+    let_open_ = NULL;
+}
+
+void Differentator::_letWrite_tex()
+{
+    if (!n_lets_)
+        return;
+    fprintf(tx_f, "\\begin{equation*}\n\\begin{aligned}\n");
+    for (int k = 1; k <= n_lets_; k++)
+    {
+        let_open_ = let_order_[k];
+        fprintf(tx_f, "%s_{%i} &= ", let_name_, k);
+        _inFilePrint_tex(let_order_[k]);
+        fprintf(tx_f, (k < n_lets_)?"\\\\\n":"\n");
+    }
+    let_open_ = NULL;
+    fprintf(tx_f, "\\end{aligned}\n\\end{equation*}\n");
+}
+
+void Differentator::_letFree()
+{
+    free(let_);
+    free(let_order_);
+    let_       = NULL;
+    let_order_ = NULL;
+    let_cap_   = 0;
+    let_size_  = 0;
+    n_lets_    = 0;
+}
+
+void Differentator::inFilePrint_bin(Node* head)
+{
+    Blob blob = {};
+    blob_put_header(&blob);
+    _packTree(head, &blob);
+    if (fwrite(blob.data_, 1, blob.size_, file_to_write_) != blob.size_)
+        printf("inFilePrint_bin: error writing %zu bytes: %s\n", blob.size_, strerror(errno));
+    free(blob.data_);
+}
+
+void Differentator::useDiskCache(const char* path)
+{
+    delete disk_cache_;
+    disk_cache_ = new DiskCache(path);
+}
+
+//unlike _treeHash it goes by var names, not by ids, so it is stable between runs
+unsigned long long Differentator::_persistHash(Node* curNodePtr, unsigned long long seed)
+{
+    if (!curNodePtr)
+        return hash_mix(seed);
+    unsigned long long key = hash_mix(((curNodePtr->type_ == TYPE_CONST)?const_hash(curNodePtr->value_):
+                                       str_hash((curNodePtr->type_ == TYPE_VAR && curNodePtr->var_id_ >= 0)?
+                                                vars_[curNodePtr->var_id_]:curNodePtr->data_)) ^ seed);
+    if (curNodePtr->kids_)
+    {
+        unsigned long long ops = 0;
+        for (int i = 0; i < curNodePtr->n_kids_; i++)
+            ops += hash_mix(_persistHash(curNodePtr->kids_[i], seed) + 0x51ed270b27ULL);
+        return hash_mix(key ^ ops ^ ((unsigned long long) curNodePtr->n_kids_ << 32) ^ (unsigned long long) curNodePtr->type_);
+    }
+    unsigned long long l = _persistHash(curNodePtr->left_dec_,  seed);
+    unsigned long long r = _persistHash(curNodePtr->right_dec_, seed);
+    if (curNodePtr->type_ == TYPE_ACT && (curNodePtr->data_[0] == '+' || curNodePtr->data_[0] == '*') && l > r)
+    {
+        unsigned long long tmp = l;
+        l = r;
+        r = tmp;
+    }
+    return hash_mix(key ^ hash_mix(l + 0x51ed270b27ULL) ^ hash_mix(r + 0x2545f4914fULL) ^ (unsigned long long) curNodePtr->type_);
+}
+
+//writes the tree body of tree_bin.h, without the file header
+void Differentator::_packTree(Node* curNodePtr, Blob* blob)
+{
+    Blob ops = {}, consts = {}, syms = {};
+    int  n_syms = 0, n_nodes = 0;
+    int* sym_ids = (int*) calloc ((size_t) (n_vars_ + FUNC_CNT), sizeof(int));
+    if (!sym_ids)
+    {
+        printf("_packTree: error finding memory\n");
+        exit(2);
+    }
+    for (int i = 0; i < n_vars_ + FUNC_CNT; i++)
+        sym_ids[i] = -1;
+
+    _packNode(curNodePtr, &ops, &consts, &syms, sym_ids, &n_syms, &n_nodes);
+
+    blob_put_varint(blob, (unsigned long long) n_nodes);
+    blob_put_varint(blob, consts.size_ / sizeof(double));
+    blob_put_varint(blob, (unsigned long long) n_syms);
+    if (consts.size_) blob_put(blob, consts.data_, consts.size_);
+    if (syms.size_)   blob_put(blob, syms.data_,   syms.size_);
+    if (ops.size_)    blob_put(blob, ops.data_,    ops.size_);
+    free(ops.data_);
+    free(consts.data_);
+    free(syms.data_);
+    free(sym_ids);
+}
+
+void Differentator::_packNode(Node* curNodePtr, Blob* ops, Blob* consts, Blob* syms, int* sym_ids, int* n_syms, int* n_nodes)
+{
+    if (!curNodePtr)
+        return;
+    _packNode(curNodePtr->left_dec_,  ops, consts, syms, sym_ids, n_syms, n_nodes);
+    _packNode(curNodePtr->right_dec_, ops, consts, syms, sym_ids, n_syms, n_nodes);
+    for (int i = 0; i < curNodePtr->n_kids_; i++)
+        _packNode(curNodePtr->kids_[i], ops, consts, syms, sym_ids, n_syms, n_nodes);
+    (*n_nodes)++;
+
+    switch(curNodePtr->type_)
+    {
+        case TYPE_CONST:
+        {
+            blob_put(consts, &curNodePtr->value_, sizeof(double));
+            blob_put(ops, "c", 1);
+            break;
+        }
+        case TYPE_VAR:
+        case TYPE_FUNC:
+        {
+            int  slot = (curNodePtr->type_ == TYPE_VAR)?curNodePtr->var_id_:n_vars_ + curNodePtr->func_id_;
+            if (slot < 0 || slot >= n_vars_ + FUNC_CNT)
+            {
+                printf("_packNode: '%s' is neither a known var nor a function\n", curNodePtr->data_);
+                exit(4);
+            }
+            if (sym_ids[slot] < 0)
+            {
+                const char* name = (curNodePtr->type_ == TYPE_VAR)?vars_[curNodePtr->var_id_]:curNodePtr->data_;
+                blob_put_varint(syms, strlen(name));
+                blob_put(syms, name, strlen(name));
+                sym_ids[slot] = (*n_syms)++;
+            }
+            blob_put(ops, (curNodePtr->type_ == TYPE_VAR)?"v":"f", 1);
+            blob_put_varint(ops, (unsigned long long) sym_ids[slot]);
+            if (curNodePtr->type_ == TYPE_FUNC)
+                blob_put_varint(ops, 1);
+            break;
+        }
+        case TYPE_ACT:
+        case TYPE_SUM:
+        case TYPE_PROD:
+            blob_put(ops, curNodePtr->data_, 1);
+            blob_put_varint(ops, (curNodePtr->kids_)?(unsigned long long) curNodePtr->n_kids_:2);
+            break;
+        case TYPE_DEF:
+        default:
+            printf("_packNode: node %p type is not set\n", curNodePtr);
+            exit(4);
+    }
+}
+
+Node* Differentator::_unpackTree(const unsigned char* rec, unsigned int len)
+{
+    const unsigned char* pos = rec;
+    const unsigned char* end = rec + len;
+    unsigned long long n_nodes  = blob_get_varint(&pos, end);
+    unsigned long long n_consts = blob_get_varint(&pos, end);
+    unsigned long long n_syms   = blob_get_varint(&pos, end);
+    const unsigned char* consts = pos;
+    unsigned long long   n_used = 0;
+    if (n_consts > (unsigned long long) (end - pos) / sizeof(double))
+    {
+        printf("_unpackTree: broken const table\n");
+        exit(5);
+    }
+    pos += n_consts * sizeof(double);
+
+    char** syms    = (char**) calloc ((size_t) n_syms + 1,  sizeof(char*));
+    int*   var_ids = (int*)   calloc ((size_t) n_syms + 1,  sizeof(int));
+    Node** stack   = (Node**) calloc ((size_t) n_nodes + 1, sizeof(Node*));
+    if (!syms || !var_ids || !stack || pos > end)
+    {
+        printf("_unpackTree: broken record or no memory for %llu nodes\n", n_nodes);
+        exit(5);
+    }
+    for (unsigned long long i = 0; i < n_syms; i++)
+    {
+        unsigned long long sym_len = blob_get_varint(&pos, end);
+        if (pos + sym_len > end || sym_len >= MAX_NODE_STR_LEN || !(syms[i] = strndup((const char*) pos, sym_len)))
+        {
+            printf("_unpackTree: broken symbol table\n");
+            exit(5);
+        }
+        var_ids[i] = (func_id(syms[i]) < 0)?_internVar(syms[i], (size_t) sym_len):-1;
+        pos += sym_len;
+    }
+
+    int depth = 0;
+    for (unsigned long long i = 0; i < n_nodes; i++)
+    {
+        if (pos >= end)
+        {
+            printf("_unpackTree: record is truncated\n");
+            exit(5);
+        }
+        unsigned char op = *pos++;
+        Node* node = NULL;
+        switch(op)
+        {
+            case 'c':
+            {
+                double val = 0.0;
+                if (n_used++ == n_consts)
+                {
+                    printf("_unpackTree: broken const table\n");
+                    exit(5);
+                }
+                memcpy(&val, consts, sizeof(double));
+                consts += sizeof(double);
+                node = new Node(val);
+                break;
+            }
+            case 'v':
+            case 'f':
+            {
+                unsigned long long sym    = blob_get_varint(&pos, end);
+                unsigned long long n_kids = (op == 'f')?blob_get_varint(&pos, end):0;
+                if (sym >= n_syms || (op == 'f' && (n_kids != 1 || !depth)))
+                {
+                    printf("_unpackTree: broken symbol reference\n");
+                    exit(5);
+                }
+                node = new Node(syms[sym]);
+                if (op == 'f' && node->type_ != TYPE_FUNC)
+                {
+                    printf("_unpackTree: unknown function '%s'\n", syms[sym]);
+                    exit(5);
+                }
+                if (op == 'v')
+                    node->var_id_ = var_ids[sym];
+                else
+                    node->left_dec_ = stack[--depth];
+                break;
+            }
+            case '+':
+            case '-':
+            case '*':
+            case '/':
+            case '^':
+            {
+                //'+' and '*' may be n-ary, the other actions are binary
+                unsigned long long n_kids = blob_get_varint(&pos, end);
+                if (n_kids < 2 || (n_kids > 2 && op != '+' && op != '*') || n_kids > (unsigned long long) depth)
+                {
+                    printf("_unpackTree: action '%c' needs 2 operands\n", op);
+                    exit(5);
+                }
+                if (n_kids > 2)
+                {
+                    node  = new Node((char) op, (int) n_kids);
+                    depth -= (int) n_kids;
+                    memcpy(node->kids_, stack + depth, (size_t) n_kids * sizeof(Node*));
+                    break;
+                }
+                node = new Node((char) op);
+                node->right_dec_ = stack[--depth];
+                node->left_dec_  = stack[--depth];
+                break;
+            }
+            default:
+                printf("_unpackTree: unknown op '%c'\n", op);
+                exit(5);
+        }
+        stack[depth++] = node;
+    }
+    Node* res = (depth == 1)?stack[0]:NULL;
+    if (!res)
+    {
+        printf("_unpackTree: record holds %i trees instead of one\n", depth);
+        exit(5);
+    }
+    if (n_used != n_consts)
+    {
+        printf("_unpackTree: broken const table\n");
+        exit(5);
+    }
+    for (unsigned long long i = 0; i < n_syms; i++)
+        free(syms[i]);
+    free(syms);
+    free(var_ids);
+    free(stack);
+    return res;
+}
+
+#define L_BRANCH curNodePtr->left_dec_
+#define R_BRANCH curNodePtr->right_dec_
+Node* Differentator::_derivative(Node* curNodePtr, int var)
+{
+    //printf("in _derivative: curNode %p: [%s]\n", curNodePtr, curNodePtr->data_);
+	if (!curNodePtr) return NULL;
+    if (!curNodePtr->isAct() && curNodePtr->type_ != TYPE_FUNC)
+        return _derivRule(curNodePtr, var);
+
+    //equal subtrees (up to the order of + and * operands) are derivated once,
+    //every later occurrence shares the same rule output; it is simplified once,
+    //as a whole, by partial
+    DerivCacheItem* item = _dcacheFind(curNodePtr, var);
+    if (item)
+        return item->deriv_->Share();
+
+    Node* res = _derivRule(curNodePtr, var);
+    _dcacheAdd(curNodePtr, var, res);
+    return res;
+}
+
+Node* Differentator::_derivRule(Node* curNodePtr, int var)
+{
+	if (!curNodePtr) goto skip;
+    switch(curNodePtr->type_)
+    {
+        case TYPE_DEF:
+            printf("_derivative: node %p: '%s' type is not set\n", curNodePtr, curNodePtr->data_);
+            exit(4);
+        case TYPE_CONST:
+        {
+            return new Node('0');
+        }
+        case TYPE_VAR:
+        {
+            return new Node((curNodePtr->var_id_ == var)?'1':'0');
+        }
+        case TYPE_ACT:
+            switch(curNodePtr->data_[0])
+            {
+                case '+':
+                    return _nodeDerivSum(L_BRANCH, R_BRANCH, var);
+                case '-':
+                    return _nodeDerivSub(L_BRANCH, R_BRANCH, var);
+                case '*':
+                    return _nodeDerivMul(L_BRANCH, R_BRANCH, var);
+                case '/':
+                    return _nodeDerivDiv(L_BRANCH, R_BRANCH, var);
+                case '^':
+                {
+                    if (R_BRANCH->type_ != TYPE_CONST || !_d_equal(R_BRANCH->value_, 0.0))
+                        return _nodeDerivPow(L_BRANCH, R_BRANCH, var);
+                }
+                default:
+                    printf("Cannot distinguish act char; worked at %i line\n", __LINE__);
+                    inFilePrint_dot(curNodePtr);
+                    curNodePtr->printNode();
+                    printf("\n");
+                    _printTree(curNodePtr);
+                    printf("\n");
+                    exit(0);
+            }
+        case TYPE_FUNC:
+            return (this->*math_funcs[curNodePtr->func_id_].deriv_)(curNodePtr, var);
+        case TYPE_SUM:
+        case TYPE_PROD:
+            return _nodeDerivNary(curNodePtr, var);
+        default:
+            printf("Node type is not set or is not recognised; worked at %i line\n", __LINE__);
+            curNodePtr->printNode();
+            exit(0);
+
+    }
+	skip: return NULL;
+}
+
+Node* Differentator::_lnDer(Node* curNodePtr, int var)
+{
+    Node* res_node      = new Node('*');
+    res_node->left_dec_ = new Node('/');
+    res_node->left_dec_->left_dec_  = new Node("1");
+    res_node->left_dec_->right_dec_ = curNodePtr->left_dec_->Share();
+    res_node->right_dec_ = _derivative(L_BRANCH, var);
+    return res_node;
+}
+
+Node* Differentator::_sinDer(Node* curNodePtr, int var)
+{
+    Node* res_node = new Node('*');
+    Node* new_l = new Node("cos");
+    new_l->left_dec_ = curNodePtr->left_dec_->Share();
+    Node* new_r = _derivative(curNodePtr->left_dec_, var);
+
+    res_node->left_dec_  = new_l;
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
+Node* Differentator::_cosDer(Node* curNodePtr, int var)
+{
+    Node* res_node = new Node('*');
+    Node* new_l = new Node('*');
+    new_l->left_dec_  = new Node("-1");
+    new_l->right_dec_ = new Node("sin");
+    new_l->right_dec_->left_dec_ = curNodePtr->left_dec_->Share();
+    Node* new_r = _derivative(curNodePtr->left_dec_, var);
+
+    res_node->left_dec_  = new_l;
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
+Node* Differentator::_expDer(Node* curNodePtr, int var)
+{
+    Node* res_node = new Node('*');
+    res_node->left_dec_  = curNodePtr->Share();
+    res_node->right_dec_ = _derivative(L_BRANCH, var);
+    return res_node;
+}
+
+Node* Differentator::_tanDer(Node* curNodePtr, int var)
+{
+    Node* res_node = new Node('/');
+    Node* new_r    = new Node('^');
+    new_r->left_dec_  = new Node("cos");
+    new_r->left_dec_->left_dec_ = L_BRANCH->Share();
+    new_r->right_dec_ = new Node("2");
+
+    res_node->left_dec_  = _derivative(L_BRANCH, var);
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
+Node* Differentator::_sqrtDer(Node* curNodePtr, int var)
+{
+    Node* res_node = new Node('/');
+    Node* new_r    = new Node('*');
+    new_r->left_dec_  = new Node("2");
+    new_r->right_dec_ = curNodePtr->Share();
+
+    res_node->left_dec_  = _derivative(L_BRANCH, var);
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
+//(1 - u^2)^0.5, the denominator of asin and acos
+Node* Differentator::_asinRoot(Node* arg_node)
+{
+    Node* sub_node = new Node('-');
+    sub_node->left_dec_  = new Node("1");
+    sub_node->right_dec_ = _nodePow(arg_node, 2.0);
+
+    Node* root_node = new Node('^');
+    root_node->left_dec_  = sub_node;
+    root_node->right_dec_ = new Node("0.5");
+    return root_node;
+}
+
+Node* Differentator::_asinDer(Node* curNodePtr, int var)
+{
+    Node* res_node = new Node('/');
+    res_node->left_dec_  = _derivative(L_BRANCH, var);
+    res_node->right_dec_ = _asinRoot(L_BRANCH);
+    return res_node;
+}
+
+Node* Differentator::_acosDer(Node* curNodePtr, int var)
+{
+    Node* res_node = new Node('/');
+    res_node->left_dec_ = new Node('*');
+    res_node->left_dec_->left_dec_  = new Node("-1");
+    res_node->left_dec_->right_dec_ = _derivative(L_BRANCH, var);
+    res_node->right_dec_ = _asinRoot(L_BRANCH);
+    return res_node;
+}
+
+Node* Differentator::_atanDer(Node* curNodePtr, int var)
+{
+    Node* res_node = new Node('/');
+    Node* new_r    = new Node('+');
+    new_r->left_dec_  = new Node("1");
+    new_r->right_dec_ = _nodePow(L_BRANCH, 2.0);
+
+    res_node->left_dec_  = _derivative(L_BRANCH, var);
+    res_node->right_dec_ = new_r;
+    return res_node;
+}
+
+#undef L_BRANCH
+#undef R_BRANCH
+
+Node* Differentator::partial(Node* head, int var_id)
+{
+    unsigned long long hash = 0, check = 0;
+    if (disk_cache_ && var_id >= 0)
+    {
+        //--reassoc simplifies to other trees, and records of another format must not be found
+        unsigned long long mode = hash_mix((unsigned long long) (reassoc_ + 2 * (DISK_CACHE_VERSION * 256 + TREE_BIN_VERSION)));
+        hash  = hash_mix(_persistHash(head, 0x243f6a8885a308d3ULL) ^ str_hash(vars_[var_id]) ^ mode);
+        check = hash_mix(_persistHash(head, 0x13198a2e03707344ULL) + str_hash(vars_[var_id]) + mode);
+        unsigned int len = 0;
+        const unsigned char* rec = disk_cache_->find(hash, check, &len);
+        if (rec)
+        {
+            Node* res = _unpackTree(rec, len);
+            shareSubtrees(&res);
+            return res;
+        }
+    }
+
+    Node* res = _derivative(head, var_id);
+    alterTree(&res);
+    shareSubtrees(&res);
+
+    if (disk_cache_ && var_id >= 0)
+    {
+        Blob blob = {};
+        _packTree(res, &blob);
+        disk_cache_->add(hash, check, blob.data_, (unsigned int) blob.size_);
+        free(blob.data_);
+    }
+    return res;
+}
+
+Node** Differentator::gradient(Node* head)
+{
+    return jacobian(&head, 1);
+}
+
+Node** Differentator::jacobian(Node** heads, int n_heads)
+{
+    //row-major n_heads x n_vars_ matrix, release every entry with delete_subTree
+    Node** jac = (Node**) calloc ((size_t) (n_heads * n_vars_) + 1, sizeof(Node*));
+    if (!jac)
+    {
+        printf("jacobian: error finding memory for %i x %i matrix\n", n_heads, n_vars_);
+        exit(2);
+    }
+    for (int i = 0; i < n_heads; i++)
+    {
+        //partials share subtrees of f, so f is simplified once before them
+        alterTree(&heads[i]);
+        for (int j = 0; j < n_vars_; j++)
+            jac[i * n_vars_ + j] = partial(heads[i], j);
+    }
+    return jac;
+}
+
+void Differentator::derivative(const char* var_name, const double* point)
+{
+    //with no var given the tree is derivated by x, or by its only var
+    int var = (var_name)?varId(var_name):varId("x");
+    if (!var_name && var < 0 && n_vars_ == 1)
+        var = 0;
+    if (var_name && var < 0)
+        printf("derivative: expression has no var '%s', derivative is 0\n", var_name);
+
+    inFilePrint_dot(root_);
+    alterTree(&root_);
+    shareSubtrees(&root_);
+    inFilePrint_dot(root_);
+
+    printf("BEFORE DERIVATING ORIGIN TREE:  ");
+    printTree(root_);
+    printf("\n\n");
+    new_root_ = partial(root_, var);
+
+    printf("after ALTERING NEW TREE:  ");
+    printTree(new_root_);
+    printf("\n\n");
+    inFilePrint_dot(root_);
+    inFilePrint_dot(new_root_);
+
+    printf("BEFORE FINAL WRITING IN FILE ORIGIN TREE ");
+    printTree(root_);
+    printf("\n\n");
+    if (bin_out_)
+        inFilePrint_bin(new_root_);
+    else
+    {
+        _letBuild(&new_root_, 1);
+        _letWrite();
+        _inFilePrint(new_root_);
+    }
+    inFilePrint_tex(root_, new_root_);
+    _letFree();
+
+    if (point)
+    {
+        //f and f' are outputs of one program, so the subtrees of f that f' shares
+        //are computed once, as are sin and cos of one argument
+        EvalProgram prog;
+        if (reassoc_)
+            prog.balanceChains();
+        prog.addOutput(root_);
+        prog.addOutput(new_root_);
+        double vals[2] = {};
+        prog.eval(point, vals);
+        char f_num[NUM_PRINT_LEN] = {}, d_num[NUM_PRINT_LEN] = {};
+        num_print(vals[0], f_num);
+        num_print(vals[1], d_num);
+        if (bin_out_)
+            printf("values: %s %s\n", f_num, d_num);
+        else
+            fprintf(file_to_write_, "\nvalues: %s %s\n", f_num, d_num);
+    }
+}
+
+void Differentator::jacobian()
+{
+    Node** jac = jacobian(roots_, n_roots_);
+    inFilePrint_jacobian(jac);
+    for (int i = 0; i < n_roots_ * n_vars_; i++)
+        delete_subTree(&jac[i]);
+    free(jac);
+}
+
+void Differentator::_depFree(DepInfo* dep)
+{
+    free(dep->vars_);
+    free(dep->pairs_);
+    dep->vars_    = NULL;
+    dep->pairs_   = NULL;
+    dep->n_vars_  = dep->n_pairs_ = 0;
+}
+
+void Differentator::_depCross(DepInfo* dep, const int* a, int n_a, const int* b, int n_b)
+{
+    if (!n_a || !n_b)
+        return;
+    long long* cross = (long long*) calloc ((size_t) (n_a * n_b), sizeof(long long));
+    if (!cross)
+    {
+        printf("_depCross: error finding memory for %i x %i pairs\n", n_a, n_b);
+        exit(2);
+    }
+    int n_cross = 0;
+    for (int i = 0; i < n_a; i++)
+        for (int j = 0; j < n_b; j++)
+        {
+            int lo = (a[i] < b[j])?a[i]:b[j];
+            int hi = (a[i] < b[j])?b[j]:a[i];
+            cross[n_cross++] = (long long) lo * n_vars_ + hi;
+        }
+    qsort(cross, (size_t) n_cross, sizeof(long long), cmp_pairs);
+    int n_uniq = 0;
+    for (int i = 0; i < n_cross; i++)
+        if (!n_uniq || cross[n_uniq - 1] != cross[i])
+            cross[n_uniq++] = cross[i];
+
+    int n_res = 0;
+    long long* res = union_pairs(dep->pairs_, dep->n_pairs_, cross, n_uniq, &n_res);
+    free(dep->pairs_);
+    free(cross);
+    dep->pairs_   = res;
+    dep->n_pairs_ = n_res;
+}
+
+void Differentator::_depAnalysis(Node* curNodePtr, DepInfo* dep)
+{
+    dep->vars_    = NULL;
+    dep->pairs_   = NULL;
+    dep->n_vars_  = dep->n_pairs_ = 0;
+    if (!curNodePtr)
+        return;
+
+    if (curNodePtr->type_ == TYPE_VAR)
+    {
+        dep->vars_ = (int*) calloc (1, sizeof(int));
+        if (!dep->vars_)
+        {
+            printf("_depAnalysis: error finding memory\n");
+            exit(2);
+        }
+        dep->vars_[0] = curNodePtr->var_id_;
+        dep->n_vars_  = 1;
+        return;
+    }
+    if (!curNodePtr->isAct() && curNodePtr->type_ != TYPE_FUNC)
+        return;
+
+    if (curNodePtr->kids_)
+    {
+        //operands of a product cross with all the ones before them
+        for (int i = 0; i < curNodePtr->n_kids_; i++)
+        {
+            DepInfo kid = {};
+            _depAnalysis(curNodePtr->kids_[i], &kid);
+            if (curNodePtr->type_ == TYPE_PROD)
+                _depCross(dep, dep->vars_, dep->n_vars_, kid.vars_, kid.n_vars_);
+            int   n_vars = 0, n_pairs = 0;
+            int*       vars  = union_ints (dep->vars_,  dep->n_vars_,  kid.vars_,  kid.n_vars_,  &n_vars);
+            long long* pairs = union_pairs(dep->pairs_, dep->n_pairs_, kid.pairs_, kid.n_pairs_, &n_pairs);
+            _depFree(dep);
+            _depFree(&kid);
+            dep->vars_    = vars;
+            dep->n_vars_  = n_vars;
+            dep->pairs_   = pairs;
+            dep->n_pairs_ = n_pairs;
+        }
+        return;
+    }
+
+    DepInfo l = {}, r = {};
+    _depAnalysis(curNodePtr->left_dec_,  &l);
+    _depAnalysis(curNodePtr->right_dec_, &r);
+    dep->vars_  = union_ints (l.vars_,  l.n_vars_,  r.vars_,  r.n_vars_,  &dep->n_vars_);
+    dep->pairs_ = union_pairs(l.pairs_, l.n_pairs_, r.pairs_, r.n_pairs_, &dep->n_pairs_);
+
+    if (curNodePtr->type_ == TYPE_FUNC)
+        //every function of MATH_FUNCTIONS is non-linear
+        _depCross(dep, l.vars_, l.n_vars_, l.vars_, l.n_vars_);
+    else
+        switch(curNodePtr->data_[0])
+        {
+            case '+':
+            case '-':
+                break;
+            case '*':
+                _depCross(dep, l.vars_, l.n_vars_, r.vars_, r.n_vars_);
+                break;
+            case '/':
+                _depCross(dep, l.vars_, l.n_vars_, r.vars_, r.n_vars_);
+                _depCross(dep, r.vars_, r.n_vars_, r.vars_, r.n_vars_);
+                break;
+            case '^':
+            {
+                double degree = (curNodePtr->right_dec_->type_ == TYPE_CONST)?curNodePtr->right_dec_->value_:2.0;
+                if (r.n_vars_)
+                    _depCross(dep, dep->vars_, dep->n_vars_, dep->vars_, dep->n_vars_);
+                else if (_d_equal(degree, 1.0) || _d_equal(degree, 0.0))
+                    break;
+                else
+                    _depCross(dep, l.vars_, l.n_vars_, l.vars_, l.n_vars_);
+                break;
+            }
+            default:
+                printf("_depAnalysis: unknown action '%c'\n", curNodePtr->data_[0]);
+                exit(4);
+        }
+    _depFree(&l);
+    _depFree(&r);
+}
+
+void Differentator::hessian(Node* head, SparseHessian* hes)
+{
+    //head is expected to be simplified already, see hessian(point)
+    DepInfo dep = {};
+    _depAnalysis(head, &dep);
+
+    hes->nnz_     = 0;
+    hes->rows_    = (int*)   calloc ((size_t) dep.n_pairs_ + 1, sizeof(int));
+    hes->cols_    = (int*)   calloc ((size_t) dep.n_pairs_ + 1, sizeof(int));
+    hes->entries_ = (Node**) calloc ((size_t) dep.n_pairs_ + 1, sizeof(Node*));
+    hes->row_ptr_ = (int*)   calloc ((size_t) n_vars_ + 1,      sizeof(int));
+    if (!hes->rows_ || !hes->cols_ || !hes->entries_ || !hes->row_ptr_)
+    {
+        printf("hessian: error finding memory for %i entries\n", dep.n_pairs_);
+        exit(2);
+    }
+
+    //pairs are sorted by row, so each first partial is built once for its whole row
+    Node* row_partial = NULL;
+    int   row = -1;
+    for (int k = 0; k < dep.n_pairs_; k++)
+    {
+        int i = (int) (dep.pairs_[k] / n_vars_);
+        int j = (int) (dep.pairs_[k] % n_vars_);
+        if (i != row)
+        {
+            delete_subTree(&row_partial);
+            row_partial = partial(head, i);
+            row = i;
+        }
+        Node* entry = partial(row_partial, j);
+        if (entry->type_ == TYPE_CONST && _d_equal(entry->value_, 0.0))
+        {
+            //structurally non-zero, but cancelled out by simplification
+            delete_subTree(&entry);
+            continue;
+        }
+        hes->rows_[hes->nnz_]    = i;
+        hes->cols_[hes->nnz_]    = j;
+        hes->entries_[hes->nnz_] = entry;
+        hes->nnz_++;
+        hes->row_ptr_[i + 1]++;
+    }
+    for (int i = 0; i < n_vars_; i++)
+        hes->row_ptr_[i + 1] += hes->row_ptr_[i];
+    delete_subTree(&row_partial);
+    _depFree(&dep);
+}
+
+void Differentator::freeHessian(SparseHessian* hes)
+{
+    for (int k = 0; k < hes->nnz_; k++)
+        delete_subTree(&hes->entries_[k]);
+    free(hes->rows_);
+    free(hes->cols_);
+    free(hes->entries_);
+    free(hes->row_ptr_);
+    hes->rows_    = hes->cols_ = hes->row_ptr_ = NULL;
+    hes->entries_ = NULL;
+    hes->nnz_     = 0;
+}
+
+double* Differentator::readPoint(char** args, int n_args)
+{
+    //args are "var=value" strings, vars that are not mentioned are 0
+    double* point = (double*) calloc ((size_t) n_vars_ + 1, sizeof(double));
+    if (!point)
+    {
+        printf("readPoint: error finding memory\n");
+        exit(2);
+    }
+    for (int i = 0; i < n_args; i++)
+    {
+        char   name[MAX_NODE_STR_LEN] = {};
+        double val = 0.0;
+        if (sscanf(args[i], "%127[^=]=%lg", name, &val) != 2)
+        {
+            printf("readPoint: expected var=value, got '%s'\n", args[i]);
+            exit(EXIT_FAILURE);
+        }
+        int var = varId(name);
+        if (var < 0)
+            printf("readPoint: expression has no var '%s', skipped\n", name);
+        else
+            point[var] = val;
+    }
+    return point;
+}
+
+//like readPoint, but args are "var=lo:hi" (or "var=value" for a point) and
+//every var gets an interval, [0, 0] if it is not mentioned
+void Differentator::readBox(char** args, int n_args, double** box_lo, double** box_hi)
+{
+    *box_lo = (double*) calloc ((size_t) n_vars_ + 1, sizeof(double));
+    *box_hi = (double*) calloc ((size_t) n_vars_ + 1, sizeof(double));
+    if (!*box_lo || !*box_hi)
+    {
+        printf("readBox: error finding memory\n");
+        exit(2);
+    }
+    for (int i = 0; i < n_args; i++)
+    {
+        char   name[MAX_NODE_STR_LEN] = {};
+        double lo = 0.0, hi = 0.0;
+        int    n_read = sscanf(args[i], "%127[^=]=%lg:%lg", name, &lo, &hi);
+        if (n_read == 2)
+            hi = lo;
+        if (n_read < 2 || !(lo <= hi))
+        {
+            printf("readBox: expected var=lo:hi, got '%s'\n", args[i]);
+            exit(EXIT_FAILURE);
+        }
+        int var = varId(name);
+        if (var < 0)
+            printf("readBox: expression has no var '%s', skipped\n", name);
+        else
+        {
+            (*box_lo)[var] = lo;
+            (*box_hi)[var] = hi;
+        }
+    }
+}
+
+//Branch and bound for the min of sign * f over the box. prog has f and its
+//n_vars_ partials as outputs. Every box gets interval bounds of f and of the
+//partials and a value of f at its middle, the least of which is an upper
+//bound of the min. A box is dropped when f is above that everywhere in it,
+//or when f is monotone in a var and the box does not reach the side of the
+//whole box f falls to; otherwise it is halved across its widest side. res
+//gets [lo, hi] holding the min, *n_boxes the boxes looked at.
+void Differentator::_boundMin(EvalProgram* prog, const double* box_lo, const double* box_hi,
+                              double sign, double* res, int* n_boxes)
+{
+    //a box is lo[n], hi[n], halvings so far and the lower bound of its parent
+    int     n      = n_vars_;
+    size_t  stride = 2 * (size_t) n + 2;
+    int     cap    = 64;
+    int     top    = 1;
+    double* boxes  = (double*) calloc ((size_t) cap * stride, sizeof(double));
+    double* out_lo = (double*) calloc ((size_t) n + 1, sizeof(double));
+    double* out_hi = (double*) calloc ((size_t) n + 1, sizeof(double));
+    double* vals   = (double*) calloc ((size_t) n + 1, sizeof(double));
+    double* mid    = (double*) calloc ((size_t) n + 1, sizeof(double));
+    if (!boxes || !out_lo || !out_hi || !vals || !mid)
+    {
+        printf("bound: error finding memory for %i vars\n", n);
+        exit(2);
+    }
+    memcpy(boxes,     box_lo, (size_t) n * sizeof(double));
+    memcpy(boxes + n, box_hi, (size_t) n * sizeof(double));
+    boxes[2 * n + 1] = -INFINITY;
+
+    double best = INFINITY, low = INFINITY;
+    int    cnt  = 0;
+    while (top)
+    {
+        double* box = boxes + (size_t) (top - 1) * stride;
+        if (cnt == BOUND_MAX_BOXES)
+        {
+            low = (box[2 * n + 1] < low)?box[2 * n + 1]:low;
+            top--;
+            continue;
+        }
+        cnt++;
+        prog->evalInterval(box, box + n, out_lo, out_hi);
+        double f_lo = (sign > 0)?out_lo[0]:-out_hi[0];
+        if (f_lo > best)
+        {
+            top--;
+            continue;
+        }
+
+        int drop = 0, moved = 0;
+        for (int j = 0; j < n && !drop; j++)
+        {
+            double g_lo = (sign > 0)?out_lo[j + 1]:-out_hi[j + 1];
+            double g_hi = (sign > 0)?out_hi[j + 1]:-out_lo[j + 1];
+            if (!(box[j] < box[n + j]) || (g_lo <= 0.0 && g_hi >= 0.0))
+                continue;
+            //increasing in var j: the min is at the low side, decreasing: at the high one
+            if ((g_lo > 0.0)?box[j] > box_lo[j]:box[n + j] < box_hi[j])
+                drop = 1;
+            else
+            {
+                box[j] = box[n + j] = (g_lo > 0.0)?box_lo[j]:box_hi[j];
+                moved = 1;
+            }
+        }
+        if (drop)
+        {
+            top--;
+            continue;
+        }
+        if (moved)
+            continue;
+
+        int widest = 0;
+        for (int j = 0; j < n; j++)
+        {
+            mid[j] = 0.5 * (box[j] + box[n + j]);
+            if (box[n + j] - box[j] > box[n + widest] - box[widest])
+                widest = j;
+        }
+        prog->eval(mid, vals);
+        if (sign * vals[0] < best)
+            best = sign * vals[0];
+        if (f_lo >= best || !n || !(box[n + widest] > box[widest]) || box[2 * n] >= BOUND_MAX_DEPTH)
+        {
+            low = (f_lo < low)?f_lo:low;
+            top--;
+            continue;
+        }
+
+        if (top == cap)
+        {
+            cap  *= 2;
+            boxes = (double*) realloc (boxes, (size_t) cap * stride * sizeof(double));
+            if (!boxes)
+            {
+                printf("bound: error finding memory for %i boxes\n", cap);
+                exit(2);
+            }
+            box = boxes + (size_t) (top - 1) * stride;
+        }
+        double* half = box + stride;
+        memcpy(half, box, stride * sizeof(double));
+        box[n + widest] = half[widest] = mid[widest];
+        box[2 * n]     += 1;
+        half[2 * n]    += 1;
+        box[2 * n + 1]  = half[2 * n + 1] = f_lo;
+        top++;
+    }
+    res[0] = (low < best)?low:best;
+    res[1] = best;
+    *n_boxes = cnt;
+
+    free(boxes);
+    free(out_lo);
+    free(out_hi);
+    free(vals);
+    free(mid);
+}
+
+static void print_interval(FILE* file, const char* name, double lo, double hi)
+{
+    char num_lo[NUM_PRINT_LEN] = {}, num_hi[NUM_PRINT_LEN] = {};
+    num_print(lo, num_lo);
+    num_print(hi, num_hi);
+    fprintf(file, "%s [%s, %s]", name, num_lo, num_hi);
+}
+
+void Differentator::bound(const double* box_lo, const double* box_hi)
+{
+    alterTree(&root_);
+    shareSubtrees(&root_);
+    Node** grad = gradient(root_);
+
+    EvalProgram prog;
+    prog.keepPowers();
+    if (reassoc_)
+        prog.balanceChains();
+    prog.addOutput(root_);
+    for (int j = 0; j < n_vars_; j++)
+        prog.addOutput(grad[j]);
+
+    double* out_lo = (double*) calloc ((size_t) n_vars_ + 1, sizeof(double));
+    double* out_hi = (double*) calloc ((size_t) n_vars_ + 1, sizeof(double));
+    if (!out_lo || !out_hi)
+    {
+        printf("bound: error finding memory for %i vars\n", n_vars_);
+        exit(2);
+    }
+    prog.evalInterval(box_lo, box_hi, out_lo, out_hi);
+
+    fprintf(file_to_write_, "box:");
+    for (int j = 0; j < n_vars_; j++)
+    {
+        fprintf(file_to_write_, " ");
+        print_interval(file_to_write_, vars_[j], box_lo[j], box_hi[j]);
+    }
+    fprintf(file_to_write_, "\n");
+    print_interval(file_to_write_, "f", out_lo[0], out_hi[0]);
+    fprintf(file_to_write_, "\n");
+    for (int j = 0; j < n_vars_; j++)
+    {
+        char name[MAX_NODE_STR_LEN + 2] = {};
+        snprintf(name, sizeof(name), "d/d%s", vars_[j]);
+        print_interval(file_to_write_, name, out_lo[j + 1], out_hi[j + 1]);
+        fprintf(file_to_write_, "\n");
+    }
+
+    double res[2] = {};
+    int n_boxes = 0;
+    _boundMin(&prog, box_lo, box_hi, 1.0, res, &n_boxes);
+    print_interval(file_to_write_, "min", res[0], res[1]);
+    fprintf(file_to_write_, " after %i boxes\n", n_boxes);
+    _boundMin(&prog, box_lo, box_hi, -1.0, res, &n_boxes);
+    print_interval(file_to_write_, "max", -res[1], -res[0]);
+    fprintf(file_to_write_, " after %i boxes\n", n_boxes);
 
-    new_r->left_dec_  = left_dec->Dup();
-    new_r->right_dec_ = _derivative(right_dec);
-    new_sum_node->left_dec_  = new_l;
-    new_sum_node->right_dec_ = new_r;
-    return new_sum_node;
+    for (int j = 0; j < n_vars_; j++)
+        delete_subTree(&grad[j]);
+    free(grad);
+    free(out_lo);
+    free(out_hi);
 }
 
-Node* Differentator::_nodeDerivDiv(Node* left_dec, Node* right_dec)
+//Newton from n_starts points spread evenly over lo:hi of var_range
+//("x=lo:hi"), the other vars are fixed at point. f' is compiled into one
+//program with f; the starts are split between threads.
+void Differentator::solve(const char* var_range, int n_starts, const double* point)
 {
-    Node* res_node   = new Node('/');
-    Node* new_l      = new Node('-');
+    char   name[MAX_NODE_STR_LEN] = {};
+    double lo = 0.0, hi = 0.0;
+    int    n_read = sscanf(var_range, "%127[^=]=%lg:%lg", name, &lo, &hi);
+    if (n_read == 2)
+        hi = lo;
+    int var = varId(name);
+    if (n_read < 2 || var < 0 || n_starts < 1)
+    {
+        printf("solve: expected var=lo:hi of a var of the expression and a count of starts, got '%s' %i\n",
+               var_range, n_starts);
+        exit(EXIT_FAILURE);
+    }
 
-    Node* new_ll     = new Node('*');
-    Node* new_lr     = new Node('*');
-    new_ll->left_dec_   = _derivative(left_dec);
-    new_ll->right_dec_  = right_dec->Dup();
-    new_lr->left_dec_   = left_dec->Dup();
-    new_lr->right_dec_  = _derivative(right_dec);
+    alterTree(&root_);
+    shareSubtrees(&root_);
+    Node* deriv = partial(root_, var);
+    EvalProgram prog;
+    if (reassoc_)
+        prog.balanceChains();
+    prog.addOutput(root_);
+    prog.addOutput(deriv);
 
-    Node* new_r         = _nodePow(right_dec, 2.0);
-    
-    new_l->left_dec_  = new_ll;
-    new_l->right_dec_ = new_lr;
+    double* zeros  = (double*) calloc ((size_t) n_vars_ + 1, sizeof(double));
+    double* x      = (double*) calloc ((size_t) n_starts, sizeof(double));
+    double* starts = (double*) calloc ((size_t) n_starts, sizeof(double));
+    int*    iters  = (int*)    calloc ((size_t) n_starts, sizeof(int));
+    int*    status = (int*)    calloc ((size_t) n_starts, sizeof(int));
+    if (!zeros || !x || !starts || !iters || !status)
+    {
+        printf("solve: error finding memory for %i starts\n", n_starts);
+        exit(2);
+    }
+    for (int i = 0; i < n_starts; i++)
+        x[i] = starts[i] = (n_starts > 1)?lo + (hi - lo) * i / (n_starts - 1):lo;
 
-    res_node->left_dec_  = new_l;
-    res_node->right_dec_ = new_r;
+    //whole blocks per thread
+    int n_blocks  = (n_starts + EVAL_BLOCK - 1) / EVAL_BLOCK;
+    int n_threads = thread_count(n_blocks);
+    int per_job   = (n_blocks + n_threads - 1) / n_threads * EVAL_BLOCK;
+    SolveJob jobs[MAX_THREADS] = {};
+    for (int t = 0; t < n_threads; t++)
+    {
+        jobs[t] = {&prog, var, n_vars_, (point)?point:zeros, x, iters, status,
+                   (t * per_job < n_starts)?t * per_job:n_starts,
+                   ((t + 1) * per_job < n_starts)?(t + 1) * per_job:n_starts};
+    }
+    run_threads(solve_thread, jobs, sizeof(SolveJob), n_threads);
 
-    return res_node;
+    int  counts[SOLVE_STATUS_CNT] = {};
+    char num_start[NUM_PRINT_LEN] = {}, num_root[NUM_PRINT_LEN] = {};
+    fprintf(file_to_write_, "start root iterations status\n");
+    for (int i = 0; i < n_starts; i++)
+    {
+        num_print(starts[i], num_start);
+        num_print(x[i], num_root);
+        fprintf(file_to_write_, "%s %s %i %s\n", num_start, num_root, iters[i], solve_status_names[status[i]]);
+        counts[status[i]]++;
+    }
+    printf("solve: %i starts on %i threads:", n_starts, n_threads);
+    for (int s = SOLVE_CONVERGED; s < SOLVE_STATUS_CNT; s++)
+        printf(" %i %s", counts[s], solve_status_names[s]);
+    printf("\n");
+
+    delete_subTree(&deriv);
+    free(zeros);
+    free(x);
+    free(starts);
+    free(iters);
+    free(status);
 }
 
-Node* Differentator::_nodeDerivPow(Node* left_dec, Node* right_dec)
+//L-BFGS from n_starts points spread over the box, every var is free. Starts
+//are the same from run to run: a xorshift sequence seeded by the start index.
+void Differentator::minimize(int n_starts, const double* box_lo, const double* box_hi)
 {
-    Node* res_node       = new Node('*');
-    res_node->left_dec_  = new Node('*');
-    res_node->left_dec_->left_dec_  = new Node(right_dec->data_);
-    res_node->left_dec_->right_dec_ = new Node('^');
-    res_node->left_dec_->right_dec_->left_dec_ = left_dec->Dup();
-    double degree = 0.0;
-    if (sscanf(right_dec->data_, "%lg", &degree))
-        res_node->left_dec_->right_dec_->right_dec_ = new Node(degree - 1.0);
-    else
+    if (n_starts < 1)
+    {
+        printf("minimize: expected a count of starts, got %i\n", n_starts);
+        exit(EXIT_FAILURE);
+    }
+    alterTree(&root_);
+    shareSubtrees(&root_);
+    Node** grad = gradient(root_);
+    EvalProgram prog;
+    if (reassoc_)
+        prog.balanceChains();
+    prog.addOutput(root_);
+    for (int j = 0; j < n_vars_; j++)
+        prog.addOutput(grad[j]);
+
+    int     nv     = n_vars_;
+    double* x      = (double*) calloc ((size_t) n_starts * (size_t) nv + 1, sizeof(double));
+    double* f      = (double*) calloc ((size_t) n_starts, sizeof(double));
+    int*    iters  = (int*)    calloc ((size_t) n_starts, sizeof(int));
+    int*    status = (int*)    calloc ((size_t) n_starts, sizeof(int));
+    if (!x || !f || !iters || !status)
     {
-        printf("error reading degree value\n");
-        exit(1);
+        printf("minimize: error finding memory for %i starts\n", n_starts);
+        exit(2);
     }
-    res_node->right_dec_ = _derivative(left_dec);
-    return res_node;
+    for (int i = 0; i < n_starts; i++)
+    {
+        unsigned long long rnd = hash_mix((unsigned long long) i + 1);
+        for (int j = 0; j < nv; j++)
+        {
+            rnd ^= rnd << 13;
+            rnd ^= rnd >> 7;
+            rnd ^= rnd << 17;
+            double u = (double) (rnd >> 11) * ldexp(1.0, -53);
+            x[(size_t) i * (size_t) nv + (size_t) j] = (n_starts > 1)?box_lo[j] + (box_hi[j] - box_lo[j]) * u:
+                                                                      0.5 * (box_lo[j] + box_hi[j]);
+        }
+    }
+
+    int n_blocks  = (n_starts + EVAL_BLOCK - 1) / EVAL_BLOCK;
+    int n_threads = thread_count(n_blocks);
+    int per_job   = (n_blocks + n_threads - 1) / n_threads * EVAL_BLOCK;
+    MinimizeJob jobs[MAX_THREADS] = {};
+    for (int t = 0; t < n_threads; t++)
+    {
+        jobs[t] = {&prog, nv, x, f, iters, status,
+                   (t * per_job < n_starts)?t * per_job:n_starts,
+                   ((t + 1) * per_job < n_starts)?(t + 1) * per_job:n_starts};
+    }
+    run_threads(minimize_thread, jobs, sizeof(MinimizeJob), n_threads);
+
+    int  counts[SOLVE_STATUS_CNT] = {};
+    int  best = 0;
+    char num[NUM_PRINT_LEN] = {};
+    fprintf(file_to_write_, "f");
+    for (int j = 0; j < nv; j++)
+        fprintf(file_to_write_, " %s", vars_[j]);
+    fprintf(file_to_write_, " iterations status\n");
+    for (int i = 0; i < n_starts; i++)
+    {
+        num_print(f[i], num);
+        fprintf(file_to_write_, "%s", num);
+        for (int j = 0; j < nv; j++)
+        {
+            num_print(x[(size_t) i * (size_t) nv + (size_t) j], num);
+            fprintf(file_to_write_, " %s", num);
+        }
+        fprintf(file_to_write_, " %i %s\n", iters[i], solve_status_names[status[i]]);
+        counts[status[i]]++;
+        if (f[i] < f[best])
+            best = i;
+    }
+    num_print(f[best], num);
+    printf("minimize: %i starts on %i threads, least f %s:", n_starts, n_threads, num);
+    for (int s = SOLVE_CONVERGED; s < SOLVE_STATUS_CNT; s++)
+        printf(" %i %s", counts[s], solve_status_names[s]);
+    printf("\n");
+
+    for (int j = 0; j < nv; j++)
+        delete_subTree(&grad[j]);
+    free(grad);
+    free(x);
+    free(f);
+    free(iters);
+    free(status);
 }
 
-Node* Differentator::_nodePow(Node* left_node, double deg)
+//Up to n_samples points of f and f' by var over a:b of var_range ("x=a:b"),
+//the other vars fixed at point. Sampling starts from a uniform grid; every
+//round the quarter of the intervals whose linear interpolation is off the
+//most, by h |f'(x1) - f'(x0)| / 8, get their midpoints (fewer if the count
+//is nearly reached), so the points gather where f bends. It ends
+//early when no interval is off by more than SAMPLE_TOL of the range of f.
+//Writes "var,f,df/dvar" lines, or raw doubles x, f, f' per point with bin_out_.
+void Differentator::sample(const char* var_range, int n_samples, const double* point)
 {
-    Node* pow_node       = new Node('^');
-    pow_node->left_dec_  = left_node->Dup();
-    pow_node->right_dec_ = new Node(deg);
-    return pow_node;
+    char   name[MAX_NODE_STR_LEN] = {};
+    double lo = 0.0, hi = 0.0;
+    int var = (sscanf(var_range, "%127[^=]=%lg:%lg", name, &lo, &hi) == 3)?varId(name):-1;
+    if (var < 0 || !(lo < hi) || n_samples < 2)
+    {
+        printf("sample: expected var=a:b of a var of the expression and a count of at least 2, got '%s' %i\n",
+               var_range, n_samples);
+        exit(EXIT_FAILURE);
+    }
+    alterTree(&root_);
+    shareSubtrees(&root_);
+    Node* deriv = partial(root_, var);
+    EvalProgram prog;
+    if (reassoc_)
+        prog.balanceChains();
+    prog.addOutput(root_);
+    prog.addOutput(deriv);
+
+    //x, f, f' of the sorted points, and the same for the next round to be merged into
+    size_t  cap   = (size_t) n_samples;
+    double* pts   = (double*) calloc (6 * cap, sizeof(double));
+    double* mids  = (double*) calloc (cap, sizeof(double));
+    double* vars  = (double*) calloc ((size_t) n_vars_ * cap + 1, sizeof(double));
+    double* res   = (double*) calloc (2 * cap, sizeof(double));
+    double* errs  = (double*) calloc (cap, sizeof(double));
+    double* order = (double*) calloc (cap, sizeof(double));
+    double* zeros = (double*) calloc ((size_t) n_vars_ + 1, sizeof(double));
+    if (!pts || !mids || !vars || !res || !errs || !order || !zeros)
+    {
+        printf("sample: error finding memory for %i points\n", n_samples);
+        exit(2);
+    }
+    double* x    = pts;
+    double* f    = pts + cap;
+    double* df   = pts + 2 * cap;
+    double* x_n  = pts + 3 * cap;
+    double* f_n  = pts + 4 * cap;
+    double* df_n = pts + 5 * cap;
+    point = (point)?point:zeros;
+
+    int n = (n_samples / 8 > SAMPLE_MIN_START)?n_samples / 8:
+            (n_samples < SAMPLE_MIN_START)?n_samples:SAMPLE_MIN_START;
+    for (int p = 0; p < n; p++)
+        x[p] = (p == n - 1)?hi:lo + (hi - lo) * p / (n - 1);
+    sample_eval(&prog, n_vars_, var, point, x, n, vars, res);
+    for (int p = 0; p < n; p++)
+    {
+        f[p]  = res[p];
+        df[p] = res[n + p];
+    }
+    int n_rounds = 0;
+    while (n < n_samples)
+    {
+        double f_min = INFINITY, f_max = -INFINITY;
+        for (int p = 0; p < n; p++)
+            if (std::isfinite(f[p]))
+            {
+                f_min = (f[p] < f_min)?f[p]:f_min;
+                f_max = (f[p] > f_max)?f[p]:f_max;
+            }
+        double tol = SAMPLE_TOL * (1.0 + ((f_max > f_min)?f_max - f_min:0.0));
+        for (int i = 0; i < n - 1; i++)
+        {
+            double err = (x[i + 1] - x[i]) * fabs(df[i + 1] - df[i]) / 8;
+            double mid = 0.5 * (x[i] + x[i + 1]);
+            //poles and undefined stretches get refined first, intervals too narrow to split never
+            errs[i] = !(mid > x[i] && mid < x[i + 1])?0.0:std::isnan(err)?INFINITY:err;
+        }
+        int k = ((n - 1) / 4 > 1)?(n - 1) / 4:1;
+        k = (n_samples - n < k)?n_samples - n:k;
+        memcpy(order, errs, (size_t) (n - 1) * sizeof(double));
+        qsort(order, (size_t) (n - 1), sizeof(double), cmp_doubles_desc);
+        double threshold = order[k - 1];
+
+        int m = 0;
+        for (int i = 0; i < n - 1 && m < k; i++)
+            if (errs[i] >= threshold && errs[i] > tol)
+                mids[m++] = 0.5 * (x[i] + x[i + 1]);
+        if (!m)
+            break;
+        sample_eval(&prog, n_vars_, var, point, mids, m, vars, res);
+
+        int j = 0, q = 0;
+        for (int i = 0; i < n; i++)
+        {
+            x_n[q]  = x[i];
+            f_n[q]  = f[i];
+            df_n[q] = df[i];
+            q++;
+            if (j < m && i < n - 1 && mids[j] > x[i] && mids[j] < x[i + 1])
+            {
+                x_n[q]  = mids[j];
+                f_n[q]  = res[j];
+                df_n[q] = res[m + j];
+                q++;
+                j++;
+            }
+        }
+        double* tmp = NULL;
+        tmp = x;  x  = x_n;  x_n  = tmp;
+        tmp = f;  f  = f_n;  f_n  = tmp;
+        tmp = df; df = df_n; df_n = tmp;
+        n = q;
+        n_rounds++;
+    }
+
+    char num[NUM_PRINT_LEN] = {};
+    if (!bin_out_)
+        fprintf(file_to_write_, "%s,f,df/d%s\n", vars_[var], vars_[var]);
+    for (int p = 0; p < n; p++)
+        if (bin_out_)
+        {
+            double row[3] = {x[p], f[p], df[p]};
+            fwrite(row, sizeof(double), 3, file_to_write_);
+        }
+        else
+        {
+            num_print(x[p], num);
+            fprintf(file_to_write_, "%s,", num);
+            num_print(f[p], num);
+            fprintf(file_to_write_, "%s,", num);
+            num_print(df[p], num);
+            fprintf(file_to_write_, "%s\n", num);
+        }
+    printf("sample: %i points after %i rounds of refining\n", n, n_rounds);
+
+    delete_subTree(&deriv);
+    free(pts);
+    free(mids);
+    free(vars);
+    free(res);
+    free(errs);
+    free(order);
+    free(zeros);
 }
 
-#define L_BRANCH curNodePtr->left_dec_
-#define R_BRANCH curNodePtr->right_dec_
-Node* Differentator::_derivative(Node* curNodePtr)
+//Streams the points of a data file through the outputs named in outs: "f"
+//or "d/dvar" for a partial. A csv file starts with a line of column names,
+//columns that are not vars are skipped and vars without a column are 0; a
+//*.bin file is raw doubles, a row per point with a column per var, in the
+//order the vars first appear in the expression. The file is mapped and goes
+//EVAL_CHUNK points at a time through eval_threads, and the pages behind are
+//dropped, so memory stays the same whatever the size of the file.
+void Differentator::evalFile(const char* data_path, char** outs, int n_outs)
 {
-    //printf("in _derivative: curNode %p: [%s]\n", curNodePtr, curNodePtr->data_);
-	if (!curNodePtr) goto skip;
-    switch(curNodePtr->type_)
+    alterTree(&root_);
+    shareSubtrees(&root_);
+    EvalProgram prog;
+    if (reassoc_)
+        prog.balanceChains();
+    Node** heads = (Node**) calloc ((size_t) n_outs + 1, sizeof(Node*));
+    if (!heads)
     {
-        case TYPE_DEF:
-            printf("_derivative: node %p: '%s' type is not set\n", curNodePtr, curNodePtr->data_);
-            exit(4);
-        case TYPE_CONST:
+        printf("eval: error finding memory for %i outputs\n", n_outs);
+        exit(2);
+    }
+    for (int i = 0; i < n_outs; i++)
+    {
+        int var = (!strncmp(outs[i], "d/d", 3))?varId(outs[i] + 3):-1;
+        if (strcmp(outs[i], "f") && var < 0)
         {
-            return new Node('0');
+            printf("eval: expected f or d/dvar of a var of the expression, got '%s'\n", outs[i]);
+            exit(EXIT_FAILURE);
         }
-        case TYPE_VAR:
+        heads[i] = (var < 0)?NULL:partial(root_, var);
+        prog.addOutput((heads[i])?heads[i]:root_);
+    }
+
+    int fd = open(data_path, O_RDONLY);
+    struct stat st = {};
+    if (fd < 0 || fstat(fd, &st) || !st.st_size)
+    {
+        printf("eval: can not open data file '%s' or it is empty\n", data_path);
+        exit(EXIT_FAILURE);
+    }
+    size_t size = (size_t) st.st_size;
+    char*  base = (char*) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED)
+    {
+        printf("eval: can not map data file '%s'\n", data_path);
+        exit(EXIT_FAILURE);
+    }
+    madvise(base, size, MADV_SEQUENTIAL);
+    const char* pos  = base;
+    const char* end  = base + size;
+    size_t      len  = strlen(data_path);
+    int         nv   = n_vars_;
+    int         raw  = (len > 4 && !strcmp(data_path + len - 4, ".bin"));
+    if (raw && (!nv || size % ((size_t) nv * sizeof(double))))
+    {
+        printf("eval: '%s' is not rows of %i doubles\n", data_path, nv);
+        exit(EXIT_FAILURE);
+    }
+
+    //csv header: var of every column, -1 for the skipped ones
+    int* col_var = NULL;
+    int  n_cols  = 0;
+    int  n_named = 0;
+    long long line = 2;     //of the row being read
+    if (!raw)
+    {
+        const char* eol = (const char*) memchr(pos, '\n', (size_t) (end - pos));
+        eol = (eol)?eol:end;
+        col_var = (int*) calloc ((size_t) (eol - pos) + 2, sizeof(int));
+        if (!col_var)
         {
-            return new Node('1');
+            printf("eval: error finding memory for the header\n");
+            exit(2);
         }
-        case TYPE_ACT:
-            switch(curNodePtr->data_[0])
+        while (pos < eol)
+        {
+            const char* comma = (const char*) memchr(pos, ',', (size_t) (eol - pos));
+            const char* stop  = (comma)?comma:eol;
+            char name[MAX_NODE_STR_LEN] = {};
+            while (pos < stop && isspace(*pos))
+                pos++;
+            int n = 0;
+            for (; pos < stop && !isspace(*pos) && n < MAX_NODE_STR_LEN - 1; pos++)
+                name[n++] = *pos;
+            col_var[n_cols++] = varId(name);
+            n_named += (n > 0);
+            pos = (comma)?comma + 1:stop;
+        }
+        if (!n_named)
+        {
+            printf("eval: the first line of '%s' must name its columns\n", data_path);
+            exit(EXIT_FAILURE);
+        }
+        pos = (eol < end)?eol + 1:end;
+        for (int v = 0; v < nv; v++)
+        {
+            int found = 0;
+            for (int c = 0; c < n_cols; c++)
+                found |= (col_var[c] == v);
+            if (!found)
+                printf("eval: data file has no column '%s', it is 0\n", vars_[v]);
+        }
+    }
+    else
+    {
+        printf("eval: binary columns");
+        for (int v = 0; v < nv; v++)
+            printf(" %s", vars_[v]);
+        printf("\n");
+    }
+
+    double* rows = (double*) calloc ((size_t) nv * EVAL_CHUNK + 1, sizeof(double));
+    double* vars = (double*) calloc ((size_t) nv * EVAL_CHUNK + 1, sizeof(double));
+    double* res  = (double*) calloc ((size_t) n_outs * EVAL_CHUNK + 1, sizeof(double));
+    if (!rows || !vars || !res)
+    {
+        printf("eval: error finding memory for a chunk of %i points\n", EVAL_CHUNK);
+        exit(2);
+    }
+    if (!bin_out_)
+        for (int i = 0; i < n_outs; i++)
+            fprintf(file_to_write_, (i < n_outs - 1)?"%s,":"%s\n", outs[i]);
+
+    long long   n_points = 0;
+    size_t      page     = (size_t) sysconf(_SC_PAGESIZE);
+    char*       dropped  = base;
+    char        num[NUM_PRINT_LEN] = {};
+    while (pos < end)
+    {
+        int m = 0;
+        if (raw)
+        {
+            size_t row_size = (size_t) nv * sizeof(double);
+            m = ((size_t) (end - pos) / row_size < EVAL_CHUNK)?(int) ((size_t) (end - pos) / row_size):EVAL_CHUNK;
+            memcpy(rows, pos, (size_t) m * row_size);
+            pos += (size_t) m * row_size;
+        }
+        else
+            for (; m < EVAL_CHUNK && pos < end; line++)
             {
-                case '+':
-                    return _nodeDerivSum(L_BRANCH, R_BRANCH);
-                case '-':
-                    return _nodeDerivSub(L_BRANCH, R_BRANCH);
-                case '*':
-                    return _nodeDerivMul(L_BRANCH, R_BRANCH);
-                case '/':
-                    return _nodeDerivDiv(L_BRANCH, R_BRANCH);
-                case '^':
+                if (*pos == '\n' || *pos == '\r')
                 {
-                    double degree = 0.0;
-                    if (sscanf(curNodePtr->right_dec_->data_, "%lg", &degree))
-					{
-                        if (!_d_equal(degree, 0.0))
-                            return _nodeDerivPow(L_BRANCH, R_BRANCH);
-					}
-                    else
+                    pos++;
+                    continue;
+                }
+                const char* row_start = pos;
+                double* row = rows + (size_t) m * (size_t) nv;
+                memset(row, 0, (size_t) nv * sizeof(double));
+                for (int c = 0; c < n_cols; c++)
+                {
+                    double val = 0.0;
+                    while (pos < end && (*pos == ' ' || *pos == '\t'))
+                        pos++;
+                    const char* next = num_parse(pos, end, &val);
+                    if (next)
+                        for (pos = next; pos < end && (*pos == ' ' || *pos == '\t');)
+                            pos++;
+                    char expect = (c < n_cols - 1)?',':'\n';
+                    if (!next || (pos < end && *pos != expect && !(expect == '\n' && *pos == '\r')))
                     {
-                        printf("error reading degree val\n");
-                        exit(6);
+                        printf("eval: line %lld of '%s': expected %i numbers separated by ','\n",
+                               line, data_path, n_cols);
+                        exit(EXIT_FAILURE);
                     }
+                    if (col_var[c] >= 0)
+                        row[col_var[c]] = val;
+                    pos += (pos < end && *pos == ',');
+                }
+                if (pos == row_start)
+                {
+                    printf("eval: line %lld of '%s' has no numbers\n", line, data_path);
+                    exit(EXIT_FAILURE);
+                }
+                pos += (pos < end && *pos == '\r');
+                pos += (pos < end && *pos == '\n');
+                m++;
+            }
+        if (!m)
+            break;
 
+        for (int p = 0; p < m; p++)
+            for (int v = 0; v < nv; v++)
+                vars[(size_t) (v * m + p)] = rows[(size_t) p * (size_t) nv + (size_t) v];
+        eval_threads(&prog, nv, vars, m, res);
+        for (int p = 0; p < m; p++)
+            for (int i = 0; i < n_outs; i++)
+            {
+                double val = res[(size_t) (i * m + p)];
+                if (bin_out_)
+                    fwrite(&val, sizeof(double), 1, file_to_write_);
+                else
+                {
+                    num_print(val, num);
+                    fprintf(file_to_write_, (i < n_outs - 1)?"%s,":"%s\n", num);
                 }
-                default:
-                    printf("Cannot distinguish act char; worked at %i line\n", __LINE__);
-                    inFilePrint_dot(curNodePtr);
-                    curNodePtr->printNode();
-                    printf("\n");
-                    _printTree(curNodePtr);
-                    printf("\n");
-                    exit(0);
             }
-        case TYPE_FUNC:
-#define _FUNCTIONS_
-#define MATH_FUNC(funcName, notused)\
-            if (!strcmp(curNodePtr->data_, #funcName))\
-                return _##funcName##Der(curNodePtr);
-#include "MATH_FUNCTIONS"
-#undef MATH_FUNC
-#undef _FUNCTIONS_
-        default:
-            printf("Node type is not set or is not recognised; worked at %i line\n", __LINE__);
-            curNodePtr->printNode();
-            exit(0);
+        n_points += m;
 
+        //the pages read so far are not needed again
+        size_t done = (size_t) (pos - dropped) / page * page;
+        if (done)
+        {
+            madvise(dropped, done, MADV_DONTNEED);
+            dropped += done;
+        }
     }
-	skip: return NULL;
-}
+    printf("eval: %lld points of %i outputs\n", n_points, n_outs);
 
-Node* Differentator::_lnDer(Node* curNodePtr)
-{
-    Node* res_node      = new Node('*');
-    res_node->left_dec_ = new Node('/');
-    res_node->left_dec_->left_dec_  = new Node("1");
-    res_node->left_dec_->right_dec_ = curNodePtr->left_dec_->Dup();
-    res_node->right_dec_ = _derivative(L_BRANCH);
-    return res_node;
+    munmap(base, size);
+    close(fd);
+    for (int i = 0; i < n_outs; i++)
+        delete_subTree(&heads[i]);
+    free(heads);
+    free(col_var);
+    free(rows);
+    free(vars);
+    free(res);
 }
 
-Node* Differentator::_sinDer(Node* curNodePtr)
+void Differentator::hessian(const double* point)
 {
-    Node* res_node = new Node('*');
-    Node* new_l = curNodePtr->Dup();
-    sprintf(new_l->data_, "cos"); 
-    Node* new_r = _derivative(curNodePtr->left_dec_);
+    SparseHessian hes = {};
+    alterTree(&root_);
+    shareSubtrees(&root_);
+    hessian(root_, &hes);
 
-    res_node->left_dec_  = new_l;
-    res_node->right_dec_ = new_r;
-    return res_node;
-}
+    fprintf(file_to_write_, "hessian of %i vars, %i non-zero upper-triangle entries of %i\n",
+                            n_vars_, hes.nnz_, n_vars_ * (n_vars_ + 1) / 2);
+    _letBuild(hes.entries_, hes.nnz_);
+    _letWrite();
+    fprintf(file_to_write_, "COO\n");
+    for (int k = 0; k < hes.nnz_; k++)
+    {
+        fprintf(file_to_write_, "%i %i d2/d%sd%s ", hes.rows_[k], hes.cols_[k],
+                                vars_[hes.rows_[k]], vars_[hes.cols_[k]]);
+        _inFilePrint(hes.entries_[k]);
+        fprintf(file_to_write_, "\n");
+    }
+    fprintf(file_to_write_, "CSR\nrow_ptr:");
+    for (int i = 0; i <= n_vars_; i++)
+        fprintf(file_to_write_, " %i", hes.row_ptr_[i]);
+    fprintf(file_to_write_, "\ncol_idx:");
+    for (int k = 0; k < hes.nnz_; k++)
+        fprintf(file_to_write_, " %i", hes.cols_[k]);
+    fprintf(file_to_write_, "\n");
 
-#undef L_BRANCH
-#undef R_BRANCH
+    if (point)
+    {
+        EvalProgram prog;
+        if (reassoc_)
+            prog.balanceChains();
+        for (int k = 0; k < hes.nnz_; k++)
+            prog.addOutput(hes.entries_[k]);
+        double* vals = (double*) calloc ((size_t) hes.nnz_ + 1, sizeof(double));
+        if (!vals)
+        {
+            printf("hessian: error finding memory for values\n");
+            exit(2);
+        }
+        prog.eval(point, vals);
+        char num[NUM_PRINT_LEN] = {};
+        fprintf(file_to_write_, "values:");
+        for (int k = 0; k < hes.nnz_; k++)
+        {
+            num_print(vals[k], num);
+            fprintf(file_to_write_, " %s", num);
+        }
+        fprintf(file_to_write_, "\n");
+        free(vals);
+    }
+    _letFree();
+    freeHessian(&hes);
+}
 
-void Differentator::derivative()
+void Differentator::taylor(const char* var_at, int order, const double* point)
 {
-    inFilePrint_dot(root_);
-    alterTree(&root_);
-    inFilePrint_dot(root_);
-
-    printf("BEFORE DERIVATING ORIGIN TREE:  ");
-    printTree(root_);
-    printf("\n\n");
-    new_root_ = _derivative(root_);
+    char   name[MAX_NODE_STR_LEN] = {};
+    double at = 0.0;
+    if (sscanf(var_at, "%127[^=]=%lg", name, &at) != 2 || order < 0)
+    {
+        printf("taylor: expected var=point and a non-negative order, got '%s' %i\n", var_at, order);
+        exit(EXIT_FAILURE);
+    }
+    int var = varId(name);
+    if (var < 0)
+        printf("taylor: expression has no var '%s', series is a constant\n", name);
 
-    printf("RIGHT AFTER DERIVATING ORIGIN TREE:  ");
-    printTree(new_root_);
-    printf("\n\n");
+    double* vars   = (double*) calloc ((size_t) n_vars_ + 1, sizeof(double));
+    double* coeffs = (double*) calloc ((size_t) order + 1,   sizeof(double));
+    if (!vars || !coeffs)
+    {
+        printf("taylor: error finding memory for %i coefficients\n", order + 1);
+        exit(2);
+    }
+    if (point)
+        memcpy(vars, point, (size_t) n_vars_ * sizeof(double));
+    if (var >= 0)
+        vars[var] = at;
 
-    inFilePrint_dot(new_root_);
+    alterTree(&root_);
+    shareSubtrees(&root_);
+    EvalProgram prog;
+    if (reassoc_)
+        prog.balanceChains();
+    prog.addOutput(root_);
+    prog.evalTaylor(vars, var, order, coeffs);
 
-    printf("BEFORE ALTERING NEW TREE:  ");
-    printTree(new_root_);
-    printf("\n\n");
-    alterTree(&new_root_);
+    char num[NUM_PRINT_LEN] = {};
+    num_print(at, num);
+    fprintf(file_to_write_, "taylor series by %s at %s, order %i\n", name, num, order);
+    for (int k = 0; k <= order; k++)
+    {
+        num_print(coeffs[k], num);
+        fprintf(file_to_write_, "%i %s\n", k, num);
+    }
 
-    printf("after ALTERING NEW TREE:  ");
-    printTree(new_root_);
-    printf("\n\n");
-    inFilePrint_dot(root_);
-    inFilePrint_dot(new_root_);
+    //the same polynomial as a tree: sum of c_k * (var - at)^k
+    Node* poly = NULL;
+    for (int k = 0; k <= order; k++)
+    {
+        if (exact_equal(coeffs[k], 0.0))
+            continue;
+        Node* term = new Node(coeffs[k]);
+        if (k && var >= 0)
+        {
+            Node* shift = new Node('-');
+            shift->left_dec_ = new Node(name);
+            shift->left_dec_->var_id_ = var;
+            shift->right_dec_ = new Node(at);
+            Node* mul = new Node('*');
+            mul->left_dec_  = term;
+            mul->right_dec_ = _nodePow(shift, (double) k);
+            delete_subTree(&shift);
+            term = mul;
+        }
+        if (poly)
+        {
+            Node* sum = new Node('+');
+            sum->left_dec_  = poly;
+            sum->right_dec_ = term;
+            term = sum;
+        }
+        poly = term;
+    }
+    if (!poly)
+        poly = new Node('0');
+    alterTree(&poly);
+    _inFilePrint(poly);
+    fprintf(file_to_write_, "\n");
 
-    printf("BEFORE FINAL WRITING IN FILE ORIGIN TREE ");
-    printTree(root_);
-    printf("\n\n");
-    inFilePrint_tex(root_, new_root_);
+    delete_subTree(&poly);
+    free(vars);
+    free(coeffs);
 }
 
 int main(int argc, char* argv[])
 {
     if (argc < 3)
     {
-        printf("Usage: %s [expression_file] [resfile]\n", argv[0]);
+        printf("Usage: %s [expression_file] [resfile] [mode] [--cache=file] [--let[=size]] [--reassoc] [--render=mode]\n"
+               "modes: deriv [var [var=value ...]]  derivative by var (x by default), with f and f' at the point if given\n"
+               "       jacobian     partials of every expression line by every var\n"
+               "       hessian [var=value ...]  sparse hessian, evaluated at the point if given\n"
+               "       taylor var=point order [var=value ...]  taylor coefficients by var\n"
+               "       bound var=lo:hi ...  guaranteed bounds of f, its partials, its min and max over the box\n"
+               "       solve var=lo:hi count [var=value ...]  newton roots of f from count starts over lo:hi\n"
+               "       minimize count [var=lo:hi ...]  L-BFGS minima of f from count starts in the box\n"
+               "       sample var=a:b count [var=value ...]  f and f' at up to count points, denser where f bends\n"
+               "       eval data_file [f] [d/dvar ...]  outputs at every point of a csv or raw *.bin data file\n"
+               "packed trees (tree_bin.h) are read as they are and written to a resfile named *.dtb\n"
+               "sample and eval write csv, or raw doubles to a resfile named *.dtb or *.bin\n"
+               "--let names shared subtrees of size nodes (%i by default) as temporaries t1, t2...\n"
+               "--reassoc regroups chains for shallow evaluation, results may differ in the last bits\n"
+               "--render=sync runs xdot, dot, pdflatex and evince and waits for them (default), async runs them\n"
+               "  in the background without waiting, none (or --headless) only writes the .gv and .tex files\n",
+               argv[0], LET_MIN_SIZE);
         exit(EXIT_FAILURE);
     }
-    FILE* f_expr = fopen(argv[1], "r");
-    FILE* res_f  = fopen(argv[2], "w");
+    FILE* f_expr = fopen(argv[1], "rb");
+    FILE* res_f  = fopen(argv[2], "wb");
     if (!f_expr)
     {
         printf("Invalid exprfile name\n");
@@ -1349,12 +6446,122 @@ int main(int argc, char* argv[])
         exit(0);
     }
     Differentator my_diff(f_expr, res_f, "MathShit.tex");
+    size_t res_len = strlen(argv[2]);
+    if (res_len > 4 && (!strcmp(argv[2] + res_len - 4, ".dtb") || !strcmp(argv[2] + res_len - 4, ".bin")))
+        my_diff.useBinaryOutput();
+    //--cache=file, --let[=size], --reassoc and --render=mode (--headless) can go anywhere
+    //after the file names, the rest is positional
+    for (int i = 3; i < argc; i++)
+        if (!strncmp(argv[i], "--cache=", 8) || !strncmp(argv[i], "--let", 5) || !strcmp(argv[i], "--reassoc") ||
+            !strncmp(argv[i], "--render=", 9) || !strcmp(argv[i], "--headless"))
+        {
+            if (argv[i][2] == 'c')
+                my_diff.useDiskCache(argv[i] + 8);
+            else if (argv[i][2] == 'l')
+                my_diff.useLetBindings((argv[i][5] == '=')?atoi(argv[i] + 6):LET_MIN_SIZE);
+            else if (!strcmp(argv[i], "--reassoc"))
+                my_diff.useReassociation();
+            else if (!strcmp(argv[i], "--headless") || !strcmp(argv[i] + 9, "none"))
+                my_diff.useRenderer(RENDER_NONE);
+            else if (!strcmp(argv[i] + 9, "async"))
+                my_diff.useRenderer(RENDER_ASYNC);
+            else if (!strcmp(argv[i] + 9, "sync"))
+                my_diff.useRenderer(RENDER_SYNC);
+            else
+            {
+                printf("Unknown render mode '%s', expected sync, async or none\n", argv[i] + 9);
+                exit(EXIT_FAILURE);
+            }
+            for (int j = i; j < argc - 1; j++)
+                argv[j] = argv[j + 1];
+            argc--;
+            i--;
+        }
+    const char* mode = (argc > 3)?argv[3]:"deriv";
 
-    my_diff.buildTree();
-    printf("BUILDED!\n");
-    //my_diff.printTree();
-    //printf("PRINTED!\n");
-    my_diff.derivative(); 
+    if (!strcmp(mode, "jacobian") || !strcmp(mode, "grad"))
+    {
+        my_diff.buildTrees();
+        printf("BUILDED!\n");
+        my_diff.jacobian();
+    }
+    else if (!strcmp(mode, "hessian"))
+    {
+        my_diff.buildTree();
+        printf("BUILDED!\n");
+        double* point = (argc > 4)?my_diff.readPoint(argv + 4, argc - 4):NULL;
+        my_diff.hessian(point);
+        free(point);
+    }
+    else if (!strcmp(mode, "taylor") && argc > 5)
+    {
+        my_diff.buildTree();
+        printf("BUILDED!\n");
+        double* point = (argc > 6)?my_diff.readPoint(argv + 6, argc - 6):NULL;
+        my_diff.taylor(argv[4], atoi(argv[5]), point);
+        free(point);
+    }
+    else if (!strcmp(mode, "bound"))
+    {
+        my_diff.buildTree();
+        printf("BUILDED!\n");
+        double* box_lo = NULL;
+        double* box_hi = NULL;
+        my_diff.readBox(argv + 4, argc - 4, &box_lo, &box_hi);
+        my_diff.bound(box_lo, box_hi);
+        free(box_lo);
+        free(box_hi);
+    }
+    else if (!strcmp(mode, "solve") && argc > 5)
+    {
+        my_diff.buildTree();
+        printf("BUILDED!\n");
+        double* point = (argc > 6)?my_diff.readPoint(argv + 6, argc - 6):NULL;
+        my_diff.solve(argv[4], atoi(argv[5]), point);
+        free(point);
+    }
+    else if (!strcmp(mode, "minimize") && argc > 4)
+    {
+        my_diff.buildTree();
+        printf("BUILDED!\n");
+        double* box_lo = NULL;
+        double* box_hi = NULL;
+        my_diff.readBox(argv + 5, argc - 5, &box_lo, &box_hi);
+        my_diff.minimize(atoi(argv[4]), box_lo, box_hi);
+        free(box_lo);
+        free(box_hi);
+    }
+    else if (!strcmp(mode, "sample") && argc > 5)
+    {
+        my_diff.buildTree();
+        printf("BUILDED!\n");
+        double* point = (argc > 6)?my_diff.readPoint(argv + 6, argc - 6):NULL;
+        my_diff.sample(argv[4], atoi(argv[5]), point);
+        free(point);
+    }
+    else if (!strcmp(mode, "eval") && argc > 4)
+    {
+        my_diff.buildTree();
+        printf("BUILDED!\n");
+        char  f_name[] = "f";
+        char* f_out    = f_name;
+        my_diff.evalFile(argv[4], (argc > 5)?argv + 5:&f_out, (argc > 5)?argc - 5:1);
+    }
+    else if (!strcmp(mode, "deriv"))
+    {
+        my_diff.buildTree();
+        printf("BUILDED!\n");
+        //my_diff.printTree();
+        //printf("PRINTED!\n");
+        double* point = (argc > 5)?my_diff.readPoint(argv + 5, argc - 5):NULL;
+        my_diff.derivative((argc > 4)?argv[4]:NULL, point);
+        free(point);
+    }
+    else
+    {
+        printf("Unknown mode '%s'\n", mode);
+        exit(EXIT_FAILURE);
+    }
     fclose(f_expr);
     fclose(res_f);
 }
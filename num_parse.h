@@ -0,0 +1,174 @@
+#ifndef NUM_PARSE_H
+#define NUM_PARSE_H
+
+//Correctly rounded decimal to double conversion.
+//Number: [+|-] digits [. digits] [e|E [+|-] digits], the integer part may be
+//empty if there is a fraction. Up to 19 significant digits are gathered into
+//an integer w, the number is then w * 10^q:
+//  - w <= 2^53 and |q| <= 22: w and 10^q are exact doubles, so one multiply
+//    or divide rounds correctly (Clinger's fast path);
+//  - otherwise w is multiplied by the truncated 128-bit 5^q of num_pow5.h
+//    (Eisel-Lemire), which is exact for 19 digits;
+//  - if more digits were cut off, w and w + 1 are converted, and only if they
+//    round to different doubles the number goes to strtod.
+
+#include "num_pow5.h"
+
+static const double num_exact_pow10[] =
+{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+enum
+{
+    NUM_MANTISSA_BITS   = 52,
+    NUM_MAX_DIGITS      = 19,
+    NUM_INF_POWER       = 0x7ff
+};
+
+//bits of the double nearest to w * 10^q, without the sign
+static unsigned long long num_eisel_lemire(unsigned long long w, long long q)
+{
+    if (!w || q < NUM_POW5_MIN)
+        return 0;
+    if (q > NUM_POW5_MAX)
+        return (unsigned long long) NUM_INF_POWER << NUM_MANTISSA_BITS;
+
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+    const unsigned long long* pow5 = num_pow5_words(q);
+    unsigned __int128 product = (unsigned __int128) w * pow5[0];
+    unsigned long long hi = (unsigned long long) (product >> 64);
+    unsigned long long lo = (unsigned long long) product;
+    //the low word of 5^q matters only if the bits below the mantissa are all ones
+    const unsigned long long precision_mask = ~0ULL >> (NUM_MANTISSA_BITS + 3);
+    if ((hi & precision_mask) == precision_mask)
+    {
+        unsigned long long second_hi = (unsigned long long) (((unsigned __int128) w * pow5[1]) >> 64);
+        lo += second_hi;
+        if (second_hi > lo)
+            hi++;
+    }
+
+    int upperbit = (int) (hi >> 63);
+    int shift    = upperbit + 64 - NUM_MANTISSA_BITS - 3;
+    unsigned long long mantissa = hi >> shift;
+    //floor(q * log2(10)) + 63, then the bias
+    int power2 = (int) (((152170 + 65536) * q) >> 16) + 63 + upperbit - lz + 1023;
+
+    if (power2 <= 0)
+    {
+        //subnormal, or the smallest normal after rounding up
+        if (-power2 + 1 >= 64)
+            return 0;
+        mantissa >>= -power2 + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        power2 = (mantissa < (1ULL << NUM_MANTISSA_BITS))?0:1;
+        return ((unsigned long long) power2 << NUM_MANTISSA_BITS) | mantissa;
+    }
+    //exactly halfway between two doubles is possible only for small q, it rounds to even
+    if (lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 && (mantissa << shift) == hi)
+        mantissa &= ~1ULL;
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= (2ULL << NUM_MANTISSA_BITS))
+    {
+        mantissa = 1ULL << NUM_MANTISSA_BITS;
+        power2++;
+    }
+    mantissa &= ~(1ULL << NUM_MANTISSA_BITS);
+    if (power2 >= NUM_INF_POWER)
+        return (unsigned long long) NUM_INF_POWER << NUM_MANTISSA_BITS;
+    return ((unsigned long long) power2 << NUM_MANTISSA_BITS) | mantissa;
+}
+
+//returns the char next to the number, NULL if str does not start with one
+static const char* num_parse(const char* str, const char* end, double* res)
+{
+    const char* pos = str;
+    int neg = 0;
+    if (pos < end && (*pos == '-' || *pos == '+'))
+        neg = (*pos++ == '-');
+
+    unsigned long long w = 0;
+    long long q = 0;
+    int n_digits  = 0;  //significant ones, leading zeros do not count
+    int n_read    = 0;
+    int truncated = 0;  //non-zero digits past NUM_MAX_DIGITS were dropped
+    for (; pos < end && '0' <= *pos && *pos <= '9'; pos++, n_read++)
+        if (n_digits < NUM_MAX_DIGITS)
+        {
+            w = w * 10 + (unsigned long long) (*pos - '0');
+            n_digits += (w != 0);
+        }
+        else
+        {
+            q++;
+            truncated |= (*pos != '0');
+        }
+    if (pos < end && *pos == '.')
+    {
+        pos++;
+        for (; pos < end && '0' <= *pos && *pos <= '9'; pos++, n_read++)
+            if (n_digits < NUM_MAX_DIGITS)
+            {
+                w = w * 10 + (unsigned long long) (*pos - '0');
+                n_digits += (w != 0);
+                q--;
+            }
+            else
+                truncated |= (*pos != '0');
+    }
+    if (!n_read)
+        return NULL;
+
+    //'e' is taken only with the digits of the exponent, "2e" stays 2 and a var
+    if (pos < end && (*pos == 'e' || *pos == 'E'))
+    {
+        const char* exp_pos = pos + 1;
+        int exp_neg = 0;
+        if (exp_pos < end && (*exp_pos == '-' || *exp_pos == '+'))
+            exp_neg = (*exp_pos++ == '-');
+        if (exp_pos < end && '0' <= *exp_pos && *exp_pos <= '9')
+        {
+            long long exp = 0;
+            for (; exp_pos < end && '0' <= *exp_pos && *exp_pos <= '9'; exp_pos++)
+                if (exp < 100000)
+                    exp = exp * 10 + (*exp_pos - '0');
+            q  += (exp_neg)?-exp:exp;
+            pos = exp_pos;
+        }
+    }
+
+    double val = 0.0;
+    if (!w)
+        val = 0.0;
+    else if (!truncated && w <= (1ULL << 53) && q >= -22 && q <= 22)
+        val = (q < 0)?(double) w / num_exact_pow10[-q]:(double) w * num_exact_pow10[q];
+    else
+    {
+        unsigned long long bits = num_eisel_lemire(w, q);
+        if (truncated && bits != num_eisel_lemire(w + 1, q))
+        {
+            //the dropped digits decide the rounding
+            size_t len  = (size_t) (pos - str);
+            char*  copy = (char*) calloc (len + 1, sizeof(char));
+            if (!copy)
+            {
+                printf("num_parse: error finding memory for %zu digits\n", len);
+                exit(2);
+            }
+            memcpy(copy, str, len);
+            *res = strtod(copy, NULL);
+            free(copy);
+            return pos;
+        }
+        memcpy(&val, &bits, sizeof(double));
+    }
+    *res = (neg)?-val:val;
+    return pos;
+}
+
+#endif
@@ -0,0 +1,243 @@
+#ifndef NUM_PRINT_H
+#define NUM_PRINT_H
+
+//Shortest round-trip double to text (Ryu): the fewest decimal digits that
+//read back to the same double, the closest to it if there is a choice.
+//Fixed notation while the decimal point is within the digits or a few zeros
+//away ("2", "0.1", "123.25", "0.0001"), "1.5e-07" style otherwise, so the
+//text parses back with num_parse.h or strtod.
+
+#include "num_pow5.h"
+
+enum
+{
+    NUM_PRINT_LEN = 32      //enough for any double and '\0'
+};
+
+static unsigned int num_pow5bits(int e)
+{
+    return (unsigned int) (((e * 1217359) >> 19) + 1);
+}
+
+static unsigned int num_log10pow2(int e)
+{
+    return (unsigned int) ((e * 78913) >> 18);
+}
+
+static unsigned int num_log10pow5(int e)
+{
+    return (unsigned int) ((e * 732923) >> 20);
+}
+
+static int num_pow5factor(unsigned long long val, unsigned int p)
+{
+    unsigned int cnt = 0;
+    for (; val && val % 5 == 0 && cnt < p; val /= 5)
+        cnt++;
+    return cnt >= p;
+}
+
+static unsigned long long num_mul_shift(unsigned long long m, const unsigned long long* mul, int j)
+{
+    unsigned __int128 b0 = (unsigned __int128) m * mul[0];
+    unsigned __int128 b2 = (unsigned __int128) m * mul[1];
+    return (unsigned long long) (((b0 >> 64) + b2) >> (j - 64));
+}
+
+//val = *digits * 10^*exp10 with the fewest digits, val is finite and positive
+static void num_shortest(double val, unsigned long long* digits, int* exp10)
+{
+    unsigned long long bits = 0;
+    memcpy(&bits, &val, sizeof(double));
+    unsigned long long ieee_mantissa = bits & ((1ULL << 52) - 1);
+    int ieee_exponent = (int) ((bits >> 52) & 0x7ff);
+
+    int e2 = 0;
+    unsigned long long m2 = 0;
+    if (!ieee_exponent)
+    {
+        e2 = 1 - 1023 - 52 - 2;
+        m2 = ieee_mantissa;
+    }
+    else
+    {
+        e2 = ieee_exponent - 1023 - 52 - 2;
+        m2 = (1ULL << 52) | ieee_mantissa;
+    }
+    int accept_bounds = !(m2 & 1);
+    unsigned long long mv = 4 * m2;
+    unsigned int mm_shift = (ieee_mantissa != 0 || ieee_exponent <= 1);
+
+    //the value and the halfway points to its neighbours, scaled by a power of ten
+    unsigned long long vr = 0, vp = 0, vm = 0;
+    int e10 = 0;
+    int vm_trailing_zeros = 0, vr_trailing_zeros = 0;
+    if (e2 >= 0)
+    {
+        unsigned int q = num_log10pow2(e2) - (e2 > 3);
+        e10 = (int) q;
+        int k = NUM_POW5_INV_BITS + (int) num_pow5bits((int) q) - 1;
+        int i = -e2 + (int) q + k;
+        vr = num_mul_shift(4 * m2,                num_pow5_inv_split[q], i);
+        vp = num_mul_shift(4 * m2 + 2,            num_pow5_inv_split[q], i);
+        vm = num_mul_shift(4 * m2 - 1 - mm_shift, num_pow5_inv_split[q], i);
+        if (q <= 21)
+        {
+            if (mv % 5 == 0)
+                vr_trailing_zeros = num_pow5factor(mv, q);
+            else if (accept_bounds)
+                vm_trailing_zeros = num_pow5factor(mv - 1 - mm_shift, q);
+            else
+                vp -= (unsigned long long) num_pow5factor(mv + 2, q);
+        }
+    }
+    else
+    {
+        unsigned int q = num_log10pow5(-e2) - (-e2 > 1);
+        e10 = (int) q + e2;
+        int i = -e2 - (int) q;
+        int k = (int) num_pow5bits(i) - NUM_POW5_BITS;
+        int j = (int) q - k;
+        vr = num_mul_shift(4 * m2,                num_pow5_split[i], j);
+        vp = num_mul_shift(4 * m2 + 2,            num_pow5_split[i], j);
+        vm = num_mul_shift(4 * m2 - 1 - mm_shift, num_pow5_split[i], j);
+        if (q <= 1)
+        {
+            vr_trailing_zeros = 1;
+            if (accept_bounds)
+                vm_trailing_zeros = (mm_shift == 1);
+            else
+                vp--;
+        }
+        else if (q < 63)
+            vr_trailing_zeros = !(mv & ((1ULL << q) - 1));
+    }
+
+    //drop digits while the interval still holds a shorter number
+    int removed = 0;
+    unsigned int last_removed = 0;
+    unsigned long long output = 0;
+    if (vm_trailing_zeros || vr_trailing_zeros)
+    {
+        while (vp / 10 > vm / 10)
+        {
+            vm_trailing_zeros &= (vm % 10 == 0);
+            vr_trailing_zeros &= (last_removed == 0);
+            last_removed = (unsigned int) (vr % 10);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vm_trailing_zeros)
+            while (vm % 10 == 0)
+            {
+                vr_trailing_zeros &= (last_removed == 0);
+                last_removed = (unsigned int) (vr % 10);
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        //exactly halfway rounds to even
+        if (vr_trailing_zeros && last_removed == 5 && vr % 2 == 0)
+            last_removed = 4;
+        output = vr + ((vr == vm && (!accept_bounds || !vm_trailing_zeros)) || last_removed >= 5);
+    }
+    else
+    {
+        int round_up = 0;
+        if (vp / 100 > vm / 100)
+        {
+            round_up = (vr % 100 >= 50);
+            vr /= 100;
+            vp /= 100;
+            vm /= 100;
+            removed += 2;
+        }
+        while (vp / 10 > vm / 10)
+        {
+            round_up = (vr % 10 >= 5);
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || round_up);
+    }
+    *digits = output;
+    *exp10  = e10 + removed;
+}
+
+//writes val into dest of NUM_PRINT_LEN chars, returns the length
+static int num_print(double val, char* dest)
+{
+    char* pos = dest;
+    unsigned long long bits = 0;
+    memcpy(&bits, &val, sizeof(double));
+    int all_ones_exp = ((bits >> 52) & 0x7ff) == 0x7ff;
+    if (all_ones_exp && (bits & ((1ULL << 52) - 1)))
+        return (int) (stpcpy(dest, "nan") - dest);
+    if (bits >> 63)
+    {
+        *pos++ = '-';
+        val = -val;
+    }
+    if (all_ones_exp)
+        return (int) (stpcpy(pos, "inf") - dest);
+    if (!(bits << 1))
+        return (int) (stpcpy(pos, "0") - dest);
+
+    unsigned long long digits = 0;
+    int exp10 = 0;
+    num_shortest(val, &digits, &exp10);
+
+    char buf[24] = {};
+    int  n = 0;
+    for (; digits; digits /= 10)
+        buf[n++] = (char) ('0' + digits % 10);
+    //buf holds the digits backwards, the point goes after point_pos of them
+    int point_pos = n + exp10;
+    if (point_pos > 0 && point_pos <= 21)
+    {
+        for (int i = 0; i < point_pos; i++)
+            *pos++ = (i < n)?buf[n - 1 - i]:'0';
+        if (point_pos < n)
+        {
+            *pos++ = '.';
+            for (int i = point_pos; i < n; i++)
+                *pos++ = buf[n - 1 - i];
+        }
+    }
+    else if (point_pos <= 0 && point_pos > -4)
+    {
+        *pos++ = '0';
+        *pos++ = '.';
+        for (int i = point_pos; i < 0; i++)
+            *pos++ = '0';
+        for (int i = 0; i < n; i++)
+            *pos++ = buf[n - 1 - i];
+    }
+    else
+    {
+        *pos++ = buf[n - 1];
+        if (n > 1)
+        {
+            *pos++ = '.';
+            for (int i = n - 2; i >= 0; i--)
+                *pos++ = buf[i];
+        }
+        int e = point_pos - 1;
+        *pos++ = 'e';
+        *pos++ = (e < 0)?'-':'+';
+        e = (e < 0)?-e:e;
+        if (e >= 100)
+            *pos++ = (char) ('0' + e / 100);
+        *pos++ = (char) ('0' + e / 10 % 10);
+        *pos++ = (char) ('0' + e % 10);
+    }
+    *pos = '\0';
+    return (int) (pos - dest);
+}
+
+#endif
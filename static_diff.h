@@ -0,0 +1,441 @@
+#ifndef STATIC_DIFF_H
+#define STATIC_DIFF_H
+
+//Compile-time differentiation of expressions known when the code is written.
+//An expression is a type: x * sin(x + y) with x = Var<0>, y = Var<1> is
+//Mul<Var<0>, Func<FN_sin, Add<Var<0>, Var<1>>>>; its objects only hold the
+//run time consts. deriv<V>(e) returns the derivative by Var<V> as another
+//such type, and eval(vars) of any of them inlines into straight-line code.
+//
+//The operators and functions are the ones of inf_diff.cpp (+ - * / ^ and
+//MATH_FUNCTIONS). Int<N> is a const known at compile time, the rules that
+//inf_diff's simplifier applies to the tree (0 * e, e * 1, e + 0, e^1, e^0 and
+//Int with Int) are applied to the types, so they never reach eval.
+//
+//    Var<0> x;
+//    Var<1> y;
+//    auto f   = x * sin(x + y) + pow(x, Int<3>());
+//    auto dfx = deriv<0>(f);
+//    double vars[] = {1.0, 2.0};
+//    double val = dfx.eval(vars);
+//
+//Needs C++14 (deduced return types), builds with C++17 as well.
+
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+namespace sdiff
+{
+
+/* LEAVES */
+
+template <long N> struct Int
+{
+    constexpr double eval(const double*) const { return (double) N; }
+};
+
+using Zero = Int<0>;
+using One  = Int<1>;
+
+//const known at run time only
+struct Const
+{
+    double val_;
+    constexpr double eval(const double*) const { return val_; }
+};
+
+template <int I> struct Var
+{
+    constexpr double eval(const double* vars) const { return vars[I]; }
+};
+
+/* OPERATIONS */
+
+template <class L, class R> struct Add
+{
+    L l_;
+    R r_;
+    constexpr double eval(const double* vars) const { return l_.eval(vars) + r_.eval(vars); }
+};
+
+template <class L, class R> struct Sub
+{
+    L l_;
+    R r_;
+    constexpr double eval(const double* vars) const { return l_.eval(vars) - r_.eval(vars); }
+};
+
+template <class L, class R> struct Mul
+{
+    L l_;
+    R r_;
+    constexpr double eval(const double* vars) const { return l_.eval(vars) * r_.eval(vars); }
+};
+
+template <class L, class R> struct Div
+{
+    L l_;
+    R r_;
+    constexpr double eval(const double* vars) const { return l_.eval(vars) / r_.eval(vars); }
+};
+
+//b^N by squaring, unrolled for every N
+template <long N> struct IntPow
+{
+    static constexpr double eval(double b) { return ((N % 2)?b:1.0) * IntPow<N / 2>::eval(b * b); }
+};
+
+template <> struct IntPow<0>
+{
+    static constexpr double eval(double) { return 1.0; }
+};
+
+template <class L, class R> struct Pow
+{
+    L l_;
+    R r_;
+    double eval(const double* vars) const { return std::pow(l_.eval(vars), r_.eval(vars)); }
+};
+
+template <class L, long N> struct Pow<L, Int<N>>
+{
+    L l_;
+    Int<N> r_;
+    constexpr double eval(const double* vars) const
+    {
+        return (N < 0)?1.0 / IntPow<(N < 0)?-N:N>::eval(l_.eval(vars)):IntPow<(N < 0)?-N:N>::eval(l_.eval(vars));
+    }
+};
+
+/* FUNCTIONS */
+
+enum FUNC_ID
+{
+#define _FUNCTIONS_
+#define MATH_FUNC(funcName, notused, notused_tex) FN_##funcName,
+#include "MATH_FUNCTIONS"
+#undef MATH_FUNC
+#undef _FUNCTIONS_
+    FN_CNT
+};
+
+template <int F, class A> struct Func;
+
+/* LIFTING */
+
+template <class T> struct IsExpr                        : std::false_type {};
+template <long N>  struct IsExpr<Int<N>>                : std::true_type  {};
+template <>        struct IsExpr<Const>                 : std::true_type  {};
+template <int I>   struct IsExpr<Var<I>>                : std::true_type  {};
+template <class L, class R> struct IsExpr<Add<L, R>>    : std::true_type  {};
+template <class L, class R> struct IsExpr<Sub<L, R>>    : std::true_type  {};
+template <class L, class R> struct IsExpr<Mul<L, R>>    : std::true_type  {};
+template <class L, class R> struct IsExpr<Div<L, R>>    : std::true_type  {};
+template <class L, class R> struct IsExpr<Pow<L, R>>    : std::true_type  {};
+template <int F, class A>   struct IsExpr<Func<F, A>>   : std::true_type  {};
+
+//plain numbers next to an expression become Const
+template <class T> constexpr const T& lift(const T& e, std::true_type) { return e; }
+template <class T> constexpr Const lift(const T& val, std::false_type) { return Const{(double) val}; }
+template <class T> constexpr auto lift(const T& e) -> decltype(lift(e, IsExpr<T>())) { return lift(e, IsExpr<T>()); }
+
+template <class T> using Lifted = typename std::decay<decltype(lift(std::declval<T>()))>::type;
+
+//the builders take part in overloading only next to an expression, std::sin(double) and the like stay as they are
+template <class L, class R> using EnableOp = typename std::enable_if<IsExpr<L>::value || IsExpr<R>::value>::type;
+template <class A>          using EnableFn = typename std::enable_if<IsExpr<A>::value>::type;
+
+#define _FUNCTIONS_
+#define MATH_FUNC(funcName, cppFuncName, notused_tex)                           \
+template <class A> struct Func<FN_##funcName, A>                                \
+{                                                                               \
+    A a_;                                                                       \
+    double eval(const double* vars) const { return std::cppFuncName(a_.eval(vars)); }\
+};                                                                              \
+template <class A, class = EnableFn<A>>                                        \
+constexpr Func<FN_##funcName, A> funcName(const A& a)                           \
+{                                                                               \
+    return Func<FN_##funcName, A>{a};                                           \
+}
+#include "MATH_FUNCTIONS"
+#undef MATH_FUNC
+#undef _FUNCTIONS_
+
+template <class A> using Ln     = Func<FN_ln,   A>;
+template <class A> using Sin    = Func<FN_sin,  A>;
+template <class A> using Cos    = Func<FN_cos,  A>;
+template <class A> using Exp    = Func<FN_exp,  A>;
+template <class A> using Tan    = Func<FN_tan,  A>;
+template <class A> using Sqrt   = Func<FN_sqrt, A>;
+template <class A> using Asin   = Func<FN_asin, A>;
+template <class A> using Acos   = Func<FN_acos, A>;
+template <class A> using Atan   = Func<FN_atan, A>;
+
+/* SIMPLIFYING CONSTRUCTORS */
+
+template <class T> struct IsInt                 : std::false_type {};
+template <long N>  struct IsInt<Int<N>>         : std::true_type  {};
+
+template <class L, class R> struct BothInt : std::integral_constant<bool, IsInt<L>::value && IsInt<R>::value> {};
+
+//the last parameter splits Int with Int (folded) from the rest, so the zero
+//and unit rules below never compete with the folding ones
+
+template <class L, class R, bool = BothInt<L, R>::value> struct AddRule
+{
+    static constexpr Add<L, R> make(const L& l, const R& r) { return Add<L, R>{l, r}; }
+};
+template <long A, long B> struct AddRule<Int<A>, Int<B>, true>
+{
+    static constexpr Int<A + B> make(const Int<A>&, const Int<B>&) { return Int<A + B>(); }
+};
+template <class R> struct AddRule<Zero, R, false>
+{
+    static constexpr R make(const Zero&, const R& r) { return r; }
+};
+template <class L> struct AddRule<L, Zero, false>
+{
+    static constexpr L make(const L& l, const Zero&) { return l; }
+};
+
+template <class L, class R, bool = BothInt<L, R>::value> struct SubRule
+{
+    static constexpr Sub<L, R> make(const L& l, const R& r) { return Sub<L, R>{l, r}; }
+};
+template <long A, long B> struct SubRule<Int<A>, Int<B>, true>
+{
+    static constexpr Int<A - B> make(const Int<A>&, const Int<B>&) { return Int<A - B>(); }
+};
+template <class L> struct SubRule<L, Zero, false>
+{
+    static constexpr L make(const L& l, const Zero&) { return l; }
+};
+
+template <class L, class R, bool = BothInt<L, R>::value> struct MulRule
+{
+    static constexpr Mul<L, R> make(const L& l, const R& r) { return Mul<L, R>{l, r}; }
+};
+template <long A, long B> struct MulRule<Int<A>, Int<B>, true>
+{
+    static constexpr Int<A * B> make(const Int<A>&, const Int<B>&) { return Int<A * B>(); }
+};
+template <class R> struct MulRule<Zero, R, false>
+{
+    static constexpr Zero make(const Zero&, const R&) { return Zero(); }
+};
+template <class L> struct MulRule<L, Zero, false>
+{
+    static constexpr Zero make(const L&, const Zero&) { return Zero(); }
+};
+template <class R> struct MulRule<One, R, false>
+{
+    static constexpr R make(const One&, const R& r) { return r; }
+};
+template <class L> struct MulRule<L, One, false>
+{
+    static constexpr L make(const L& l, const One&) { return l; }
+};
+
+//Int / Int is left alone: the quotient is not an Int
+template <class L, class R> struct DivRule
+{
+    static constexpr Div<L, R> make(const L& l, const R& r) { return Div<L, R>{l, r}; }
+};
+template <class R> struct DivRule<Zero, R>
+{
+    static constexpr Zero make(const Zero&, const R&) { return Zero(); }
+};
+template <class L> struct DivRule<L, One>
+{
+    static constexpr L make(const L& l, const One&) { return l; }
+};
+template <> struct DivRule<Zero, One>
+{
+    static constexpr Zero make(const Zero&, const One&) { return Zero(); }
+};
+
+template <class L, class R> struct PowRule
+{
+    static constexpr Pow<L, R> make(const L& l, const R& r) { return Pow<L, R>{l, r}; }
+};
+template <class L> struct PowRule<L, Zero>
+{
+    static constexpr One make(const L&, const Zero&) { return One(); }
+};
+template <class L> struct PowRule<L, One>
+{
+    static constexpr L make(const L& l, const One&) { return l; }
+};
+
+template <class L, class R, class = EnableOp<L, R>>
+constexpr auto add(const L& l, const R& r) { return AddRule<Lifted<L>, Lifted<R>>::make(lift(l), lift(r)); }
+template <class L, class R, class = EnableOp<L, R>>
+constexpr auto sub(const L& l, const R& r) { return SubRule<Lifted<L>, Lifted<R>>::make(lift(l), lift(r)); }
+template <class L, class R, class = EnableOp<L, R>>
+constexpr auto mul(const L& l, const R& r) { return MulRule<Lifted<L>, Lifted<R>>::make(lift(l), lift(r)); }
+template <class L, class R, class = EnableOp<L, R>>
+constexpr auto div(const L& l, const R& r) { return DivRule<Lifted<L>, Lifted<R>>::make(lift(l), lift(r)); }
+template <class L, class R, class = EnableOp<L, R>>
+constexpr auto pow(const L& l, const R& r) { return PowRule<Lifted<L>, Lifted<R>>::make(lift(l), lift(r)); }
+
+/* OPERATORS */
+
+template <class L, class R, class = EnableOp<L, R>> constexpr auto operator+(const L& l, const R& r) { return add(l, r); }
+template <class L, class R, class = EnableOp<L, R>> constexpr auto operator-(const L& l, const R& r) { return sub(l, r); }
+template <class L, class R, class = EnableOp<L, R>> constexpr auto operator*(const L& l, const R& r) { return mul(l, r); }
+template <class L, class R, class = EnableOp<L, R>> constexpr auto operator/(const L& l, const R& r) { return div(l, r); }
+
+/* DERIVATIVES */
+
+//Deriv<V, E>::make(e) is d e / d Var<V>, every rule simplifies as it builds
+
+template <int V, class E> struct Deriv;
+
+template <int V, long N> struct Deriv<V, Int<N>>
+{
+    static constexpr Zero make(const Int<N>&) { return Zero(); }
+};
+
+template <int V> struct Deriv<V, Const>
+{
+    static constexpr Zero make(const Const&) { return Zero(); }
+};
+
+template <int V, int I> struct Deriv<V, Var<I>>
+{
+    static constexpr Int<V == I> make(const Var<I>&) { return Int<V == I>(); }
+};
+
+template <int V, class L, class R> struct Deriv<V, Add<L, R>>
+{
+    static constexpr auto make(const Add<L, R>& e)
+    {
+        return add(Deriv<V, L>::make(e.l_), Deriv<V, R>::make(e.r_));
+    }
+};
+
+template <int V, class L, class R> struct Deriv<V, Sub<L, R>>
+{
+    static constexpr auto make(const Sub<L, R>& e)
+    {
+        return sub(Deriv<V, L>::make(e.l_), Deriv<V, R>::make(e.r_));
+    }
+};
+
+template <int V, class L, class R> struct Deriv<V, Mul<L, R>>
+{
+    static constexpr auto make(const Mul<L, R>& e)
+    {
+        return add(mul(Deriv<V, L>::make(e.l_), e.r_), mul(e.l_, Deriv<V, R>::make(e.r_)));
+    }
+};
+
+template <int V, class L, class R> struct Deriv<V, Div<L, R>>
+{
+    static constexpr auto make(const Div<L, R>& e)
+    {
+        return div(sub(mul(Deriv<V, L>::make(e.l_), e.r_), mul(e.l_, Deriv<V, R>::make(e.r_))),
+                   pow(e.r_, Int<2>()));
+    }
+};
+
+//(l^r)' = l^r * (r' ln l + r l' / l)
+template <int V, class L, class R> struct Deriv<V, Pow<L, R>>
+{
+    static constexpr auto make(const Pow<L, R>& e)
+    {
+        return mul(e, add(mul(Deriv<V, R>::make(e.r_), ln(e.l_)),
+                          div(mul(e.r_, Deriv<V, L>::make(e.l_)), e.l_)));
+    }
+};
+
+template <int V, class L, long N> struct Deriv<V, Pow<L, Int<N>>>
+{
+    static constexpr auto make(const Pow<L, Int<N>>& e)
+    {
+        return mul(mul(Int<N>(), pow(e.l_, Int<N - 1>())), Deriv<V, L>::make(e.l_));
+    }
+};
+
+template <int V, class L> struct Deriv<V, Pow<L, Const>>
+{
+    static constexpr auto make(const Pow<L, Const>& e)
+    {
+        return mul(mul(e.r_, pow(e.l_, Const{e.r_.val_ - 1})), Deriv<V, L>::make(e.l_));
+    }
+};
+
+//function rules: f'(a) * a', the f'(a) part per MATH_FUNCTIONS entry
+template <int F> struct FuncDeriv;
+
+template <> struct FuncDeriv<FN_ln>
+{
+    template <class A> static constexpr auto outer(const Ln<A>& e) { return div(One(), e.a_); }
+};
+
+template <> struct FuncDeriv<FN_sin>
+{
+    template <class A> static constexpr auto outer(const Sin<A>& e) { return cos(e.a_); }
+};
+
+template <> struct FuncDeriv<FN_cos>
+{
+    template <class A> static constexpr auto outer(const Cos<A>& e) { return mul(Int<-1>(), sin(e.a_)); }
+};
+
+template <> struct FuncDeriv<FN_exp>
+{
+    template <class A> static constexpr auto outer(const Exp<A>& e) { return e; }
+};
+
+template <> struct FuncDeriv<FN_tan>
+{
+    template <class A> static constexpr auto outer(const Tan<A>& e) { return div(One(), pow(cos(e.a_), Int<2>())); }
+};
+
+template <> struct FuncDeriv<FN_sqrt>
+{
+    template <class A> static constexpr auto outer(const Sqrt<A>& e) { return div(One(), mul(Int<2>(), e)); }
+};
+
+template <> struct FuncDeriv<FN_asin>
+{
+    template <class A> static constexpr auto outer(const Asin<A>& e)
+    {
+        return div(One(), sqrt(sub(One(), pow(e.a_, Int<2>()))));
+    }
+};
+
+template <> struct FuncDeriv<FN_acos>
+{
+    template <class A> static constexpr auto outer(const Acos<A>& e)
+    {
+        return div(Int<-1>(), sqrt(sub(One(), pow(e.a_, Int<2>()))));
+    }
+};
+
+template <> struct FuncDeriv<FN_atan>
+{
+    template <class A> static constexpr auto outer(const Atan<A>& e)
+    {
+        return div(One(), add(One(), pow(e.a_, Int<2>())));
+    }
+};
+
+template <int V, int F, class A> struct Deriv<V, Func<F, A>>
+{
+    static constexpr auto make(const Func<F, A>& e)
+    {
+        return mul(FuncDeriv<F>::outer(e), Deriv<V, A>::make(e.a_));
+    }
+};
+
+template <int V, class E> constexpr auto deriv(const E& e)
+{
+    return Deriv<V, E>::make(e);
+}
+
+}
+
+#endif
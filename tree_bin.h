@@ -0,0 +1,105 @@
+#ifndef TREE_BIN_H
+#define TREE_BIN_H
+
+//Binary tree format shared by the differentiators.
+//
+//File: "DIFFTREE" magic, unsigned int version, unsigned int reserved (0),
+//then the body. The body alone is also the record format of the derivative
+//cache. Body, all counts are varints:
+//    n_nodes, n_consts, n_syms
+//    n_consts raw doubles (native byte order)
+//    n_syms symbols: length + chars, no '\0'
+//    n_nodes ops in post-order:
+//        'c'                 next const of the table
+//        'v' sym             var
+//        'f' sym n_kids      function of the last n_kids nodes
+//        action n_kids       '+', '-', '*', '/', '^' of the last n_kids nodes
+//                            (2, or any number >= 2 for '+' and '*')
+//A reader keeps a stack of finished nodes and builds the tree in one pass.
+
+#define TREE_BIN_MAGIC "DIFFTREE"
+
+enum
+{
+    TREE_BIN_VERSION     = 1,
+    TREE_BIN_HEADER_LEN  = 16
+};
+
+//growable byte buffer a body is written into
+struct Blob
+{
+    unsigned char*  data_;
+    size_t          size_;
+    size_t          cap_;
+};
+
+static inline void blob_put(Blob* blob, const void* bytes, size_t len)
+{
+    if (blob->size_ + len > blob->cap_)
+    {
+        blob->cap_  = (blob->cap_ * 2 > blob->size_ + len)?blob->cap_ * 2:blob->size_ + len + 64;
+        blob->data_ = (unsigned char*) realloc (blob->data_, blob->cap_);
+        if (!blob->data_)
+        {
+            printf("blob_put: error finding memory for %zu bytes\n", blob->cap_);
+            exit(2);
+        }
+    }
+    memcpy(blob->data_ + blob->size_, bytes, len);
+    blob->size_ += len;
+}
+
+static inline void blob_put_varint(Blob* blob, unsigned long long val)
+{
+    unsigned char bytes[10] = {};
+    size_t len = 0;
+    do
+    {
+        bytes[len] = (unsigned char) (val & 0x7f);
+        val >>= 7;
+        if (val)
+            bytes[len] |= 0x80;
+        len++;
+    }
+    while (val);
+    blob_put(blob, bytes, len);
+}
+
+static inline unsigned long long blob_get_varint(const unsigned char** pos, const unsigned char* end)
+{
+    unsigned long long val = 0;
+    for (int shift = 0; *pos < end && shift < 64; shift += 7)
+    {
+        unsigned char byte = *(*pos)++;
+        val |= (unsigned long long) (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return val;
+    }
+    printf("blob_get_varint: packed tree is truncated\n");
+    exit(5);
+}
+
+static inline void blob_put_header(Blob* blob)
+{
+    unsigned int version = TREE_BIN_VERSION, reserved = 0;
+    blob_put(blob, TREE_BIN_MAGIC, 8);
+    blob_put(blob, &version,  sizeof(unsigned int));
+    blob_put(blob, &reserved, sizeof(unsigned int));
+}
+
+//returns the body of a mapped file, NULL if it is not a tree file
+static inline const unsigned char* blob_get_header(const unsigned char* file, size_t len)
+{
+    unsigned int version = 0;
+    if (len < TREE_BIN_HEADER_LEN || memcmp(file, TREE_BIN_MAGIC, 8))
+        return NULL;
+    memcpy(&version, file + 8, sizeof(unsigned int));
+    if (version != TREE_BIN_VERSION)
+    {
+        printf("tree file version %u is not supported, expected %i\n", version, TREE_BIN_VERSION);
+        exit(5);
+    }
+    return file + TREE_BIN_HEADER_LEN;
+}
+
+#endif